@@ -71,6 +71,12 @@ extern "C" {
 
 // api version history:
 // 9.9 -- devel
+// 1.7 -- deadbeef-0.6.2
+//   adds read_float and probe methods to decoder plugins
+//   adds cond_wait_locked
+//   adds performance counters
+//   adds get_delay method to output plugins
+//   adds duration cache
 // 1.6 -- deadbeef-0.6.1
 // 1.5 -- deadbeef-0.6
 // 1.4 -- deadbeef-0.5.5
@@ -91,7 +97,7 @@ extern "C" {
 // 0.1 -- deadbeef-0.2.0
 
 #define DB_API_VERSION_MAJOR 1
-#define DB_API_VERSION_MINOR 6
+#define DB_API_VERSION_MINOR 7
 
 #define DDB_DEPRECATED(x)
 
@@ -509,6 +515,8 @@ typedef struct {
     int (*mutex_unlock) (uintptr_t mtx);
     uintptr_t (*cond_create) (void);
     void (*cond_free) (uintptr_t cond);
+    // locks the mutex and waits, returns with the mutex locked;
+    // must be called without holding the mutex, see also cond_wait_locked
     int (*cond_wait) (uintptr_t cond, uintptr_t mutex);
     int (*cond_signal) (uintptr_t cond);
     int (*cond_broadcast) (uintptr_t cond);
@@ -1031,6 +1039,46 @@ typedef struct {
 #if (DDB_API_LEVEL >= 6)
     void (*plt_set_scroll) (ddb_playlist_t *plt, int scroll);
     int (*plt_get_scroll) (ddb_playlist_t *plt);
+#endif
+    // since 1.7
+#if (DDB_API_LEVEL >= 7)
+    // same as pthread_cond_wait: the caller must hold the mutex (locked once),
+    // it is released while waiting, and locked again on return.
+    // unlike cond_wait, there's no window where a signal can get lost between
+    // checking a condition and starting to wait
+    int (*cond_wait_locked) (uintptr_t cond, uintptr_t mutex);
+
+    // performance counters, for timing plugin code which runs during playback.
+    // perf_counter returns a counter handle for a name, e.g.
+    // "output.alsa.write", registering it on the first call; it's fine to
+    // cache it, and 0 is a valid no-op handle.
+    // timing is only done when enabled by the perf.enable config option,
+    // otherwise perf_begin returns 0, and perf_end does nothing:
+    //   int64_t t = deadbeef->perf_begin ();
+    //   ...
+    //   deadbeef->perf_end (counter, t);
+    // perf_add counts events, like xruns, instead of time.
+    // perf_report prints a table of all counters into the buffer, and
+    // returns the number of bytes written.
+    uintptr_t (*perf_counter) (const char *name);
+    int64_t (*perf_begin) (void);
+    void (*perf_end) (uintptr_t counter, int64_t start);
+    void (*perf_add) (uintptr_t counter, int64_t value);
+    int (*perf_report) (char *buffer, int size);
+    void (*perf_reset) (void);
+
+    // persistent cache for durations which are slow to find, e.g. by
+    // playing the whole song through; to be consulted in insert before
+    // doing that.
+    // entries are keyed by a digest of the decoder id and the file contents,
+    // so they survive renames; change the id passed to duration_cache_key
+    // (e.g. "dumb" -> "dumb.2") if the way durations are found changes.
+    // duration_cache_key returns -1 if the file can't be read;
+    // duration_cache_get returns the duration of a subtune in seconds, or -1
+    // if it's not cached.
+    int (*duration_cache_key) (const char *id, const char *fname, uint8_t key[16]);
+    float (*duration_cache_get) (const uint8_t key[16], int subtune);
+    void (*duration_cache_set) (const uint8_t key[16], int subtune, float duration);
 #endif
 } DB_functions_t;
 
@@ -1210,8 +1258,17 @@ typedef struct DB_fileinfo_s {
 
 enum {
     DDB_DECODER_HINT_16BIT = 0x1, // that flag means streamer prefers 16 bit streams for performance reasons
+    DDB_DECODER_HINT_OFFLINE = 0x2, // decoding for conversion or analysis rather than playback, decoder may trade memory for speed
 };
 
+#if (DDB_API_LEVEL >= 7)
+// flags for DB_decoder_t.probe
+enum {
+    DDB_PROBE_FORMAT = 0x1, // duration, :CHANNELS, :SAMPLERATE, :BPS, :FILE_SIZE, :BITRATE
+    DDB_PROBE_TAGS = 0x2, // all tags, replacing the existing ones, same as read_metadata
+};
+#endif
+
 // decoder plugin
 typedef struct DB_decoder_s {
     DB_plugin_t plugin;
@@ -1252,6 +1309,28 @@ typedef struct DB_decoder_s {
     // NULL terminated array of all supported prefixes (UADE support needs that)
     // e.g. "mod.song_title"
     const char **prefixes;
+
+#if (DDB_API_LEVEL >= 7)
+    // optional, can be NULL
+    // same as read, but decodes to 32 bit float samples (interleaved, same
+    // channels/samplerate as info->fmt), for decoders which produce float or
+    // planar data internally; saves the int conversion when the caller
+    // needs float anyway (dsp chain, converter, analysis)
+    // nbytes and return value are in bytes of float data
+    // check plugin.api_vminor >= 7 before using
+    int (*read_float) (DB_fileinfo_t *info, float *buffer, int nbytes);
+
+    // optional, can be NULL
+    // refreshes format info and/or tags of an existing track from the file
+    // at its :URI, reading as little as possible (normally only the headers
+    // and tag blocks); doesn't initialize a decoder or scan the stream.
+    // meant for rescans, where insert would be too heavy and read_metadata
+    // doesn't pick up format/duration changes
+    // flags is a combination of DDB_PROBE_*
+    // returns 0 on success, -1 on error
+    // check plugin.api_vminor >= 7 before using
+    int (*probe) (DB_playItem_t *it, uint32_t flags);
+#endif
 } DB_decoder_t;
 
 // output plugin
@@ -1279,6 +1358,13 @@ typedef struct DB_output_s {
 
     // set to 1 if volume control is done internally by plugin
     int has_volume;
+
+#if (DDB_API_LEVEL >= 7)
+    // returns the number of frames which were passed to the device, but not
+    // played yet; used to report the playback position of what's actually
+    // heard. can be NULL
+    int (*get_delay) (void);
+#endif
 } DB_output_t;
 
 // dsp plugin
@@ -0,0 +1,374 @@
+/*
+  This file is part of Deadbeef Player source code
+  http://deadbeef.sourceforge.net
+
+  pipelined dsp chain executor
+
+  Copyright (C) 2009-2013 Alexey Yakovenko
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  Alexey Yakovenko waker@users.sourceforge.net
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+#include "threading.h"
+#include "perf.h"
+#include "dsppipe.h"
+
+//#define trace(...) { fprintf(stderr, __VA_ARGS__); }
+#define trace(fmt,...)
+
+typedef struct {
+    float *samples;
+    int alloc; // in floats
+    int frames;
+    int consumed;
+    ddb_waveformat_t fmt;
+    float ratio;
+    int stage; // next stage to run, nstages when done
+    int busy; // a stage worker is processing it
+} dsppipe_block_t;
+
+typedef struct {
+    dsppipe_t *pipe;
+    ddb_dsp_context_t *ctx;
+    int idx;
+    intptr_t tid;
+    uintptr_t perf;
+    double cputime;
+    int64_t blocks;
+    int64_t frames;
+} dsppipe_stage_t;
+
+struct dsppipe_s {
+    uintptr_t mutex;
+    uintptr_t cond;
+    ddb_dsp_context_t *chain;
+    dsppipe_stage_t *stages;
+    int nstages;
+    int running;
+    int terminate;
+    // ring of blocks; slots [head, head+count) are in use, oldest first
+    dsppipe_block_t *slots;
+    int nslots;
+    int head;
+    int count;
+};
+
+static double
+dsppipe_cputime (void) {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (!clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts)) {
+        return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+    }
+#endif
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+dsppipe_t *
+dsppipe_new (void) {
+    dsppipe_t *p = calloc (1, sizeof (dsppipe_t));
+    if (!p) {
+        return NULL;
+    }
+    p->mutex = mutex_create ();
+    p->cond = cond_create ();
+    return p;
+}
+
+static void
+dsppipe_stop (dsppipe_t *p) {
+    if (!p->running) {
+        return;
+    }
+    mutex_lock (p->mutex);
+    p->terminate = 1;
+    cond_broadcast (p->cond);
+    mutex_unlock (p->mutex);
+    for (int i = 0; i < p->nstages; i++) {
+        thread_join (p->stages[i].tid);
+    }
+    mutex_lock (p->mutex);
+    for (int i = 0; i < p->nslots; i++) {
+        if (p->slots[i].samples) {
+            free (p->slots[i].samples);
+        }
+    }
+    free (p->slots);
+    p->slots = NULL;
+    p->nslots = 0;
+    free (p->stages);
+    p->stages = NULL;
+    p->nstages = 0;
+    p->head = 0;
+    p->count = 0;
+    p->running = 0;
+    p->terminate = 0;
+    mutex_unlock (p->mutex);
+}
+
+void
+dsppipe_free (dsppipe_t *p) {
+    dsppipe_stop (p);
+    cond_free (p->cond);
+    mutex_free (p->mutex);
+    free (p);
+}
+
+void
+dsppipe_set_chain (dsppipe_t *p, ddb_dsp_context_t *chain) {
+    dsppipe_stop (p);
+    p->chain = chain;
+}
+
+// must be called with the pipe locked
+static dsppipe_block_t *
+dsppipe_find_block (dsppipe_t *p, int stage) {
+    for (int i = 0; i < p->count; i++) {
+        dsppipe_block_t *b = &p->slots[(p->head + i) % p->nslots];
+        if (b->stage == stage && !b->busy) {
+            return b;
+        }
+        if (b->stage <= stage) {
+            // later blocks can't be ahead of this one
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void
+dsppipe_worker (void *ctx) {
+    dsppipe_stage_t *st = ctx;
+    dsppipe_t *p = st->pipe;
+    mutex_lock (p->mutex);
+    for (;;) {
+        dsppipe_block_t *b = NULL;
+        while (!p->terminate && !(b = dsppipe_find_block (p, st->idx))) {
+            cond_wait_locked (p->cond, p->mutex);
+        }
+        if (p->terminate) {
+            break;
+        }
+        b->busy = 1;
+        mutex_unlock (p->mutex);
+
+        // enabled can be toggled at any time, a disabled stage passes the
+        // block through
+        double t = dsppipe_cputime ();
+        if (st->ctx->enabled && b->frames > 0) {
+            float r = 1;
+            int64_t perf_start = perf_begin ();
+            b->frames = st->ctx->plugin->process (st->ctx, b->samples, b->frames, b->alloc / b->fmt.channels, &b->fmt, &r);
+            perf_end (st->perf, perf_start);
+            if (b->frames < 0) {
+                b->frames = 0;
+            }
+            b->ratio *= r;
+        }
+        t = dsppipe_cputime () - t;
+
+        mutex_lock (p->mutex);
+        st->cputime += t;
+        st->blocks++;
+        st->frames += b->frames;
+        b->busy = 0;
+        b->stage++;
+        cond_broadcast (p->cond);
+    }
+    mutex_unlock (p->mutex);
+}
+
+// must be called with the pipe locked
+static int
+dsppipe_start (dsppipe_t *p) {
+    int n = 0;
+    for (ddb_dsp_context_t *dsp = p->chain; dsp; dsp = dsp->next) {
+        n++;
+    }
+    // one block per stage, plus one which is being filled or consumed
+    p->slots = calloc (n + 1, sizeof (dsppipe_block_t));
+    p->stages = calloc (n ? n : 1, sizeof (dsppipe_stage_t));
+    if (!p->slots || !p->stages) {
+        free (p->slots);
+        p->slots = NULL;
+        free (p->stages);
+        p->stages = NULL;
+        return -1;
+    }
+    p->nslots = n + 1;
+    p->head = 0;
+    p->count = 0;
+    p->running = 1;
+    ddb_dsp_context_t *dsp = p->chain;
+    for (int i = 0; i < n; i++, dsp = dsp->next) {
+        dsppipe_stage_t *st = &p->stages[i];
+        st->pipe = p;
+        st->ctx = dsp;
+        st->idx = i;
+        char name[100];
+        snprintf (name, sizeof (name), "dsp.%s.process", dsp->plugin->plugin.id);
+        st->perf = perf_counter (name);
+        st->tid = thread_start (dsppipe_worker, st);
+        if (!st->tid) {
+            return -1;
+        }
+        p->nstages++;
+    }
+    trace ("dsppipe: started %d stages\n", n);
+    return 0;
+}
+
+void
+dsppipe_flush (dsppipe_t *p) {
+    mutex_lock (p->mutex);
+    for (;;) {
+        int busy = 0;
+        for (int i = 0; i < p->nslots; i++) {
+            if (p->slots[i].busy) {
+                busy = 1;
+                break;
+            }
+        }
+        if (!busy) {
+            break;
+        }
+        cond_wait_locked (p->cond, p->mutex);
+    }
+    p->head = 0;
+    p->count = 0;
+    cond_broadcast (p->cond);
+    mutex_unlock (p->mutex);
+}
+
+int
+dsppipe_can_submit (dsppipe_t *p) {
+    mutex_lock (p->mutex);
+    int res = !p->running || p->count < p->nslots;
+    mutex_unlock (p->mutex);
+    return res;
+}
+
+int
+dsppipe_pending (dsppipe_t *p) {
+    mutex_lock (p->mutex);
+    int res = p->count;
+    mutex_unlock (p->mutex);
+    return res;
+}
+
+int
+dsppipe_submit (dsppipe_t *p, const float *samples, int frames, int maxframes, const ddb_waveformat_t *fmt) {
+    mutex_lock (p->mutex);
+    if (!p->running && dsppipe_start (p) < 0) {
+        mutex_unlock (p->mutex);
+        fprintf (stderr, "dsppipe: failed to start workers\n");
+        dsppipe_stop (p);
+        return -1;
+    }
+    if (p->count == p->nslots) {
+        mutex_unlock (p->mutex);
+        return -1;
+    }
+    dsppipe_block_t *b = &p->slots[(p->head + p->count) % p->nslots];
+    if (maxframes < frames) {
+        maxframes = frames;
+    }
+    int need = maxframes * fmt->channels;
+    if (b->alloc < need) {
+        float *s = realloc (b->samples, need * sizeof (float));
+        if (!s) {
+            mutex_unlock (p->mutex);
+            return -1;
+        }
+        b->samples = s;
+        b->alloc = need;
+    }
+    memcpy (b->samples, samples, frames * fmt->channels * sizeof (float));
+    memcpy (&b->fmt, fmt, sizeof (ddb_waveformat_t));
+    b->frames = frames;
+    b->consumed = 0;
+    b->ratio = 1;
+    b->stage = 0;
+    b->busy = 0;
+    p->count++;
+    cond_broadcast (p->cond);
+    mutex_unlock (p->mutex);
+    return 0;
+}
+
+float *
+dsppipe_peek (dsppipe_t *p, int *frames, ddb_waveformat_t *fmt, float *ratio, int wait) {
+    mutex_lock (p->mutex);
+    while (wait && p->count > 0 && p->slots[p->head].stage < p->nstages) {
+        cond_wait_locked (p->cond, p->mutex);
+    }
+    if (!p->count || p->slots[p->head].stage < p->nstages) {
+        mutex_unlock (p->mutex);
+        return NULL;
+    }
+    dsppipe_block_t *b = &p->slots[p->head];
+    *frames = b->frames - b->consumed;
+    memcpy (fmt, &b->fmt, sizeof (ddb_waveformat_t));
+    *ratio = b->ratio;
+    float *res = b->samples + b->consumed * b->fmt.channels;
+    mutex_unlock (p->mutex);
+    return res;
+}
+
+void
+dsppipe_consume (dsppipe_t *p, int frames) {
+    mutex_lock (p->mutex);
+    // the block could have been dropped by a flush meanwhile
+    if (p->count && p->slots[p->head].stage == p->nstages) {
+        dsppipe_block_t *b = &p->slots[p->head];
+        b->consumed += frames;
+        if (b->consumed >= b->frames) {
+            p->head = (p->head + 1) % p->nslots;
+            p->count--;
+            cond_broadcast (p->cond);
+        }
+    }
+    mutex_unlock (p->mutex);
+}
+
+void
+dsppipe_print_stats (dsppipe_t *p) {
+    mutex_lock (p->mutex);
+    double total = 0;
+    int slowest = -1;
+    for (int i = 0; i < p->nstages; i++) {
+        total += p->stages[i].cputime;
+        if (slowest < 0 || p->stages[i].cputime > p->stages[slowest].cputime) {
+            slowest = i;
+        }
+    }
+    if (total > 0) {
+        for (int i = 0; i < p->nstages; i++) {
+            dsppipe_stage_t *st = &p->stages[i];
+            fprintf (stderr, "dsppipe: stage %d (%s): %lld blocks, %lld frames, %.3f sec cpu, %.1f%%%s\n", i, st->ctx->plugin->plugin.id, (long long)st->blocks, (long long)st->frames, st->cputime, st->cputime * 100 / total, i == slowest ? " <- slowest" : "");
+        }
+    }
+    mutex_unlock (p->mutex);
+}
@@ -0,0 +1,88 @@
+/*
+  This file is part of Deadbeef Player source code
+  http://deadbeef.sourceforge.net
+
+  pipelined dsp chain executor
+
+  Copyright (C) 2009-2013 Alexey Yakovenko
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  Alexey Yakovenko waker@users.sourceforge.net
+*/
+
+// runs every dsp context of a chain on its own thread, so that block N can
+// be in the 2nd stage while block N+1 is in the 1st one.
+// blocks go through a small ring of slots, so the added latency is bounded
+// by the number of slots, and output comes out in submission order.
+
+#ifndef __DSPPIPE_H
+#define __DSPPIPE_H
+
+#include "deadbeef.h"
+
+typedef struct dsppipe_s dsppipe_t;
+
+dsppipe_t *
+dsppipe_new (void);
+
+void
+dsppipe_free (dsppipe_t *p);
+
+// drops all blocks, stops the workers and remembers the new chain;
+// workers for the new chain are started on the next submit.
+// must not run at the same time as submit/peek/consume, flush is fine
+void
+dsppipe_set_chain (dsppipe_t *p, ddb_dsp_context_t *chain);
+
+// drops all queued and processed blocks; waits for workers which are busy
+// with one; safe to call from any thread
+void
+dsppipe_flush (dsppipe_t *p);
+
+// returns 1 if there's a free slot for dsppipe_submit
+int
+dsppipe_can_submit (dsppipe_t *p);
+
+// number of blocks which were submitted but not fully consumed yet
+int
+dsppipe_pending (dsppipe_t *p);
+
+// copies frames of interleaved float samples in fmt into a free slot and
+// queues them for the first stage; maxframes is the capacity for stages
+// which produce more frames than they consume, like process() has it.
+// returns -1 if there's no free slot, or on allocation error
+int
+dsppipe_submit (dsppipe_t *p, const float *samples, int frames, int maxframes, const ddb_waveformat_t *fmt);
+
+// returns the unconsumed frames of the oldest block, if it passed all
+// stages, and its output format and the combined ratio of the chain;
+// with wait set, blocks until it's done.
+// returns NULL if nothing is ready, or if nothing is pending
+float *
+dsppipe_peek (dsppipe_t *p, int *frames, ddb_waveformat_t *fmt, float *ratio, int wait);
+
+// marks frames returned by dsppipe_peek as consumed; the slot is released
+// when all of them are
+void
+dsppipe_consume (dsppipe_t *p, int frames);
+
+// prints per-stage cpu time to stderr, to find the slowest stage
+void
+dsppipe_print_stats (dsppipe_t *p);
+
+#endif
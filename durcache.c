@@ -0,0 +1,340 @@
+/*
+  This file is part of Deadbeef Player source code
+  http://deadbeef.sourceforge.net
+
+  persistent cache of computed durations
+
+  Copyright (C) 2009-2013 Alexey Yakovenko
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  Alexey Yakovenko waker@users.sourceforge.net
+*/
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "threading.h"
+#include "vfs.h"
+#include "md5/md5.h"
+#include "durcache.h"
+
+//#define trace(...) { fprintf(stderr, __VA_ARGS__); }
+#define trace(fmt,...)
+
+#define DURCACHE_MAGIC "DDBDUR2"
+
+// the file is append-only, and is rewritten on load once it has more than
+// that many duplicate records, and more duplicates than live ones
+#define DURCACHE_COMPACT_MIN 1000
+
+typedef struct {
+    uint8_t key[16];
+    int32_t subtune; // subtune + 1, so that 0 marks a free slot
+    float duration;
+} durcache_entry_t;
+
+// record format of the file
+typedef struct {
+    uint8_t key[16];
+    int32_t subtune;
+    float duration;
+    uint32_t check; // hash of the fields above, catches torn and garbage writes
+} durcache_record_t;
+
+static uintptr_t mutex;
+static int loaded;
+// hash table with linear probing
+static durcache_entry_t *table;
+static int table_size; // power of 2
+static int table_count;
+static FILE *fp;
+
+static int
+durcache_path (char *path, int size) {
+    const char *cache = getenv ("XDG_CACHE_HOME");
+    if (!cache && !getenv ("HOME")) {
+        return -1;
+    }
+    return snprintf (path, size, cache ? "%s/deadbeef/durations.bin" : "%s/.cache/deadbeef/durations.bin", cache ? cache : getenv ("HOME")) < size ? 0 : -1;
+}
+
+static durcache_entry_t *
+durcache_find (const uint8_t key[16], int subtune) {
+    uint32_t h;
+    memcpy (&h, key, 4);
+    h ^= subtune * 2654435761u;
+    for (int i = h & (table_size - 1);; i = (i + 1) & (table_size - 1)) {
+        durcache_entry_t *e = &table[i];
+        if (!e->subtune || (e->subtune == subtune + 1 && !memcmp (e->key, key, 16))) {
+            return e;
+        }
+    }
+}
+
+// must be called with the mutex locked
+static int
+durcache_insert (const uint8_t key[16], int subtune, float duration) {
+    if ((table_count + 1) * 10 > table_size * 7) {
+        int oldsize = table_size;
+        durcache_entry_t *old = table;
+        int newsize = table_size ? table_size * 2 : 1024;
+        durcache_entry_t *t = calloc (newsize, sizeof (durcache_entry_t));
+        if (!t) {
+            return -1;
+        }
+        table = t;
+        table_size = newsize;
+        for (int i = 0; i < oldsize; i++) {
+            if (old[i].subtune) {
+                *durcache_find (old[i].key, old[i].subtune - 1) = old[i];
+            }
+        }
+        free (old);
+    }
+    durcache_entry_t *e = durcache_find (key, subtune);
+    if (!e->subtune) {
+        memcpy (e->key, key, 16);
+        e->subtune = subtune + 1;
+        table_count++;
+    }
+    e->duration = duration;
+    return 0;
+}
+
+// FNV-1a over everything but the check field
+static uint32_t
+durcache_check (const durcache_record_t *r) {
+    const uint8_t *p = (const uint8_t *)r;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof (durcache_record_t, check); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void
+durcache_make_record (durcache_record_t *r, const uint8_t key[16], int subtune, float duration) {
+    memcpy (r->key, key, 16);
+    r->subtune = subtune;
+    r->duration = duration;
+    r->check = durcache_check (r);
+}
+
+// must be called with the mutex locked
+// replaces the file with one record per table entry, through a temporary
+// file, so that a crash never leaves a partial cache behind
+static void
+durcache_rewrite (void) {
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    if (durcache_path (path, sizeof (path)) < 0 || snprintf (tmp, sizeof (tmp), "%s.part", path) >= sizeof (tmp)) {
+        return;
+    }
+    if (fp) {
+        fclose (fp);
+        fp = NULL;
+    }
+    FILE *out = fopen (tmp, "wb");
+    if (!out) {
+        trace ("durcache: failed to open %s\n", tmp);
+        return;
+    }
+    int err = fwrite (DURCACHE_MAGIC, 1, 8, out) != 8;
+    for (int i = 0; !err && i < table_size; i++) {
+        if (table[i].subtune) {
+            durcache_record_t r;
+            durcache_make_record (&r, table[i].key, table[i].subtune - 1, table[i].duration);
+            err = fwrite (&r, sizeof (r), 1, out) != 1;
+        }
+    }
+    if (fclose (out) || err || rename (tmp, path)) {
+        unlink (tmp);
+        return;
+    }
+    trace ("durcache: rewrote %s with %d entries\n", path, table_count);
+}
+
+// must be called with the mutex locked
+// invalid records are skipped, and a short one ends the file; the file is
+// rewritten without them then, and also when it's mostly duplicates
+static void
+durcache_load (void) {
+    loaded = 1;
+    char path[PATH_MAX];
+    if (durcache_path (path, sizeof (path)) < 0) {
+        return;
+    }
+    FILE *in = fopen (path, "rb");
+    if (!in) {
+        return;
+    }
+    int rewrite = 0;
+    int failed = 0;
+    int nrecords = 0;
+    char magic[8];
+    if (fread (magic, 1, 8, in) != 8 || memcmp (magic, DURCACHE_MAGIC, 8)) {
+        trace ("durcache: bad header in %s\n", path);
+        rewrite = 1;
+    }
+    else {
+        durcache_record_t r;
+        size_t rb;
+        while ((rb = fread (&r, 1, sizeof (r), in)) == sizeof (r)) {
+            if (r.check != durcache_check (&r) || r.subtune < 0) {
+                // records are fixed size, so only this one is lost
+                trace ("durcache: bad record %d in %s\n", nrecords, path);
+                rewrite = 1;
+                continue;
+            }
+            if (durcache_insert (r.key, r.subtune, r.duration) < 0) {
+                failed = 1;
+                break;
+            }
+            nrecords++;
+        }
+        if (rb > 0 && rb < sizeof (r)) {
+            trace ("durcache: short record %d in %s\n", nrecords, path);
+            rewrite = 1;
+        }
+    }
+    fclose (in);
+    int duplicates = nrecords - table_count;
+    if (duplicates > DURCACHE_COMPACT_MIN && duplicates > table_count) {
+        rewrite = 1;
+    }
+    // don't drop what didn't fit into memory
+    if (rewrite && !failed) {
+        durcache_rewrite ();
+    }
+    trace ("durcache: loaded %d entries from %d records\n", table_count, nrecords);
+}
+
+// must be called with the mutex locked
+static void
+durcache_append (const durcache_record_t *r) {
+    if (!fp) {
+        char path[PATH_MAX];
+        if (durcache_path (path, sizeof (path)) < 0) {
+            return;
+        }
+        // create the cache dir, and its parent if it's the default one
+        char *slash = strrchr (path, '/');
+        *slash = 0;
+        char *parent = strrchr (path, '/');
+        *parent = 0;
+        mkdir (path, 0755);
+        *parent = '/';
+        mkdir (path, 0755);
+        *slash = '/';
+        fp = fopen (path, "ab");
+        if (!fp) {
+            trace ("durcache: failed to open %s\n", path);
+            return;
+        }
+        if (ftell (fp) == 0) {
+            fwrite (DURCACHE_MAGIC, 1, 8, fp);
+        }
+    }
+    fwrite (r, sizeof (*r), 1, fp);
+    fflush (fp);
+}
+
+void
+durcache_init (void) {
+    mutex = mutex_create_nonrecursive ();
+}
+
+void
+durcache_free (void) {
+    if (fp) {
+        fclose (fp);
+        fp = NULL;
+    }
+    free (table);
+    table = NULL;
+    table_size = 0;
+    table_count = 0;
+    loaded = 0;
+    if (mutex) {
+        mutex_free (mutex);
+        mutex = 0;
+    }
+}
+
+int
+durcache_key (const char *id, const char *fname, uint8_t key[16]) {
+    DB_FILE *f = vfs_fopen (fname);
+    if (!f) {
+        return -1;
+    }
+    md5_state_t st;
+    md5_init (&st);
+    md5_append (&st, (const md5_byte_t *)id, strlen (id) + 1);
+    char buf[65536];
+    size_t rb;
+    while ((rb = vfs_fread (buf, 1, sizeof (buf), f)) > 0) {
+        md5_append (&st, (const md5_byte_t *)buf, rb);
+    }
+    vfs_fclose (f);
+    md5_finish (&st, key);
+    return 0;
+}
+
+float
+durcache_get (const uint8_t key[16], int subtune) {
+    float res = -1;
+    mutex_lock (mutex);
+    if (!loaded) {
+        durcache_load ();
+    }
+    if (table_size) {
+        durcache_entry_t *e = durcache_find (key, subtune);
+        if (e->subtune) {
+            res = e->duration;
+        }
+    }
+    mutex_unlock (mutex);
+    return res;
+}
+
+void
+durcache_set (const uint8_t key[16], int subtune, float duration) {
+    if (subtune < 0) {
+        return;
+    }
+    mutex_lock (mutex);
+    if (!loaded) {
+        durcache_load ();
+    }
+    if (table_size) {
+        durcache_entry_t *e = durcache_find (key, subtune);
+        if (e->subtune && e->duration == duration) {
+            mutex_unlock (mutex);
+            return;
+        }
+    }
+    if (!durcache_insert (key, subtune, duration)) {
+        durcache_record_t r;
+        durcache_make_record (&r, key, subtune, duration);
+        durcache_append (&r);
+    }
+    mutex_unlock (mutex);
+}
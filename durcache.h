@@ -0,0 +1,58 @@
+/*
+  This file is part of Deadbeef Player source code
+  http://deadbeef.sourceforge.net
+
+  persistent cache of computed durations
+
+  Copyright (C) 2009-2013 Alexey Yakovenko
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  Alexey Yakovenko waker@users.sourceforge.net
+*/
+
+// decoders of emulated and tracker formats find the duration of a song by
+// playing it through, which is too slow to repeat every time the same file
+// is added. this remembers such durations across runs, keyed by a digest of
+// the decoder id and the file contents, and by subtune.
+// entries are appended to $XDG_CACHE_HOME/deadbeef/durations.bin as they're
+// added, and read back on first use.
+
+#ifndef __DURCACHE_H
+#define __DURCACHE_H
+
+#include <stdint.h>
+
+void
+durcache_init (void);
+
+void
+durcache_free (void);
+
+// computes the key of a file for the decoder with the given id;
+// returns -1 if the file can't be read
+int
+durcache_key (const char *id, const char *fname, uint8_t key[16]);
+
+// returns the duration of the subtune in seconds, or -1 if it's unknown
+float
+durcache_get (const uint8_t key[16], int subtune);
+
+void
+durcache_set (const uint8_t key[16], int subtune, float duration);
+
+#endif
@@ -65,6 +65,8 @@
 #include "plugins.h"
 #include "common.h"
 #include "junklib.h"
+#include "perf.h"
+#include "durcache.h"
 
 #ifndef PREFIX
 #error PREFIX must be defined
@@ -107,6 +109,9 @@ print_help (void) {
                 "                      copy[r]ight, [e]lapsed\n"));
     fprintf (stdout, _("                      e.g.: --nowplaying \"%%a - %%t\" should print \"artist - title\"\n"));
     fprintf (stdout, _("                      for more info, see http://sourceforge.net/apps/mediawiki/deadbeef/index.php?title=Title_Formatting\n"));
+    fprintf (stdout, _("   --perf-report      Print playback performance counters to stdout\n"
+                "                      (requires perf.enable=1 in config)\n"));
+    fprintf (stdout, _("   --perf-reset       Reset playback performance counters\n"));
 }
 
 // Parse command line an return a single buffer with all
@@ -264,10 +269,28 @@ server_exec_command_line (const char *cmdline, int len, char *sendback, int sbsi
         else if (!strcmp (parg, "--queue")) {
             queue = 1;
         }
+        else if (!strcmp (parg, "--perf-report")) {
+            if (sendback) {
+                const char pr[] = "perf ";
+                memcpy (sendback, pr, sizeof (pr)-1);
+                perf_report (sendback+sizeof(pr)-1, sbsize-sizeof(pr)+1);
+                return 0;
+            }
+            else {
+                char out[8192];
+                perf_report (out, sizeof (out));
+                fwrite (out, 1, strlen (out), stdout);
+                return 1; // exit
+            }
+        }
+        else if (!strcmp (parg, "--perf-reset")) {
+            perf_reset ();
+            return 0;
+        }
         else if (!strcmp (parg, "--quit")) {
             messagepump_push (DB_EV_TERMINATE, 0, 0, 0);
         }
-        else if (!strcmp (parg, "--sm-client-id")) {
+        else if (!strcmp (parg, "--sm-client-id") || !strcmp (parg, "--gui")) {
             parg += strlen (parg);
             parg++;
             if (parg < pend) {
@@ -445,7 +468,7 @@ server_update (void) {
     else if (s2 != -1) {
         int size = -1;
         char *buf = read_entire_message(s2, &size);
-        char sendback[1024] = "";
+        char sendback[8192] = "";
         if (size > 0) {
             if (size == 1 && buf[0] == 0) {
                 // FIXME: that should be called right after activation of gui plugin
@@ -456,7 +479,7 @@ server_update (void) {
             }
         }
         if (sendback[0]) {
-            // send nowplaying back to client
+            // send nowplaying or perf report back to client
             send (s2, sendback, strlen (sendback)+1, 0);
         }
         else {
@@ -554,6 +577,11 @@ player_mainloop (void) {
                         output->stop ();
                         streamer_free ();
                         output->free ();
+                        if (conf_get_int ("perf.enable", 0)) {
+                            char report[8192];
+                            perf_report (report, sizeof (report));
+                            fprintf (stderr, "%s", report);
+                        }
                         term = 1;
                     }
                     break;
@@ -592,6 +620,7 @@ player_mainloop (void) {
                 case DB_EV_PAUSE:
                     if (output->state () != OUTPUT_STATE_PAUSED) {
                         output->pause ();
+                        streamer_send_deferred_events ();
                         messagepump_push (DB_EV_PAUSED, 0, 1, 0);
                     }
                     break;
@@ -601,6 +630,7 @@ player_mainloop (void) {
                     }
                     else {
                         output->pause ();
+                        streamer_send_deferred_events ();
                         messagepump_push (DB_EV_PAUSED, 0, 1, 0);
                     }
                     break;
@@ -616,6 +646,7 @@ player_mainloop (void) {
                     conf_save ();
                     streamer_configchanged ();
                     junk_configchanged ();
+                    perf_configchanged ();
                     break;
                 case DB_EV_SEEK:
                     streamer_set_seek (p1 / 1000.f);
@@ -860,6 +891,10 @@ main (int argc, char *argv[]) {
             return 0;
         }
         else if (!strcmp (argv[i], "--gui")) {
+            if (i == argc-1) {
+                break;
+            }
+            i++;
             strncpy (use_gui_plugin, argv[i], sizeof(use_gui_plugin) - 1);
             use_gui_plugin[sizeof(use_gui_plugin) - 1] = 0;
         }
@@ -913,11 +948,16 @@ main (int argc, char *argv[]) {
         else {
             // check if that's nowplaying response
             const char np[] = "nowplaying ";
+            const char pr[] = "perf ";
             const char err[] = "error ";
             if (!strncmp (out, np, sizeof (np)-1)) {
                 const char *prn = &out[sizeof (np)-1];
                 fwrite (prn, 1, strlen (prn), stdout);
             }
+            else if (!strncmp (out, pr, sizeof (pr)-1)) {
+                const char *prn = &out[sizeof (pr)-1];
+                fwrite (prn, 1, strlen (prn), stdout);
+            }
             else if (!strncmp (out, err, sizeof (err)-1)) {
                 const char *prn = &out[sizeof (err)-1];
                 fwrite (prn, 1, strlen (prn), stderr);
@@ -949,9 +989,12 @@ main (int argc, char *argv[]) {
         return 0;
     }
 
+    perf_init ();
+    durcache_init ();
     pl_init ();
     conf_init ();
     conf_load (); // required by some plugins at startup
+    perf_configchanged ();
 
     if (use_gui_plugin[0]) {
         conf_set_str ("gui_plugin", use_gui_plugin);
@@ -1043,6 +1086,8 @@ main (int argc, char *argv[]) {
     // at this point we can simply do exit(0), but let's clean up for debugging
     pl_free (); // may access conf_*
     conf_free ();
+    perf_free ();
+    durcache_free ();
 
     fprintf (stderr, "messagepump_free\n");
     messagepump_free ();
@@ -0,0 +1,70 @@
+/*
+  This file is part of Deadbeef Player source code
+  http://deadbeef.sourceforge.net
+
+  allocation checks for the audio path
+
+  Copyright (C) 2009-2013 Alexey Yakovenko
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  Alexey Yakovenko waker@users.sourceforge.net
+*/
+#include "noalloc.h"
+
+#ifdef NOALLOC_ENABLED
+#include <stdio.h>
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+__thread int noalloc_depth;
+
+static void
+noalloc_fail (const char *func, size_t size) {
+    // stderr is unbuffered, so printing doesn't allocate; reset the depth
+    // anyway in case it does
+    noalloc_depth = 0;
+    fprintf (stderr, "noalloc: %s(%zu) called in the audio path\n", func, size);
+    abort ();
+}
+
+void *
+malloc (size_t size) {
+    if (noalloc_depth) {
+        noalloc_fail ("malloc", size);
+    }
+    return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size) {
+    if (noalloc_depth) {
+        noalloc_fail ("calloc", nmemb * size);
+    }
+    return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size) {
+    if (noalloc_depth) {
+        noalloc_fail ("realloc", size);
+    }
+    return __libc_realloc (ptr, size);
+}
+#endif
@@ -0,0 +1,57 @@
+/*
+  This file is part of Deadbeef Player source code
+  http://deadbeef.sourceforge.net
+
+  allocation checks for the audio path
+
+  Copyright (C) 2009-2013 Alexey Yakovenko
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  Alexey Yakovenko waker@users.sourceforge.net
+*/
+
+// the streamer keeps its scratch memory preallocated, and reallocates it
+// only when the input or output format changes. to verify that nothing in
+// the steady-state audio path allocates, configure with
+// --enable-noalloc-check: malloc, calloc and realloc then abort if they are
+// called by a thread which is between noalloc_begin and noalloc_end.
+// in normal builds both are no-ops.
+
+#ifndef __NOALLOC_H
+#define __NOALLOC_H
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+#include <stdlib.h>
+
+// the check replaces the libc allocator, which needs glibc's __libc_malloc
+#if defined(NOALLOC_CHECK) && defined(__GLIBC__)
+#define NOALLOC_ENABLED 1
+#endif
+
+#ifdef NOALLOC_ENABLED
+extern __thread int noalloc_depth;
+#define noalloc_begin() (noalloc_depth++)
+#define noalloc_end() (noalloc_depth--)
+#else
+#define noalloc_begin()
+#define noalloc_end()
+#endif
+
+#endif
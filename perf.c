@@ -0,0 +1,209 @@
+/*
+  This file is part of Deadbeef Player source code
+  http://deadbeef.sourceforge.net
+
+  playback performance counters
+
+  Copyright (C) 2009-2013 Alexey Yakovenko
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  Alexey Yakovenko waker@users.sourceforge.net
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+#include "threading.h"
+#include "conf.h"
+#include "perf.h"
+
+//#define trace(...) { fprintf(stderr, __VA_ARGS__); }
+#define trace(fmt,...)
+
+typedef struct {
+    char name[64];
+    int timed; // 0 for counters updated by perf_add
+    int64_t count;
+    int64_t total; // ns for timed counters
+    int64_t max;
+    int64_t hist[PERF_HIST_BUCKETS];
+} perf_counter_t;
+
+static uintptr_t mutex;
+static int enabled;
+static perf_counter_t counters[PERF_MAX_COUNTERS];
+static int ncounters;
+
+void
+perf_init (void) {
+    mutex = mutex_create_nonrecursive ();
+}
+
+void
+perf_free (void) {
+    if (mutex) {
+        mutex_free (mutex);
+        mutex = 0;
+    }
+}
+
+void
+perf_configchanged (void) {
+    int e = conf_get_int ("perf.enable", 0);
+    if (e != enabled) {
+        trace ("perf: timing %s\n", e ? "on" : "off");
+        enabled = e;
+    }
+}
+
+uintptr_t
+perf_counter (const char *name) {
+    uintptr_t res = 0;
+    mutex_lock (mutex);
+    for (int i = 0; i < ncounters; i++) {
+        if (!strcmp (counters[i].name, name)) {
+            res = i + 1;
+            break;
+        }
+    }
+    if (!res && ncounters < PERF_MAX_COUNTERS) {
+        perf_counter_t *c = &counters[ncounters++];
+        snprintf (c->name, sizeof (c->name), "%s", name);
+        res = ncounters;
+    }
+    mutex_unlock (mutex);
+    return res;
+}
+
+static int64_t
+perf_time (void) {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+    if (!clock_gettime (CLOCK_MONOTONIC, &ts)) {
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+#endif
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+int64_t
+perf_begin (void) {
+    if (!enabled) {
+        return 0;
+    }
+    return perf_time ();
+}
+
+void
+perf_end (uintptr_t counter, int64_t start) {
+    if (!start || !counter) {
+        return;
+    }
+    int64_t t = perf_time () - start;
+    if (t < 0) {
+        t = 0;
+    }
+    int b = 0;
+    for (int64_t us = t / 1000; us > 0 && b < PERF_HIST_BUCKETS-1; us >>= 1) {
+        b++;
+    }
+    mutex_lock (mutex);
+    perf_counter_t *c = &counters[counter-1];
+    c->timed = 1;
+    c->count++;
+    c->total += t;
+    if (t > c->max) {
+        c->max = t;
+    }
+    c->hist[b]++;
+    mutex_unlock (mutex);
+}
+
+void
+perf_add (uintptr_t counter, int64_t value) {
+    if (!enabled || !counter) {
+        return;
+    }
+    mutex_lock (mutex);
+    perf_counter_t *c = &counters[counter-1];
+    c->count++;
+    c->total += value;
+    if (value > c->max) {
+        c->max = value;
+    }
+    mutex_unlock (mutex);
+}
+
+// upper bound of the bucket which contains the given fraction of calls, in us
+static int64_t
+perf_percentile (perf_counter_t *c, double fraction) {
+    int64_t n = (int64_t)(c->count * fraction + 0.5);
+    int64_t sum = 0;
+    for (int b = 0; b < PERF_HIST_BUCKETS; b++) {
+        sum += c->hist[b];
+        if (sum >= n) {
+            return (int64_t)1 << b;
+        }
+    }
+    return (int64_t)1 << (PERF_HIST_BUCKETS-1);
+}
+
+int
+perf_report (char *buffer, int size) {
+    int n = 0;
+#define PRN(...) if (n < size) { int l = snprintf (buffer+n, size-n, __VA_ARGS__); n += l < size-n ? l : size-n-1; }
+    if (size > 0) {
+        buffer[0] = 0;
+    }
+    mutex_lock (mutex);
+    if (!enabled) {
+        PRN ("timing is off, set perf.enable=1 in config to turn it on\n");
+    }
+    PRN ("%-32s %9s %10s %9s %9s %9s %9s\n", "counter", "calls", "total ms", "avg us", "max us", "p50 <us", "p99 <us");
+    for (int i = 0; i < ncounters; i++) {
+        perf_counter_t *c = &counters[i];
+        if (!c->count) {
+            continue;
+        }
+        if (c->timed) {
+            PRN ("%-32s %9lld %10.1f %9.1f %9.1f %9lld %9lld\n", c->name, (long long)c->count, c->total / 1000000.0, c->total / 1000.0 / c->count, c->max / 1000.0, (long long)perf_percentile (c, 0.5), (long long)perf_percentile (c, 0.99));
+        }
+        else {
+            PRN ("%-32s %9lld %10lld (total) %9lld (max)\n", c->name, (long long)c->count, (long long)c->total, (long long)c->max);
+        }
+    }
+    mutex_unlock (mutex);
+#undef PRN
+    return n;
+}
+
+void
+perf_reset (void) {
+    mutex_lock (mutex);
+    for (int i = 0; i < ncounters; i++) {
+        perf_counter_t *c = &counters[i];
+        c->count = 0;
+        c->total = 0;
+        c->max = 0;
+        memset (c->hist, 0, sizeof (c->hist));
+    }
+    mutex_unlock (mutex);
+}
@@ -0,0 +1,81 @@
+/*
+  This file is part of Deadbeef Player source code
+  http://deadbeef.sourceforge.net
+
+  playback performance counters
+
+  Copyright (C) 2009-2013 Alexey Yakovenko
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+  Alexey Yakovenko waker@users.sourceforge.net
+*/
+
+// named counters which accumulate call count, total/max time and a
+// histogram of call durations, for finding the plugin which makes playback
+// stutter.
+// timing is off by default (config option perf.enable), and perf_begin
+// returns 0 then, which makes perf_end a no-op, so the instrumented code
+// pays only for a function call and a flag check.
+
+#ifndef __PERF_H
+#define __PERF_H
+
+#include <stdint.h>
+
+#define PERF_MAX_COUNTERS 256
+
+// buckets are powers of 2 of microseconds: <1us, <2us, <4us, ..., >=2^22us
+#define PERF_HIST_BUCKETS 24
+
+void
+perf_init (void);
+
+void
+perf_free (void);
+
+// re-reads perf.enable
+void
+perf_configchanged (void);
+
+// returns the counter with the given name, registering it if necessary;
+// returns 0 when there's no room for more counters.
+// counters are never unregistered, so the result can be cached
+uintptr_t
+perf_counter (const char *name);
+
+// returns the current time in nanoseconds, or 0 if timing is off
+int64_t
+perf_begin (void);
+
+// adds the time since perf_begin to the counter
+void
+perf_end (uintptr_t counter, int64_t start);
+
+// adds a value to a counter which counts events rather than time, e.g. xruns
+void
+perf_add (uintptr_t counter, int64_t value);
+
+// prints a table of all counters which were used since the last reset;
+// returns the number of bytes written, like snprintf
+int
+perf_report (char *buffer, int size);
+
+void
+perf_reset (void);
+
+#endif
@@ -61,10 +61,13 @@
 #include "metacache.h"
 #include "volume.h"
 #include "pltmeta.h"
+#include "perf.h"
 
 #define DISABLE_LOCKING 0
 #define DEBUG_LOCKING 0
 #define DETECT_PL_LOCK_RC 0
+// set to 1 to collect pl_lock wait/hold times, the stats are printed in pl_free
+#define PROFILE_PL_LOCK 0
 
 // file format revision history
 // 1.1->1.2 changelog:
@@ -103,11 +106,39 @@ static int plt_loading = 0; // disable sending event about playlist switch, conf
 
 #if !DISABLE_LOCKING
 static uintptr_t mutex;
+static uintptr_t perf_lock_wait;
 #endif
 
 #define LOCK {pl_lock();}
 #define UNLOCK {pl_unlock();}
 
+#if PROFILE_PL_LOCK
+// all of these are only modified while holding the mutex
+static int pl_lock_depth;
+static int64_t pl_lock_acquired_at;
+static uint64_t pl_lock_count;
+static uint64_t pl_lock_contended;
+static int64_t pl_lock_wait_total;
+static int64_t pl_lock_wait_max;
+static int64_t pl_lock_hold_total;
+static int64_t pl_lock_hold_max;
+
+static int64_t
+pl_lock_profile_time (void) {
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+pl_lock_profile_print (void) {
+    fprintf (stderr, "pl_lock: %llu locks, %llu contended, wait total %lld us (max %lld us), hold total %lld us (max %lld us)\n",
+            (unsigned long long)pl_lock_count, (unsigned long long)pl_lock_contended,
+            (long long)pl_lock_wait_total, (long long)pl_lock_wait_max,
+            (long long)pl_lock_hold_total, (long long)pl_lock_hold_max);
+}
+#endif
+
 // used at startup to prevent crashes
 static playlist_t dummy_playlist = {
     .refc = 1
@@ -162,6 +193,7 @@ pl_init (void) {
     playlist = &dummy_playlist;
 #if !DISABLE_LOCKING
     mutex = mutex_create ();
+    perf_lock_wait = perf_counter ("pl_lock.wait");
 #endif
     return 0;
 }
@@ -186,6 +218,9 @@ pl_free (void) {
     }
     plt_loading = 0;
     UNLOCK;
+#if PROFILE_PL_LOCK
+    pl_lock_profile_print ();
+#endif
 #if !DISABLE_LOCKING
     if (mutex) {
         mutex_free (mutex);
@@ -206,7 +241,27 @@ pthread_t pl_lock_tid = 0;
 void
 pl_lock (void) {
 #if !DISABLE_LOCKING
+#if PROFILE_PL_LOCK
+    int64_t wait_start = pl_lock_profile_time ();
+#endif
+    int64_t perf_start = perf_begin ();
     mutex_lock (mutex);
+    perf_end (perf_lock_wait, perf_start);
+#if PROFILE_PL_LOCK
+    // only outermost locks are counted, recursive ones never wait
+    if (pl_lock_depth++ == 0) {
+        pl_lock_acquired_at = pl_lock_profile_time ();
+        int64_t wait = pl_lock_acquired_at - wait_start;
+        pl_lock_count++;
+        if (wait > 0) {
+            pl_lock_contended++;
+        }
+        pl_lock_wait_total += wait;
+        if (wait > pl_lock_wait_max) {
+            pl_lock_wait_max = wait;
+        }
+    }
+#endif
 #if DETECT_PL_LOCK_RC
     pl_lock_tid = pthread_self ();
     tids[ntids++] = pl_lock_tid;
@@ -232,6 +287,15 @@ pl_unlock (void) {
     else {
         pl_lock_tid = 0;
     }
+#endif
+#if PROFILE_PL_LOCK
+    if (--pl_lock_depth == 0) {
+        int64_t hold = pl_lock_profile_time () - pl_lock_acquired_at;
+        pl_lock_hold_total += hold;
+        if (hold > pl_lock_hold_max) {
+            pl_lock_hold_max = hold;
+        }
+    }
 #endif
     mutex_unlock (mutex);
 #if DEBUG_LOCKING
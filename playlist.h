@@ -80,6 +80,14 @@ pl_init (void);
 void
 pl_free (void);
 
+// lock ordering:
+// pl_lock is a single recursive mutex guarding all playlists, items and
+// their metadata. it must be the innermost lock: streamer_lock and the
+// streamer's decodemutex may be taken before pl_lock, but never while
+// holding it (checked with DETECT_PL_LOCK_RC in streamer_lock).
+// never do blocking i/o (vfs_fopen, decoder init) inside pl_lock: copy the
+// required metadata out, unlock, then do the work.
+// set PROFILE_PL_LOCK to 1 in playlist.c to print wait/hold stats at exit.
 void
 pl_lock (void);
 
@@ -54,6 +54,8 @@
 #include "dsppreset.h"
 #include "pltmeta.h"
 #include "metacache.h"
+#include "perf.h"
+#include "durcache.h"
 
 #define trace(...) { fprintf(stderr, __VA_ARGS__); }
 //#define trace(fmt,...)
@@ -368,6 +370,17 @@ static DB_functions_t deadbeef_api = {
     // ******* new 1.6 APIs ********
     .plt_set_scroll = (void (*) (ddb_playlist_t *plt, int scroll))plt_set_scroll,
     .plt_get_scroll = (int (*) (ddb_playlist_t *plt))plt_get_scroll,
+    // ******* new 1.7 APIs ********
+    .cond_wait_locked = cond_wait_locked,
+    .perf_counter = perf_counter,
+    .perf_begin = perf_begin,
+    .perf_end = perf_end,
+    .perf_add = perf_add,
+    .perf_report = perf_report,
+    .perf_reset = perf_reset,
+    .duration_cache_key = durcache_key,
+    .duration_cache_get = durcache_get,
+    .duration_cache_set = durcache_set,
 };
 
 DB_functions_t *deadbeef = &deadbeef_api;
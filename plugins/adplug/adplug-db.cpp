@@ -271,10 +271,21 @@ adplug_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
         return NULL;
     }
 
+    // songlength plays the whole subsong through the emulator, the results
+    // are remembered across runs, keyed by the file contents
+    uint8_t key[16];
+    int cached = deadbeef->vminor >= 7 && !deadbeef->duration_cache_key ("adplug", fname, key);
+
     int subsongs = p->getsubsongs ();
     for (int i = 0; i < subsongs; i++) {
         // prepare track for addition
-        float dur = p->songlength (i)/1000.f;
+        float dur = cached ? deadbeef->duration_cache_get (key, i) : -1;
+        if (dur < 0) {
+            dur = p->songlength (i)/1000.f;
+            if (cached) {
+                deadbeef->duration_cache_set (key, i, dur);
+            }
+        }
         if (dur < 0.1) {
             continue;
         }
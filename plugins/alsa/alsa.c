@@ -54,9 +54,24 @@ static snd_pcm_uframes_t req_period_size;
 
 static int conf_alsa_resample = 1;
 static char conf_alsa_soundcard[100] = "default";
+static int conf_alsa_mmap = 0;
+
+// set if the device accepted mmap access, when it was requested
+static int use_mmap;
+
+// one period of data from the streamer
+static char *period_buffer;
+static int period_buffer_size;
+
+// frames written to the device, but not played yet; updated by the thread
+static snd_pcm_sframes_t output_delay;
 
 static int alsa_formatchanged = 0;
 
+// perf counters, 0 if they couldn't be registered
+static uintptr_t perf_write;
+static uintptr_t perf_xrun;
+
 static int
 palsa_callback (char *stream, int len);
 
@@ -121,7 +136,17 @@ retry:
         goto error;
     }
 
-    if ((err = snd_pcm_hw_params_set_access (audio, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+    use_mmap = 0;
+    if (conf_alsa_mmap) {
+        if ((err = snd_pcm_hw_params_set_access (audio, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+            fprintf (stderr, "alsa: mmap access is not supported (%s), using read/write\n",
+                    snd_strerror (err));
+        }
+        else {
+            use_mmap = 1;
+        }
+    }
+    if (!use_mmap && (err = snd_pcm_hw_params_set_access (audio, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
         fprintf (stderr, "cannot set access type (%s)\n",
                 snd_strerror (err));
         goto error;
@@ -251,8 +276,8 @@ retry:
     trace ("trying period size: %d frames\n", (int)period_size);
     snd_pcm_hw_params_set_buffer_size_near (audio, hw_params, &buffer_size);
     snd_pcm_hw_params_set_period_size_near (audio, hw_params, &period_size, NULL);
-    trace ("alsa buffer size: %d frames\n", (int)buffer_size);
-    trace ("alsa period size: %d frames\n", (int)period_size);
+    trace ("alsa buffer size: %d frames (%.1f ms)\n", (int)buffer_size, buffer_size * 1000.f / val);
+    trace ("alsa period size: %d frames (%.1f ms)\n", (int)period_size, period_size * 1000.f / val);
 
     if ((err = snd_pcm_hw_params (audio, hw_params)) < 0) {
         fprintf (stderr, "cannot set parameters (%s)\n",
@@ -330,6 +355,7 @@ palsa_init (void) {
 
     // get and cache conf variables
     conf_alsa_resample = deadbeef->conf_get_int ("alsa.resample", 1);
+    conf_alsa_mmap = deadbeef->conf_get_int ("alsa.mmap", 0);
     deadbeef->conf_get_str ("alsa_soundcard", "default", conf_alsa_soundcard, sizeof (conf_alsa_soundcard));
     trace ("alsa_soundcard: %s\n", conf_alsa_soundcard);
 
@@ -500,6 +526,12 @@ palsa_free (void) {
         }
         snd_pcm_close(audio);
         audio = NULL;
+        if (period_buffer) {
+            free (period_buffer);
+            period_buffer = NULL;
+            period_buffer_size = 0;
+        }
+        output_delay = 0;
         if (mutex) {
             deadbeef->mutex_free (mutex);
             mutex = 0;
@@ -520,6 +552,7 @@ palsa_hw_pause (int pause) {
     }
     if (pause == 1) {
         snd_pcm_drop (audio);
+        output_delay = 0;
     }
     else {
         snd_pcm_prepare (audio);
@@ -568,6 +601,7 @@ palsa_stop (void) {
     state = OUTPUT_STATE_STOPPED;
     LOCK;
     snd_pcm_drop (audio);
+    output_delay = 0;
 #if 0
     if (pcm_callback) {
         snd_async_del_handler (pcm_callback);
@@ -619,6 +653,62 @@ palsa_unpause (void) {
     return 0;
 }
 
+// copies the data into the mmap area of the device; this is done from a
+// buffer filled by the streamer rather than by letting the streamer write
+// there directly, since streamer_read can't be called with the lock held,
+// and without it setformat could remap the area under its feet.
+// must be called with the lock held
+static snd_pcm_sframes_t
+palsa_mmap_write (const char *buf, snd_pcm_uframes_t frames) {
+    int framesize = (plugin.fmt.bps>>3) * plugin.fmt.channels;
+    snd_pcm_uframes_t written = 0;
+    while (written < frames) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t n = frames - written;
+        int err = snd_pcm_mmap_begin (audio, &areas, &offset, &n);
+        if (err < 0) {
+            return err;
+        }
+        if (!n) {
+            break;
+        }
+        // interleaved access, so all channels are in the 1st area
+        char *dst = (char *)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+        memcpy (dst, buf + written * framesize, n * framesize);
+        snd_pcm_sframes_t res = snd_pcm_mmap_commit (audio, offset, n);
+        if (res < 0) {
+            return res;
+        }
+        written += res;
+        if (res != n) {
+            break;
+        }
+    }
+    // unlike writei, commit doesn't start the stream at the start threshold
+    if (snd_pcm_state (audio) == SND_PCM_STATE_PREPARED && snd_pcm_avail_update (audio) <= (snd_pcm_sframes_t)period_size) {
+        snd_pcm_start (audio);
+    }
+    return written;
+}
+
+// must be called with the lock held
+static void
+palsa_update_delay (void) {
+    snd_pcm_sframes_t delay;
+    if (snd_pcm_delay (audio, &delay) == 0 && delay >= 0) {
+        output_delay = delay;
+    }
+}
+
+static int
+palsa_get_delay (void) {
+    if (state != OUTPUT_STATE_PLAYING) {
+        return 0;
+    }
+    return output_delay;
+}
+
 static void
 palsa_thread (void *context) {
     prctl (PR_SET_NAME, "deadbeef-alsa", 0, 0, 0, 0);
@@ -638,15 +728,25 @@ palsa_thread (void *context) {
             UNLOCK;
             continue;
         }
-        char buf[period_size * (plugin.fmt.bps>>3) * plugin.fmt.channels];
+        int period_bytes = period_size * (plugin.fmt.bps>>3) * plugin.fmt.channels;
+        if (period_buffer_size < period_bytes) {
+            char *b = realloc (period_buffer, period_bytes);
+            if (!b) {
+                UNLOCK;
+                usleep (10000);
+                continue;
+            }
+            period_buffer = b;
+            period_buffer_size = period_bytes;
+        }
+        char *buf = period_buffer;
         int bytes_to_write = 0;
-        
+
         /* find out how much space is available for playback data */
         snd_pcm_sframes_t frames_to_deliver = snd_pcm_avail_update (audio);
 
-        // FIXME: pushing data without waiting for next buffer will drain entire
-        // streamer buffer, and might lead to stuttering
-        // however, waiting for buffer does a lot of cpu wakeups
+        // the device is refilled a period at a time, and the thread sleeps
+        // in snd_pcm_wait until the next period is free
         while (/*state == OUTPUT_STATE_PLAYING*/frames_to_deliver >= period_size) {
             if (alsa_terminate) {
                 break;
@@ -654,7 +754,7 @@ palsa_thread (void *context) {
             err = 0;
             if (!bytes_to_write) {
                 UNLOCK; // holding a lock here may cause deadlock in the streamer
-                bytes_to_write = palsa_callback (buf, period_size * (plugin.fmt.bps>>3) * plugin.fmt.channels);
+                bytes_to_write = palsa_callback (buf, period_bytes);
                 LOCK;
                 if (OUTPUT_STATE_PLAYING != state || alsa_terminate) {
                     break;
@@ -662,9 +762,18 @@ palsa_thread (void *context) {
             }
 
             if (bytes_to_write >= (plugin.fmt.bps>>3) * plugin.fmt.channels) {
-                UNLOCK;
-                err = snd_pcm_writei (audio, buf, snd_pcm_bytes_to_frames(audio, bytes_to_write));
-                LOCK;
+                int64_t t = perf_write ? deadbeef->perf_begin () : 0;
+                if (use_mmap) {
+                    err = palsa_mmap_write (buf, snd_pcm_bytes_to_frames(audio, bytes_to_write));
+                }
+                else {
+                    UNLOCK;
+                    err = snd_pcm_writei (audio, buf, snd_pcm_bytes_to_frames(audio, bytes_to_write));
+                    LOCK;
+                }
+                if (perf_write) {
+                    deadbeef->perf_end (perf_write, t);
+                }
                 if (alsa_formatchanged) {
                     trace ("handled alsa_formatchanged [2]\n");
                     alsa_formatchanged = 0;
@@ -705,6 +814,9 @@ palsa_thread (void *context) {
             //        break;
                 }
                 else {
+                    if (err == -EPIPE && perf_xrun) {
+                        deadbeef->perf_add (perf_xrun, 1);
+                    }
                     //if (err != -EPIPE) {
                     //    fprintf (stderr, "alsa: snd_pcm_writei error=%d, %s\n", err, snd_strerror (err));
                     //}
@@ -714,12 +826,32 @@ palsa_thread (void *context) {
                 continue;
             }
             bytes_to_write = 0;
+            palsa_update_delay ();
             frames_to_deliver = snd_pcm_avail_update (audio);
         }
         UNLOCK;
-        int sleeptime = period_size-frames_to_deliver;
-        if (sleeptime > 0 && plugin.fmt.samplerate > 0 && plugin.fmt.channels > 0) {
-            usleep (sleeptime * 1000 / plugin.fmt.samplerate * 1000);
+        if (frames_to_deliver >= 0 && frames_to_deliver < period_size) {
+            // wakes up when avail_min (one period) frames are free; the
+            // timeout is there to notice state changes
+            if (snd_pcm_wait (audio, 100) < 0) {
+                usleep (10000);
+            }
+            LOCK;
+            if (state == OUTPUT_STATE_PLAYING) {
+                palsa_update_delay ();
+            }
+            UNLOCK;
+        }
+        else if (frames_to_deliver < 0) {
+            if (frames_to_deliver == -EPIPE) {
+                LOCK;
+                if (perf_xrun) {
+                    deadbeef->perf_add (perf_xrun, 1);
+                }
+                snd_pcm_prepare (audio);
+                UNLOCK;
+            }
+            usleep (10000);
         }
     }
 }
@@ -733,11 +865,13 @@ static int
 alsa_configchanged (void) {
     deadbeef->conf_lock ();
     int alsa_resample = deadbeef->conf_get_int ("alsa.resample", 1);
+    int alsa_mmap = deadbeef->conf_get_int ("alsa.mmap", 0);
     const char *alsa_soundcard = deadbeef->conf_get_str_fast ("alsa_soundcard", "default");
     int buffer = deadbeef->conf_get_int ("alsa.buffer", DEFAULT_BUFFER_SIZE);
     int period = deadbeef->conf_get_int ("alsa.period", DEFAULT_PERIOD_SIZE);
     if (audio &&
             (alsa_resample != conf_alsa_resample
+            || alsa_mmap != conf_alsa_mmap
             || strcmp (alsa_soundcard, conf_alsa_soundcard)
             || buffer != req_buffer_size
             || period != req_period_size)) {
@@ -794,6 +928,8 @@ alsa_message (uint32_t id, uintptr_t ctx, uint32_t p1, uint32_t p2) {
 
 static int
 alsa_start (void) {
+    perf_write = deadbeef->perf_counter ("output.alsa.write");
+    perf_xrun = deadbeef->perf_counter ("output.alsa.xrun");
     return 0;
 }
 
@@ -811,6 +947,7 @@ alsa_load (DB_functions_t *api) {
 static const char settings_dlg[] =
     "property \"Use ALSA resampling\" checkbox alsa.resample 1;\n"
     "property \"Release device while stopped\" checkbox alsa.freeonstop 0;\n"
+    "property \"Use mmap transfer\" checkbox alsa.mmap 0;\n"
     "property \"Preferred buffer size\" entry alsa.buffer " DEFAULT_BUFFER_SIZE_STR ";\n"
     "property \"Preferred period size\" entry alsa.period " DEFAULT_PERIOD_SIZE_STR ";\n"
 ;
@@ -818,9 +955,9 @@ static const char settings_dlg[] =
 // define plugin interface
 static DB_output_t plugin = {
     .plugin.api_vmajor = 1,
-    .plugin.api_vminor = 0,
+    .plugin.api_vminor = 7,
     .plugin.version_major = 1,
-    .plugin.version_minor = 0,
+    .plugin.version_minor = 1,
     .plugin.type = DB_PLUGIN_OUTPUT,
     .plugin.id = "alsa",
     .plugin.name = "ALSA output plugin",
@@ -856,4 +993,5 @@ static DB_output_t plugin = {
     .unpause = palsa_unpause,
     .state = palsa_get_state,
     .enum_soundcards = palsa_enum_soundcards,
+    .get_delay = palsa_get_delay,
 };
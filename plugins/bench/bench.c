@@ -0,0 +1,423 @@
+/*
+    Headless playback benchmark for DeaDBeeF
+    Copyright (C) 2009-2013 Alexey Yakovenko <waker@users.sourceforge.net>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// a GUI plugin without a GUI: selected with --gui bench, it switches the
+// output to nullout (which doesn't wait for a sound card, so everything
+// runs at max speed), executes the scenario script given in the
+// DDB_BENCH_SCRIPT environment variable, and quits.
+//
+// scripts have one command per line, # starts a comment:
+//   add PATH              add file or folder to the current playlist;
+//                         relative paths are resolved against DDB_BENCH_DATA
+//   clear                 clear the current playlist
+//   set KEY VALUE         set a config option, e.g. "set streamer.dsp_pipeline 1"
+//   order linear|shuffle|random|shuffle_albums
+//   play [N]              play track N (default 0)
+//   next, prev, random, stop
+//   seek SEC              seek the current track
+//   seek_random           seek to a random position of the current track
+//   sleep SEC
+//   wait                  wait until playback stops at the end of the playlist
+//   repeat N ... end      run the enclosed commands N times
+//   report LABEL          print stats since the previous report, and reset them
+//
+// the report has a line of key=value pairs for scripts to parse, followed
+// by the perf counters of the player, which show the time per stage
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "../../deadbeef.h"
+
+//#define trace(...) { fprintf(stderr, __VA_ARGS__); }
+#define trace(fmt,...)
+
+#define MAX_LINES 1000
+#define WAIT_TIMEOUT 3600 // seconds
+
+static DB_functions_t *deadbeef;
+static DB_gui_t plugin;
+
+static char *lines[MAX_LINES];
+static int nlines;
+
+// updated from the message handler
+static volatile int stopped;
+static uintptr_t mutex;
+static double played; // seconds of audio which went through the output
+static int tracks;
+
+// state at the previous report
+static double report_time;
+static double report_cpu;
+
+static double
+now (void) {
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double
+cputime (void) {
+    struct rusage ru;
+    getrusage (RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+}
+
+static void
+bench_reset_stats (void) {
+    deadbeef->mutex_lock (mutex);
+    played = 0;
+    tracks = 0;
+    deadbeef->mutex_unlock (mutex);
+    deadbeef->perf_reset ();
+    report_time = now ();
+    report_cpu = cputime ();
+}
+
+static void
+bench_report (const char *label) {
+    double t = now () - report_time;
+    double cpu = cputime () - report_cpu;
+    struct rusage ru;
+    getrusage (RUSAGE_SELF, &ru);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    long heap = mallinfo2 ().uordblks / 1024;
+#elif defined(__GLIBC__)
+    long heap = mallinfo ().uordblks / 1024;
+#else
+    long heap = -1;
+#endif
+    deadbeef->mutex_lock (mutex);
+    double audio = played;
+    int ntracks = tracks;
+    deadbeef->mutex_unlock (mutex);
+
+    printf ("bench: label=\"%s\" wall=%.3f cpu=%.3f audio=%.3f realtime=%.1f tracks=%d maxrss_kb=%ld heap_kb=%ld\n", label, t, cpu, audio, t > 0 ? audio / t : 0, ntracks, (long)ru.ru_maxrss, heap);
+    char buffer[8192];
+    deadbeef->perf_report (buffer, sizeof (buffer));
+    printf ("%s\n", buffer);
+    fflush (stdout);
+    bench_reset_stats ();
+}
+
+static int
+bench_message (uint32_t id, uintptr_t ctx, uint32_t p1, uint32_t p2) {
+    if (id == DB_EV_SONGCHANGED) {
+        ddb_event_trackchange_t *ev = (ddb_event_trackchange_t *)ctx;
+        deadbeef->mutex_lock (mutex);
+        if (ev->from) {
+            played += ev->playtime;
+            tracks++;
+        }
+        deadbeef->mutex_unlock (mutex);
+        if (!ev->to) {
+            stopped = 1;
+        }
+    }
+    return 0;
+}
+
+static void
+bench_add (const char *path) {
+    char fname[PATH_MAX];
+    const char *data = getenv ("DDB_BENCH_DATA");
+    if (path[0] != '/' && data) {
+        snprintf (fname, sizeof (fname), "%s/%s", data, path);
+    }
+    else {
+        snprintf (fname, sizeof (fname), "%s", path);
+    }
+    ddb_playlist_t *plt = deadbeef->plt_get_curr ();
+    if (!plt) {
+        return;
+    }
+    if (deadbeef->plt_add_files_begin (plt, 0) == 0) {
+        if (deadbeef->plt_add_dir2 (0, plt, fname, NULL, NULL) < 0) {
+            if (deadbeef->plt_add_file2 (0, plt, fname, NULL, NULL) < 0) {
+                fprintf (stderr, "bench: failed to add %s\n", fname);
+            }
+        }
+        deadbeef->plt_add_files_end (plt, 0);
+    }
+    deadbeef->plt_unref (plt);
+}
+
+static void
+bench_seek_random (void) {
+    DB_playItem_t *it = deadbeef->streamer_get_playing_track ();
+    if (!it) {
+        return;
+    }
+    float dur = deadbeef->pl_get_item_duration (it);
+    deadbeef->pl_item_unref (it);
+    if (dur > 0) {
+        deadbeef->sendmessage (DB_EV_SEEK, 0, (uint32_t)(dur * 1000 * (rand () / (RAND_MAX + 1.0))), 0);
+    }
+}
+
+static void
+bench_wait (void) {
+    double start = now ();
+    while (!stopped && now () - start < WAIT_TIMEOUT) {
+        usleep (10000);
+    }
+    if (!stopped) {
+        fprintf (stderr, "bench: timeout waiting for playback to stop\n");
+    }
+}
+
+// returns the index of the "end" which closes the "repeat" at line idx
+static int
+bench_find_end (int idx) {
+    int depth = 0;
+    for (int i = idx + 1; i < nlines; i++) {
+        if (!strncmp (lines[i], "repeat ", 7)) {
+            depth++;
+        }
+        else if (!strcmp (lines[i], "end")) {
+            if (!depth) {
+                return i;
+            }
+            depth--;
+        }
+    }
+    return -1;
+}
+
+static int
+bench_exec (int from, int to) {
+    for (int i = from; i < to; i++) {
+        const char *l = lines[i];
+        trace ("bench: %s\n", l);
+        const char *arg = strchr (l, ' ');
+        arg = arg ? arg + 1 : "";
+        if (!strncmp (l, "repeat ", 7)) {
+            int end = bench_find_end (i);
+            if (end < 0) {
+                fprintf (stderr, "bench: line %d: repeat without end\n", i+1);
+                return -1;
+            }
+            int n = atoi (arg);
+            for (int k = 0; k < n; k++) {
+                if (bench_exec (i + 1, end) < 0) {
+                    return -1;
+                }
+            }
+            i = end;
+        }
+        else if (!strncmp (l, "add ", 4)) {
+            bench_add (arg);
+        }
+        else if (!strcmp (l, "clear")) {
+            ddb_playlist_t *plt = deadbeef->plt_get_curr ();
+            if (plt) {
+                deadbeef->plt_clear (plt);
+                deadbeef->plt_unref (plt);
+            }
+        }
+        else if (!strncmp (l, "set ", 4)) {
+            char key[100];
+            const char *val = strchr (arg, ' ');
+            if (!val || val - arg >= sizeof (key)) {
+                fprintf (stderr, "bench: line %d: set expects key and value\n", i+1);
+                return -1;
+            }
+            memcpy (key, arg, val - arg);
+            key[val - arg] = 0;
+            deadbeef->conf_set_str (key, val + 1);
+            deadbeef->sendmessage (DB_EV_CONFIGCHANGED, 0, 0, 0);
+        }
+        else if (!strncmp (l, "order ", 6)) {
+            int order = PLAYBACK_ORDER_LINEAR;
+            if (!strcmp (arg, "shuffle")) {
+                order = PLAYBACK_ORDER_SHUFFLE_TRACKS;
+            }
+            else if (!strcmp (arg, "random")) {
+                order = PLAYBACK_ORDER_RANDOM;
+            }
+            else if (!strcmp (arg, "shuffle_albums")) {
+                order = PLAYBACK_ORDER_SHUFFLE_ALBUMS;
+            }
+            deadbeef->conf_set_int ("playback.order", order);
+            deadbeef->sendmessage (DB_EV_CONFIGCHANGED, 0, 0, 0);
+        }
+        else if (!strcmp (l, "play") || !strncmp (l, "play ", 5)) {
+            stopped = 0;
+            deadbeef->sendmessage (DB_EV_PLAY_NUM, 0, atoi (arg), 0);
+        }
+        else if (!strcmp (l, "next")) {
+            deadbeef->sendmessage (DB_EV_NEXT, 0, 0, 0);
+        }
+        else if (!strcmp (l, "prev")) {
+            deadbeef->sendmessage (DB_EV_PREV, 0, 0, 0);
+        }
+        else if (!strcmp (l, "random")) {
+            deadbeef->sendmessage (DB_EV_PLAY_RANDOM, 0, 0, 0);
+        }
+        else if (!strcmp (l, "stop")) {
+            deadbeef->sendmessage (DB_EV_STOP, 0, 0, 0);
+        }
+        else if (!strncmp (l, "seek ", 5)) {
+            deadbeef->sendmessage (DB_EV_SEEK, 0, (uint32_t)(atof (arg) * 1000), 0);
+        }
+        else if (!strcmp (l, "seek_random")) {
+            bench_seek_random ();
+        }
+        else if (!strncmp (l, "sleep ", 6)) {
+            usleep ((useconds_t)(atof (arg) * 1000000));
+        }
+        else if (!strcmp (l, "wait")) {
+            bench_wait ();
+        }
+        else if (!strcmp (l, "report") || !strncmp (l, "report ", 7)) {
+            bench_report (arg);
+        }
+        else {
+            fprintf (stderr, "bench: line %d: unknown command: %s\n", i+1, l);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int
+bench_load_script (const char *fname) {
+    FILE *fp = fopen (fname, "rt");
+    if (!fp) {
+        fprintf (stderr, "bench: failed to open %s\n", fname);
+        return -1;
+    }
+    char str[1024];
+    while (fgets (str, sizeof (str), fp) && nlines < MAX_LINES) {
+        char *p = str;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        char *e = p + strlen (p);
+        while (e > p && (e[-1] == '\n' || e[-1] == '\r' || e[-1] == ' ' || e[-1] == '\t')) {
+            e--;
+        }
+        *e = 0;
+        if (!*p || *p == '#') {
+            continue;
+        }
+        lines[nlines++] = strdup (p);
+    }
+    fclose (fp);
+    return 0;
+}
+
+static int
+bench_start (void) {
+    const char *script = getenv ("DDB_BENCH_SCRIPT");
+    if (!script) {
+        fprintf (stderr, "bench: DDB_BENCH_SCRIPT is not set\n");
+    }
+    else if (!bench_load_script (script)) {
+        // nullout pulls data as fast as the streamer can produce it
+        deadbeef->conf_set_str ("output_plugin", "null output plugin");
+        deadbeef->conf_set_int ("playback.loop", PLAYBACK_MODE_NOLOOP);
+        deadbeef->conf_set_int ("perf.enable", 1);
+        deadbeef->sendmessage (DB_EV_CONFIGCHANGED, 0, 0, 0);
+        deadbeef->sendmessage (DB_EV_REINIT_SOUND, 0, 0, 0);
+        srand (0);
+        bench_reset_stats ();
+        bench_exec (0, nlines);
+    }
+    for (int i = 0; i < nlines; i++) {
+        free (lines[i]);
+    }
+    nlines = 0;
+    deadbeef->sendmessage (DB_EV_TERMINATE, 0, 0, 0);
+    return 0;
+}
+
+static int
+bench_stop (void) {
+    return 0;
+}
+
+static int
+bench_connect (void) {
+    mutex = deadbeef->mutex_create ();
+    return 0;
+}
+
+static int
+bench_disconnect (void) {
+    if (mutex) {
+        deadbeef->mutex_free (mutex);
+        mutex = 0;
+    }
+    return 0;
+}
+
+static int
+bench_run_dialog (ddb_dialog_t *dlg, uint32_t buttons, int (*callback)(int button, void *ctx), void *ctx) {
+    return ddb_button_cancel;
+}
+
+DB_plugin_t *
+ddb_gui_bench_load (DB_functions_t *api) {
+    deadbeef = api;
+    return DB_PLUGIN (&plugin);
+}
+
+static DB_gui_t plugin = {
+    .plugin.api_vmajor = 1,
+    .plugin.api_vminor = 7,
+    .plugin.version_major = 1,
+    .plugin.version_minor = 0,
+    .plugin.type = DB_PLUGIN_GUI,
+    .plugin.id = "bench",
+    .plugin.name = "Headless benchmark",
+    .plugin.descr = "Runs a playback scenario script as fast as possible through the null output, and reports realtime factor, cpu time per stage and memory usage.\n"
+        "Usage: DDB_BENCH_SCRIPT=scenario.bench deadbeef --gui bench\n"
+        "Use a separate XDG_CONFIG_HOME, as the script changes settings.",
+    .plugin.copyright =
+        "Copyright (C) 2009-2013 Alexey Yakovenko <waker@users.sourceforge.net>\n"
+        "\n"
+        "This program is free software; you can redistribute it and/or\n"
+        "modify it under the terms of the GNU General Public License\n"
+        "as published by the Free Software Foundation; either version 2\n"
+        "of the License, or (at your option) any later version.\n"
+        "\n"
+        "This program is distributed in the hope that it will be useful,\n"
+        "but WITHOUT ANY WARRANTY; without even the implied warranty of\n"
+        "MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n"
+        "GNU General Public License for more details.\n"
+        "\n"
+        "You should have received a copy of the GNU General Public License\n"
+        "along with this program; if not, write to the Free Software\n"
+        "Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.\n"
+    ,
+    .plugin.website = "http://deadbeef.sf.net",
+    .plugin.start = bench_start,
+    .plugin.stop = bench_stop,
+    .plugin.connect = bench_connect,
+    .plugin.disconnect = bench_disconnect,
+    .plugin.message = bench_message,
+    .run_dialog = bench_run_dialog,
+};
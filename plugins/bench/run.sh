@@ -0,0 +1,25 @@
+#!/bin/sh
+# runs benchmark scenarios in a throwaway config dir and prints the
+# "bench:" result lines, which are key=value pairs for CI to collect
+#
+# usage: run.sh DATADIR [SCENARIO.bench...]
+# DATADIR should contain "album" (a folder with a few tracks) and "library"
+# (a large folder); DEADBEEF can point to the player binary
+
+if [ -z "$1" ]; then
+    echo "usage: $0 DATADIR [SCENARIO.bench...]" >&2
+    exit 1
+fi
+
+DATA=$(cd "$1" && pwd)
+shift
+DEADBEEF=${DEADBEEF:-deadbeef}
+SCENARIOS=${*:-$(dirname "$0")/scenarios/*.bench}
+
+CONF=$(mktemp -d)
+trap 'rm -rf "$CONF"' EXIT
+
+for s in $SCENARIOS; do
+    rm -rf "$CONF/deadbeef"
+    XDG_CONFIG_HOME="$CONF" DDB_BENCH_DATA="$DATA" DDB_BENCH_SCRIPT="$s" "$DEADBEEF" --gui bench 2>/dev/null || exit 1
+done
@@ -32,6 +32,7 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include "converter.h"
 #include "../../deadbeef.h"
 #include "../../strdupa.h"
@@ -786,7 +787,8 @@ check_dir (const char *dir, mode_t mode)
         if (-1 == stat (tmp, &stat_buf))
         {
             trace ("creating dir %s\n", tmp);
-            if (0 != mkdir (tmp, mode))
+            // another conversion thread could have created it meanwhile
+            if (0 != mkdir (tmp, mode) && errno != EEXIST)
             {
                 trace ("Failed to create %s\n", tmp);
                 free (tmp);
@@ -820,7 +822,7 @@ convert (DB_playItem_t *it, const char *out, int output_bps, int output_is_float
     deadbeef->pl_unlock ();
 
     if (dec) {
-        fileinfo = dec->open (0);
+        fileinfo = dec->open (DDB_DECODER_HINT_OFFLINE);
         if (fileinfo && dec->init (fileinfo, DB_PLAYITEM (it)) != 0) {
             deadbeef->pl_lock ();
             fprintf (stderr, "converter: failed to decode file %s\n", deadbeef->pl_find_meta (it, ":URI"));
@@ -948,6 +950,9 @@ convert (DB_playItem_t *it, const char *out, int output_bps, int output_is_float
             char buffer[dspsize];
             // account for up to float32 7.1 resampled to 48x ratio
             char dspbuffer[dspsize];
+            // decoders which can output float feed the dsp chain directly
+            int read_float = dsp_preset && dec->plugin.api_vminor >= 7 && dec->read_float;
+            int floatbs = 2000 * fileinfo->fmt.channels * sizeof (float);
             int eof = 0;
             for (;;) {
                 if (eof) {
@@ -956,11 +961,23 @@ convert (DB_playItem_t *it, const char *out, int output_bps, int output_is_float
                 if (abort && *abort) {
                     break;
                 }
-                int sz = dec->read (fileinfo, buffer, bs);
-
-                if (sz != bs) {
-                    eof = 1;
+                int sz;
+                int frames;
+                if (read_float) {
+                    sz = dec->read_float (fileinfo, (float *)dspbuffer, floatbs);
+                    if (sz != floatbs) {
+                        eof = 1;
+                    }
+                    frames = sz / (fileinfo->fmt.channels * sizeof (float));
                 }
+                else {
+                    sz = dec->read (fileinfo, buffer, bs);
+                    if (sz != bs) {
+                        eof = 1;
+                    }
+                    frames = sz / samplesize;
+                }
+
                 if (dsp_preset) {
                     ddb_waveformat_t fmt;
                     ddb_waveformat_t outfmt;
@@ -968,10 +985,11 @@ convert (DB_playItem_t *it, const char *out, int output_bps, int output_is_float
                     memcpy (&outfmt, &fileinfo->fmt, sizeof (fmt));
                     fmt.bps = 32;
                     fmt.is_float = 1;
-                    deadbeef->pcm_convert (&fileinfo->fmt, buffer, &fmt, dspbuffer, sz);
+                    if (!read_float) {
+                        deadbeef->pcm_convert (&fileinfo->fmt, buffer, &fmt, dspbuffer, sz);
+                    }
 
                     ddb_dsp_context_t *dsp = dsp_preset->chain;
-                    int frames = sz / samplesize;
                     while (dsp) {
                         frames = dsp->plugin->process (dsp, (float *)dspbuffer, frames, sizeof (dspbuffer) / (fmt.channels * 4), &fmt, NULL);
                         if (frames <= 0) {
@@ -1003,7 +1021,6 @@ convert (DB_playItem_t *it, const char *out, int output_bps, int output_is_float
                     outfmt.channels = outch;
                     outfmt.samplerate = outsr;
 
-                    int frames = sz / samplesize;
                     int n = deadbeef->pcm_convert (&fileinfo->fmt, buffer, &outfmt, dspbuffer, frames * samplesize);
                     memcpy (buffer, dspbuffer, n);
                     sz = n;
@@ -63,6 +63,11 @@ typedef struct {
     GtkWidget *progress_entry;
     int cancelled;
     char *progress_text;
+    uintptr_t mutex;
+    uintptr_t prompt_mutex;
+    int *cpu_items; // indexes into convert_items
+    int cpu_items_count;
+    int next_cpu_item;
 } converter_ctx_t;
 
 converter_ctx_t *current_ctx;
@@ -128,6 +133,121 @@ overwrite_prompt_cb (void *ctx) {
     return FALSE;
 }
 
+// decoders which render the sound from a program or a score, with little
+// i/o; their tracks are converted on several threads at once.
+// uade is not in the list: its frontend keeps the headphone and normalise
+// effect state in statics, which parallel renders would mix up
+static const char *cpu_bound_decoders[] = {
+    "stddumb", "stdgme", "stdsid", "adplug", "wmidi", NULL
+};
+
+static int
+converter_is_cpu_bound (DB_playItem_t *it) {
+    int res = 0;
+    deadbeef->pl_lock ();
+    const char *dec = deadbeef->pl_find_meta (it, ":DECODER");
+    for (int i = 0; dec && cpu_bound_decoders[i]; i++) {
+        if (!strcmp (dec, cpu_bound_decoders[i])) {
+            res = 1;
+            break;
+        }
+    }
+    deadbeef->pl_unlock ();
+    return res;
+}
+
+static void
+converter_convert_item (converter_ctx_t *conv, int n, const char *root, ddb_dsp_preset_t *dsp_preset) {
+    update_progress_info_t *info = malloc (sizeof (update_progress_info_t));
+    info->entry = conv->progress_entry;
+    g_object_ref (info->entry);
+    deadbeef->pl_lock ();
+    info->text = strdup (deadbeef->pl_find_meta (conv->convert_items[n], ":URI"));
+    deadbeef->pl_unlock ();
+    g_idle_add (update_progress_cb, info);
+
+    char outpath[2000];
+
+    converter_plugin->get_output_path (conv->convert_items[n], conv->outfolder, conv->outfile, conv->encoder_preset, conv->preserve_folder_structure, root, conv->write_to_source_folder, outpath, sizeof (outpath));
+
+    int skip = 0;
+
+    // need to unescape path before passing to stat
+    char unesc_path[2000];
+    char invalid[] = "$\"`\\";
+    const char *p = outpath;
+    char *o = unesc_path;
+    while (*p) {
+        if (*p == '\\') {
+            p++;
+        }
+        *o++ = *p++;
+    }
+    *o = 0;
+
+    // only one thread at a time may ask about overwriting
+    deadbeef->mutex_lock (conv->prompt_mutex);
+    struct stat st;
+    int res = stat(unesc_path, &st);
+    if (res == 0) {
+        if (conv->overwrite_action > 1 || conv->overwrite_action < 0) {
+            conv->overwrite_action = 0;
+        }
+        if (conv->overwrite_action == 0) {
+            // prompt if file exists
+            struct overwrite_prompt_ctx ctl;
+            ctl.mutex = deadbeef->mutex_create ();
+            ctl.cond = deadbeef->cond_create ();
+            ctl.fname = unesc_path;
+            ctl.result = 0;
+            gdk_threads_add_idle (overwrite_prompt_cb, &ctl);
+            deadbeef->cond_wait (ctl.cond, ctl.mutex);
+            deadbeef->cond_free (ctl.cond);
+            deadbeef->mutex_free (ctl.mutex);
+            if (ctl.result) {
+                unlink (outpath);
+            }
+            else {
+                skip = 1;
+            }
+        }
+        else if (conv->overwrite_action == 1) {
+            unlink (outpath);
+        }
+    }
+    deadbeef->mutex_unlock (conv->prompt_mutex);
+
+    if (!skip) {
+        converter_plugin->convert (conv->convert_items[n], outpath, conv->output_bps, conv->output_is_float, conv->encoder_preset, dsp_preset, &conv->cancelled);
+    }
+}
+
+typedef struct {
+    converter_ctx_t *conv;
+    const char *root;
+    ddb_dsp_preset_t *dsp_preset;
+} converter_thread_t;
+
+// converts cpu bound tracks until there are none left; each thread has its
+// own dsp preset copy, since dsp contexts keep state
+static void
+converter_cpu_worker (void *ctx) {
+    converter_thread_t *t = ctx;
+    converter_ctx_t *conv = t->conv;
+    while (!conv->cancelled) {
+        deadbeef->mutex_lock (conv->mutex);
+        int n = -1;
+        if (conv->next_cpu_item < conv->cpu_items_count) {
+            n = conv->cpu_items[conv->next_cpu_item++];
+        }
+        deadbeef->mutex_unlock (conv->mutex);
+        if (n < 0) {
+            break;
+        }
+        converter_convert_item (conv, n, t->root, t->dsp_preset);
+    }
+}
+
 static void
 converter_worker (void *ctx) {
     deadbeef->background_job_increment ();
@@ -170,72 +290,74 @@ converter_worker (void *ctx) {
         fprintf (stderr, "common root path: %s\n", root);
     }
 
+    conv->mutex = deadbeef->mutex_create_nonrecursive ();
+    conv->prompt_mutex = deadbeef->mutex_create_nonrecursive ();
+
+    // tracks of emulated and tracker formats are rendered in parallel,
+    // subtunes of one file too, each by its own decoder instance;
+    // everything else is converted one by one, in order, on this thread
+    conv->cpu_items = malloc (sizeof (int) * (conv->convert_items_count + 1));
+    conv->cpu_items_count = 0;
+    conv->next_cpu_item = 0;
     for (int n = 0; n < conv->convert_items_count; n++) {
-        update_progress_info_t *info = malloc (sizeof (update_progress_info_t));
-        info->entry = conv->progress_entry;
-        g_object_ref (info->entry);
-        deadbeef->pl_lock ();
-        info->text = strdup (deadbeef->pl_find_meta (conv->convert_items[n], ":URI"));
-        deadbeef->pl_unlock ();
-        g_idle_add (update_progress_cb, info);
-
-        char outpath[2000];
-
-        converter_plugin->get_output_path (conv->convert_items[n], conv->outfolder, conv->outfile, conv->encoder_preset, conv->preserve_folder_structure, root, conv->write_to_source_folder, outpath, sizeof (outpath));
-
-        int skip = 0;
-
-        // need to unescape path before passing to stat
-        char unesc_path[2000];
-        char invalid[] = "$\"`\\";
-        const char *p = outpath;
-        char *o = unesc_path;
-        while (*p) {
-            if (*p == '\\') {
-                p++;
-            }
-            *o++ = *p++;
+        if (converter_is_cpu_bound (conv->convert_items[n])) {
+            conv->cpu_items[conv->cpu_items_count++] = n;
         }
-        *o = 0;
+    }
 
-        struct stat st;
-        int res = stat(unesc_path, &st);
-        if (res == 0) {
-            if (conv->overwrite_action > 1 || conv->overwrite_action < 0) {
-                conv->overwrite_action = 0;
-            }
-            if (conv->overwrite_action == 0) {
-                // prompt if file exists
-                struct overwrite_prompt_ctx ctl;
-                ctl.mutex = deadbeef->mutex_create ();
-                ctl.cond = deadbeef->cond_create ();
-                ctl.fname = unesc_path;
-                ctl.result = 0;
-                gdk_threads_add_idle (overwrite_prompt_cb, &ctl);
-                deadbeef->cond_wait (ctl.cond, ctl.mutex);
-                deadbeef->cond_free (ctl.cond);
-                deadbeef->mutex_free (ctl.mutex);
-                if (ctl.result) {
-                    unlink (outpath);
-                }
-                else {
-                    skip = 1;
-                }
-            }
-            else if (conv->overwrite_action == 1) {
-                unlink (outpath);
-            }
+    int nthreads = deadbeef->conf_get_int ("converter.threads", 0);
+    if (nthreads <= 0) {
+        nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+    }
+    // this thread joins them when it's done with the rest
+    int nhelpers = nthreads - 1;
+    if (nhelpers > conv->cpu_items_count) {
+        nhelpers = conv->cpu_items_count;
+    }
+    if (nhelpers < 0) {
+        nhelpers = 0;
+    }
+    converter_thread_t *threads = calloc (nhelpers + 1, sizeof (converter_thread_t));
+    intptr_t *tids = calloc (nhelpers + 1, sizeof (intptr_t));
+    for (int i = 0; i <= nhelpers; i++) {
+        threads[i].conv = conv;
+        threads[i].root = root;
+        threads[i].dsp_preset = conv->dsp_preset;
+        if (i == 0) {
+            continue;
+        }
+        if (conv->dsp_preset) {
+            threads[i].dsp_preset = converter_plugin->dsp_preset_alloc ();
+            converter_plugin->dsp_preset_copy (threads[i].dsp_preset, conv->dsp_preset);
         }
+        tids[i] = deadbeef->thread_start (converter_cpu_worker, &threads[i]);
+    }
 
-        if (!skip) {
-            converter_plugin->convert (conv->convert_items[n], outpath, conv->output_bps, conv->output_is_float, conv->encoder_preset, conv->dsp_preset, &conv->cancelled);
+    int next = 0;
+    for (int n = 0; n < conv->convert_items_count && !conv->cancelled; n++) {
+        if (next < conv->cpu_items_count && conv->cpu_items[next] == n) {
+            next++;
+            continue;
         }
-        if (conv->cancelled) {
-            for (; n < conv->convert_items_count; n++) {
-                deadbeef->pl_item_unref (conv->convert_items[n]);
-            }
-            break;
+        converter_convert_item (conv, n, root, conv->dsp_preset);
+    }
+    converter_cpu_worker (&threads[0]);
+
+    for (int i = 1; i <= nhelpers; i++) {
+        if (tids[i]) {
+            deadbeef->thread_join (tids[i]);
+        }
+        if (threads[i].dsp_preset) {
+            converter_plugin->dsp_preset_free (threads[i].dsp_preset);
         }
+    }
+    free (tids);
+    free (threads);
+    free (conv->cpu_items);
+    deadbeef->mutex_free (conv->prompt_mutex);
+    deadbeef->mutex_free (conv->mutex);
+
+    for (int n = 0; n < conv->convert_items_count; n++) {
         deadbeef->pl_item_unref (conv->convert_items[n]);
     }
     g_idle_add (destroy_progress_cb, conv->progress);
@@ -453,6 +575,9 @@ converter_show_cb (void *data) {
     combo = GTK_COMBO_BOX (lookup_widget (conv->converter, "overwrite_action"));
     gtk_combo_box_set_active (combo, deadbeef->conf_get_int ("converter.overwrite_action", 0));
 
+    // 0 is one per cpu core
+    gtk_spin_button_set_value (GTK_SPIN_BUTTON (lookup_widget (conv->converter, "numthreads")), deadbeef->conf_get_int ("converter.threads", 0));
+
     for (;;) {
         int response = gtk_dialog_run (GTK_DIALOG (conv->converter));
         if (response == GTK_RESPONSE_OK) {
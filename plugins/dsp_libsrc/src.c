@@ -43,6 +43,8 @@ typedef struct {
     SRC_STATE *src;
     SRC_DATA srcdata;
     int remaining; // number of input samples in SRC buffer
+    float *outbuf; // reused between calls, grown when maxframes needs more
+    int outbuf_size; // in floats
     __attribute__((__aligned__(16))) char in_fbuffer[sizeof(float)*SRC_BUFFER*SRC_MAX_CHANNELS];
     unsigned quality_changed : 1;
     unsigned need_reset : 1;
@@ -66,6 +68,9 @@ ddb_src_close (ddb_dsp_context_t *_src) {
         src_delete (src->src);
         src->src = NULL;
     }
+    if (src->outbuf) {
+        free (src->outbuf);
+    }
     free (src);
 }
 
@@ -134,11 +139,21 @@ ddb_src_process (ddb_dsp_context_t *_src, float *samples, int nframes, int maxfr
     ddb_src_set_ratio (_src, ratio);
     fmt->samplerate = samplerate;
 
+    // the result is copied back into samples, so there's no use in
+    // producing more than maxframes
+    if (src->outbuf_size < maxframes * fmt->channels) {
+        float *outbuf = realloc (src->outbuf, maxframes * fmt->channels * sizeof (float));
+        if (!outbuf) {
+            fprintf (stderr, "src: failed to allocate output buffer\n");
+            return nframes;
+        }
+        src->outbuf = outbuf;
+        src->outbuf_size = maxframes * fmt->channels;
+    }
+
     int numoutframes = 0;
-    int outsize = nframes*24;
-    float outbuf[outsize*fmt->channels];
-    memset (outbuf, 0, sizeof (outbuf));
-    char *output = (char *)outbuf;
+    int outsize = maxframes;
+    char *output = (char *)src->outbuf;
     float *input = samples;
     int inputsize = nframes;
 
@@ -168,7 +183,7 @@ ddb_src_process (ddb_dsp_context_t *_src, float *samples, int nframes, int maxfr
         src->srcdata.input_frames = src->remaining;
         src->srcdata.output_frames = outsize;
         src->srcdata.end_of_input = 0;
-        trace ("src input: %d, ratio %f, buffersize: %d\n", src->srcdata.input_frames, src->srcdata.src_ratio, sizeof (outbuf));
+        trace ("src input: %d, ratio %f, buffersize: %d\n", src->srcdata.input_frames, src->srcdata.src_ratio, outsize);
         int src_err = src_process (src->src, &src->srcdata);
         trace ("src output: %d, used: %d\n", src->srcdata.output_frames_gen, src->srcdata.input_frames_used);
 
@@ -196,7 +211,7 @@ ddb_src_process (ddb_dsp_context_t *_src, float *samples, int nframes, int maxfr
         }
     } while (inputsize > 0 && outsize > 0);
 
-    memcpy (input, outbuf, numoutframes * fmt->channels * sizeof (float));
+    memcpy (input, src->outbuf, numoutframes * fmt->channels * sizeof (float));
     //static FILE *out = NULL;
     //if (!out) {
     //    out = fopen ("out.raw", "w+b");
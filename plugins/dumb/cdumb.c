@@ -36,10 +36,16 @@
 static DB_decoder_t plugin;
 static DB_functions_t *deadbeef;
 
+// renderer state is saved every CHECKPOINT_INTERVAL of playback, so that
+// seeks can start from the nearest one instead of the beginning
+#define CHECKPOINT_INTERVAL (10 * 65536)
+#define MAX_CHECKPOINTS 128
+
 typedef struct {
     DB_fileinfo_t info;
     DUH *duh;
     DUH_SIGRENDERER *renderer;
+    long next_checkpoint;
 } dumb_info_t;
 
 //#define DUMB_RQ_ALIASING
@@ -50,7 +56,7 @@ extern int dumb_resampling_quality;
 extern int dumb_it_max_to_mix;
 
 static int
-cdumb_startrenderer (DB_fileinfo_t *_info);
+cdumb_startrenderer (DB_fileinfo_t *_info, long pos);
 
 static DUH*
 open_module(const char *fname, const char *ext, int *start_order, int *is_it, int *is_dos, const char **filetype);
@@ -82,8 +88,6 @@ cdumb_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
     }
     deadbeef->pl_unlock ();
 
-    dumb_it_do_initial_runthrough (info->duh);
-
     _info->plugin = &plugin;
     _info->fmt.bps = deadbeef->conf_get_int ("dumb.8bitoutput", 0) ? 8 : 16;
     _info->fmt.channels = 2;
@@ -91,7 +95,8 @@ cdumb_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
     _info->readpos = 0;
     _info->fmt.channelmask = _info->fmt.channels == 1 ? DDB_SPEAKER_FRONT_LEFT : (DDB_SPEAKER_FRONT_LEFT | DDB_SPEAKER_FRONT_RIGHT);
 
-    if (cdumb_startrenderer (_info) < 0) {
+    info->next_checkpoint = CHECKPOINT_INTERVAL;
+    if (cdumb_startrenderer (_info, 0) < 0) {
         return -1;
     }
 
@@ -99,15 +104,16 @@ cdumb_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
     return 0;
 }
 
+// pos is in 1/65536 sec
 static int
-cdumb_startrenderer (DB_fileinfo_t *_info) {
+cdumb_startrenderer (DB_fileinfo_t *_info, long pos) {
     dumb_info_t *info = (dumb_info_t *)_info;
     // reopen
     if (info->renderer) {
         duh_end_sigrenderer (info->renderer);
         info->renderer = NULL;
     }
-    info->renderer = duh_start_sigrenderer (info->duh, 0, 2, 0);
+    info->renderer = duh_start_sigrenderer (info->duh, 0, 2, pos);
     if (!info->renderer) {
         return -1;
     }
@@ -157,6 +163,12 @@ cdumb_read (DB_fileinfo_t *_info, char *bytes, int size) {
     long ret;
     ret = duh_render (info->renderer, _info->fmt.bps, 0, 1, 65536.f / _info->fmt.samplerate, length, bytes);
     _info->readpos += ret / (float)_info->fmt.samplerate;
+    long pos = duh_sigrenderer_get_position (info->renderer);
+    if (pos >= info->next_checkpoint) {
+        // fails harmlessly if this part was played before
+        dumb_it_sr_add_checkpoint (duh_get_it_sigrenderer (info->renderer), pos, MAX_CHECKPOINTS);
+        info->next_checkpoint = pos + CHECKPOINT_INTERVAL;
+    }
     trace ("cdumb_read %d\n", ret*samplesize);
     return ret*samplesize;
 }
@@ -165,17 +177,22 @@ static int
 cdumb_seek (DB_fileinfo_t *_info, float time) {
     trace ("cdumb_read seek %f\n", time);
     dumb_info_t *info = (dumb_info_t *)_info;
-    if (time < _info->readpos) {
-        if (cdumb_startrenderer (_info) < 0) {
+    long pos = time * 65536;
+    long curr = duh_sigrenderer_get_position (info->renderer);
+    // restart from the nearest checkpoint, unless the current position is
+    // closer to the target
+    long checkpoint = dumb_it_sd_get_checkpoint_time (duh_get_it_sigdata (info->duh), pos);
+    if (pos < curr || checkpoint > curr) {
+        if (cdumb_startrenderer (_info, pos) < 0) {
             return -1;
-        }       
+        }
     }
     else {
-        time -= _info->readpos;
+        int samples = (pos - curr) / 65536.f * _info->fmt.samplerate;
+        duh_sigrenderer_generate_samples (info->renderer, 0, 65536.0f / _info->fmt.samplerate, samples, NULL);
     }
-    int pos = time * _info->fmt.samplerate;
-    duh_sigrenderer_generate_samples (info->renderer, 0, 65536.0f / _info->fmt.samplerate, pos, NULL);
     _info->readpos = duh_sigrenderer_get_position (info->renderer) / 65536.f;
+    info->next_checkpoint = duh_sigrenderer_get_position (info->renderer) + CHECKPOINT_INTERVAL;
     return 0;
 }
 
@@ -831,8 +848,19 @@ cdumb_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
 
     read_metadata_internal (it, itsd);
 
-    dumb_it_do_initial_runthrough (duh);
-    deadbeef->plt_set_item_duration (plt, it, duh_get_length (duh)/65536.0f);
+    // finding the length means rendering the whole module, so it's
+    // remembered across runs, keyed by the file contents
+    uint8_t key[16];
+    int cached = deadbeef->vminor >= 7 && !deadbeef->duration_cache_key ("dumb", fname, key);
+    float dur = cached ? deadbeef->duration_cache_get (key, 0) : -1;
+    if (dur < 0) {
+        dumb_it_do_initial_runthrough (duh);
+        dur = duh_get_length (duh)/65536.0f;
+        if (cached) {
+            deadbeef->duration_cache_set (key, 0, dur);
+        }
+    }
+    deadbeef->plt_set_item_duration (plt, it, dur);
     deadbeef->pl_add_meta (it, ":FILETYPE", ftype);
 //    printf ("duration: %f\n", _info->duration);
     after = deadbeef->plt_insert_item (plt, after, it);
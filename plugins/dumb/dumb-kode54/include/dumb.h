@@ -440,6 +440,8 @@ DUH *dumb_read_riff_quick(DUMBFILE *f);
 DUH *dumb_read_asy_quick(DUMBFILE *f);
 
 long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata, int startorder);
+int dumb_it_sr_add_checkpoint(DUMB_IT_SIGRENDERER *sigrenderer, long pos, int max_checkpoints);
+long dumb_it_sd_get_checkpoint_time(DUMB_IT_SIGDATA *sigdata, long pos);
 void dumb_it_do_initial_runthrough(DUH *duh);
 
 int dumb_get_psm_subsong_count(DUMBFILE *f);
@@ -5353,6 +5353,66 @@ long dumb_it_build_checkpoints(DUMB_IT_SIGDATA *sigdata, int startorder)
 
 
 
+/* Adds a copy of the sigrenderer's current state to the checkpoint list of
+ * its sigdata, so that duh_start_sigrenderer() can start near a position
+ * without rendering everything before it. pos is the sigrenderer's position,
+ * as returned by duh_sigrenderer_get_position(), and must be past the last
+ * checkpoint. Returns -1 if it isn't, if there are max_checkpoints already,
+ * or on allocation failure.
+ */
+int dumb_it_sr_add_checkpoint(DUMB_IT_SIGRENDERER *sigrenderer, long pos, int max_checkpoints)
+{
+	DUMB_IT_SIGDATA *sigdata;
+	IT_CHECKPOINT *checkpoint, *last;
+	int n = 1;
+	if (!sigrenderer) return -1;
+	sigdata = sigrenderer->sigdata;
+	if (!sigdata->checkpoint) {
+		/* it_start_sigrenderer() expects the list to start at time 0 */
+		checkpoint = malloc(sizeof(*checkpoint));
+		if (!checkpoint) return -1;
+		checkpoint->time = 0;
+		checkpoint->next = NULL;
+		checkpoint->sigrenderer = dumb_it_init_sigrenderer(sigdata, 0, 0);
+		if (!checkpoint->sigrenderer) {
+			free(checkpoint);
+			return -1;
+		}
+		sigdata->checkpoint = checkpoint;
+	}
+	for (last = sigdata->checkpoint; last->next; last = last->next)
+		n++;
+	if (pos <= last->time || n >= max_checkpoints) return -1;
+	checkpoint = malloc(sizeof(*checkpoint));
+	if (!checkpoint) return -1;
+	checkpoint->time = pos;
+	checkpoint->next = NULL;
+	checkpoint->sigrenderer = dup_sigrenderer(sigrenderer, 0, NULL);
+	if (!checkpoint->sigrenderer) {
+		free(checkpoint);
+		return -1;
+	}
+	last->next = checkpoint;
+	return 0;
+}
+
+
+
+/* Returns the position of the checkpoint which duh_start_sigrenderer()
+ * would start from to reach pos, or 0 if there are none.
+ */
+long dumb_it_sd_get_checkpoint_time(DUMB_IT_SIGDATA *sigdata, long pos)
+{
+	IT_CHECKPOINT *checkpoint;
+	if (!sigdata || !sigdata->checkpoint) return 0;
+	checkpoint = sigdata->checkpoint;
+	while (checkpoint->next && checkpoint->next->time < pos)
+		checkpoint = checkpoint->next;
+	return checkpoint->time;
+}
+
+
+
 void dumb_it_do_initial_runthrough(DUH *duh)
 {
 	if (duh) {
@@ -37,6 +37,7 @@
 //#include <alloca.h>
 #include <assert.h>
 #include <math.h>
+#include <unistd.h>
 #include "../../deadbeef.h"
 
 #ifdef TARGET_ANDROID
@@ -276,12 +277,16 @@ typedef struct APEContext {
     int skip_header;
 } APEContext;
 
+struct ape_parallel_s;
+
 typedef struct {
     DB_fileinfo_t info;
     int startsample;
     int endsample;
     APEContext ape_ctx;
     DB_FILE *fp;
+    uint32_t hints;
+    struct ape_parallel_s *parallel; // NULL in sequential mode
 } ape_info_t;
 
 
@@ -667,10 +672,15 @@ ape_free_ctx (APEContext *ape_ctx) {
     }
 }
 
+static void ape_parallel_free (ape_info_t *info);
+
 static void
 ffap_free (DB_fileinfo_t *_info)
 {
     ape_info_t *info = (ape_info_t *)_info;
+    if (info->parallel) {
+        ape_parallel_free (info);
+    }
     ape_free_ctx (&info->ape_ctx);
     if (info->fp) {
         deadbeef->fclose (info->fp);
@@ -682,9 +692,12 @@ static DB_fileinfo_t *
 ffap_open (uint32_t hints) {
     DB_fileinfo_t *_info = malloc (sizeof (ape_info_t));
     memset (_info, 0, sizeof (ape_info_t));
+    ((ape_info_t *)_info)->hints = hints;
     return _info;
 }
 
+static int ape_parallel_init (ape_info_t *info);
+
 static int
 ffap_init (DB_fileinfo_t *_info, DB_playItem_t *it)
 {
@@ -750,6 +763,12 @@ ffap_init (DB_fileinfo_t *_info, DB_playItem_t *it)
         fprintf (stderr, "ape: failed to allocate memory for packet data\n");
         return -1;
     }
+
+    int parallel = deadbeef->conf_get_int ("ffap.parallel", 0);
+    if (parallel == 2 || (parallel == 1 && (info->hints & DDB_DECODER_HINT_OFFLINE))) {
+        // falls back to sequential decoding on failure
+        ape_parallel_init (info);
+    }
     return 0;
 }
 
@@ -1461,6 +1480,62 @@ static void ape_unpack_stereo(APEContext * ctx, int count)
     }
 }
 
+// converts decoded0/decoded1[from..count) to interleaved pcm, returns the end
+// of written data
+static char *
+ape_output_samples (APEContext *s, int bps, char *samples, int from, int count)
+{
+    int i = from;
+    if (bps == 32) {
+        for (; i < count; i++) {
+            *((int32_t*)samples) = s->decoded0[i];
+            samples += 4;
+            if(s->channels > 1) {
+                *((int32_t*)samples) = s->decoded1[i];
+                samples += 4;
+            }
+        }
+    }
+    else if (bps == 24) {
+        for (; i < count; i++) {
+            int32_t sample = s->decoded0[i];
+
+            samples[0] = sample&0xff;
+            samples[1] = (sample&0xff00)>>8;
+            samples[2] = (sample&0xff0000)>>16;
+            samples += 3;
+            if(s->channels > 1) {
+                sample = s->decoded1[i];
+                samples[0] = sample&0xff;
+                samples[1] = (sample&0xff00)>>8;
+                samples[2] = (sample&0xff0000)>>16;
+                samples += 3;
+            }
+        }
+    }
+    else if (bps == 16) {
+        for (; i < count; i++) {
+            *((int16_t*)samples) = (int16_t)s->decoded0[i];
+            samples += 2;
+            if(s->channels > 1) {
+                *((int16_t*)samples) = (int16_t)s->decoded1[i];
+                samples += 2;
+            }
+        }
+    }
+    else if (bps == 8) {
+        for (; i < count; i++) {
+            *samples = (int16_t)s->decoded0[i];
+            samples++;
+            if(s->channels > 1) {
+                *samples = (int16_t)s->decoded1[i];
+                samples++;
+            }
+        }
+    }
+    return samples;
+}
+
 static int
 ape_decode_frame(DB_fileinfo_t *_info, void *data, int *data_size)
 {
@@ -1468,7 +1543,7 @@ ape_decode_frame(DB_fileinfo_t *_info, void *data, int *data_size)
     APEContext *s = &info->ape_ctx;
     char *samples = data;
     int nblocks;
-    int i, n;
+    int n;
     int blockstodecode;
     int bytes_used;
     int samplesize = _info->fmt.bps/8 * s->channels;;
@@ -1569,56 +1644,8 @@ ape_decode_frame(DB_fileinfo_t *_info, void *data, int *data_size)
     }
 
     int skip = min (s->samplestoskip, blockstodecode);
-    i = skip;
+    samples = ape_output_samples (s, _info->fmt.bps, samples, skip, blockstodecode);
 
-    if (_info->fmt.bps == 32) {
-        for (; i < blockstodecode; i++) {
-            *((int32_t*)samples) = s->decoded0[i];
-            samples += 4;
-            if(s->channels > 1) {
-                *((int32_t*)samples) = s->decoded1[i];
-                samples += 4;
-            }
-        }
-    }
-    else if (_info->fmt.bps == 24) {
-        for (; i < blockstodecode; i++) {
-            int32_t sample = s->decoded0[i];
-
-            samples[0] = sample&0xff;
-            samples[1] = (sample&0xff00)>>8;
-            samples[2] = (sample&0xff0000)>>16;
-            samples += 3;
-            if(s->channels > 1) {
-                sample = s->decoded1[i];
-                samples[0] = sample&0xff;
-                samples[1] = (sample&0xff00)>>8;
-                samples[2] = (sample&0xff0000)>>16;
-                samples += 3;
-            }
-        }
-    }
-    else if (_info->fmt.bps == 16) {
-        for (; i < blockstodecode; i++) {
-            *((int16_t*)samples) = (int16_t)s->decoded0[i];
-            samples += 2;
-            if(s->channels > 1) {
-                *((int16_t*)samples) = (int16_t)s->decoded1[i];
-                samples += 2;
-            }
-        }
-    }
-    else if (_info->fmt.bps == 8) {
-        for (; i < blockstodecode; i++) {
-            *samples = (int16_t)s->decoded0[i];
-            samples++;
-            if(s->channels > 1) {
-                *samples = (int16_t)s->decoded1[i];
-                samples++;
-            }
-        }
-    }
-    
     s->samplestoskip -= skip;
     s->samples -= blockstodecode;
 
@@ -1638,6 +1665,382 @@ error:
     return bytes_used;
 }
 
+/**
+ * @defgroup parallel frame-parallel decoding
+ * Every APE frame restarts the entropy decoder, predictor and filters, so
+ * frames can be decoded independently. In parallel mode the reading thread
+ * only does file i/o: it loads whole compressed frames into a ring of slots,
+ * worker threads decode them, and the results are consumed in frame order.
+ * Memory use is about (threads + 2) * (compressed + decoded frame size), so
+ * this is meant for conversion/scanning, and is off by default.
+ * @{
+ */
+
+#define APE_MAX_PARALLEL_THREADS 16
+
+// zeroed bytes after the frame data, the range decoder may read a bit ahead
+#define APE_FRAME_PADDING 16
+
+enum {
+    APE_SLOT_EMPTY,    // owned by the reading thread
+    APE_SLOT_QUEUED,   // compressed data loaded, waiting for a worker
+    APE_SLOT_DECODING,
+    APE_SLOT_DONE,
+    APE_SLOT_ERROR,
+};
+
+typedef struct {
+    int state;
+    uint8_t *data;     // compressed frame with packet header, byteswapped
+    int datasize;
+    char *pcm;         // decoded frame
+    int pcmsize;
+    int pcmpos;        // number of bytes already returned by read
+} ape_slot_t;
+
+typedef struct {
+    ape_info_t *info;
+    APEContext *s;     // private decoder state
+    intptr_t tid;
+} ape_worker_t;
+
+typedef struct ape_parallel_s {
+    uintptr_t mutex;
+    uintptr_t cond;
+    ape_worker_t workers[APE_MAX_PARALLEL_THREADS];
+    int nthreads;
+    int quit;
+
+    ape_slot_t *slots;
+    int nslots;
+    int head;          // slot holding the frame to be returned next
+    int nqueued;       // number of slots in use, starting from head
+    int nextframe;     // next frame to be loaded
+} ape_parallel_t;
+
+// loads compressed frame into slot, in the same layout ape_read_packet uses
+static int
+ape_parallel_load_frame (ape_info_t *info, int frame, ape_slot_t *slot)
+{
+    APEContext *ape = &info->ape_ctx;
+    int nblocks = frame == ape->totalframes - 1 ? ape->finalframeblocks : ape->blocksperframe;
+
+    if (deadbeef->fseek (info->fp, ape->frames[frame].pos + ape->skip_header, SEEK_SET) != 0) {
+        return -1;
+    }
+    AV_WL32(slot->data    , nblocks);
+    AV_WL32(slot->data + 4, ape->frames[frame].skip);
+    int r = deadbeef->fread (slot->data + 8, 1, ape->frames[frame].size, info->fp);
+    if (r <= 0) {
+        return -1;
+    }
+    memset (slot->data + 8 + r, 0, ape->frames[frame].size - r + APE_FRAME_PADDING);
+    slot->datasize = r + 8;
+    bswap_buf ((uint32_t*)slot->data, (const uint32_t*)slot->data, (slot->datasize + 3) >> 2);
+
+    if (!(info->hints & DDB_DECODER_HINT_OFFLINE) && nblocks != 0) {
+        float sec = (float)nblocks / ape->samplerate;
+        int bitrate = ape->frames[frame].size / sec * 8;
+        if (bitrate > 0) {
+            deadbeef->streamer_set_bitrate (bitrate/1000);
+        }
+    }
+    return 0;
+}
+
+// decodes the whole frame in slot using private decoder state s
+static int
+ape_parallel_decode_frame (APEContext *s, int bps, ape_slot_t *slot)
+{
+    s->ptr = s->last_ptr = slot->data;
+    s->data_end = slot->data + slot->datasize;
+    slot->pcmsize = 0;
+    slot->pcmpos = 0;
+
+    int nblocks = s->samples = bytestream_get_be32(&s->ptr);
+    int n = bytestream_get_be32(&s->ptr);
+    if (n < 0 || n > 3) {
+        fprintf (stderr, "ape: Incorrect offset passed\n");
+        return -1;
+    }
+    s->ptr += n;
+    s->currentframeblocks = nblocks;
+    if (nblocks <= 0) {
+        return 0;
+    }
+
+    memset(s->decoded0,  0, sizeof(s->decoded0));
+    memset(s->decoded1,  0, sizeof(s->decoded1));
+    init_frame_decoder(s);
+
+    char *samples = slot->pcm;
+    while (s->samples > 0) {
+        int blockstodecode = min(BLOCKS_PER_LOOP, s->samples);
+        s->error = 0;
+        if ((s->channels == 1) || (s->frameflags & APE_FRAMECODE_PSEUDO_STEREO))
+            ape_unpack_mono(s, blockstodecode);
+        else
+            ape_unpack_stereo(s, blockstodecode);
+
+        if (s->error || s->ptr >= s->data_end) {
+            fprintf (stderr, "ape: Error decoding frame\n");
+            return -1;
+        }
+        samples = ape_output_samples (s, bps, samples, 0, blockstodecode);
+        s->samples -= blockstodecode;
+    }
+    slot->pcmsize = samples - slot->pcm;
+    return 0;
+}
+
+// copy of the stream decoder state with its own filter buffers
+static APEContext *
+ape_parallel_ctx_new (APEContext *ape)
+{
+    APEContext *s = malloc (sizeof (APEContext));
+    if (!s) {
+        return NULL;
+    }
+    memcpy (s, ape, sizeof (APEContext));
+    s->frames = NULL;
+    s->seektable = NULL;
+    s->packet_data = NULL;
+    memset (s->filterbuf, 0, sizeof (s->filterbuf));
+    for (int i = 0; i < APE_FILTER_LEVELS; i++) {
+        if (!ape_filter_orders[s->fset][i])
+            break;
+        if (posix_memalign ((void **)&s->filterbuf[i], 16, (ape_filter_orders[s->fset][i] * 3 + HISTORY_SIZE) * 4)) {
+            ape_free_ctx (s);
+            free (s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+static void
+ape_parallel_worker (void *ctx)
+{
+    ape_worker_t *w = ctx;
+    ape_parallel_t *p = w->info->parallel;
+    int bps = w->info->info.fmt.bps;
+
+    deadbeef->mutex_lock (p->mutex);
+    while (!p->quit) {
+        ape_slot_t *slot = NULL;
+        for (int k = 0; k < p->nqueued; k++) {
+            ape_slot_t *sl = &p->slots[(p->head + k) % p->nslots];
+            if (sl->state == APE_SLOT_QUEUED) {
+                slot = sl;
+                break;
+            }
+        }
+        if (!slot) {
+            deadbeef->cond_wait_locked (p->cond, p->mutex);
+            continue;
+        }
+        slot->state = APE_SLOT_DECODING;
+        deadbeef->mutex_unlock (p->mutex);
+
+        int res = ape_parallel_decode_frame (w->s, bps, slot);
+
+        deadbeef->mutex_lock (p->mutex);
+        slot->state = res < 0 ? APE_SLOT_ERROR : APE_SLOT_DONE;
+        deadbeef->cond_broadcast (p->cond);
+    }
+    deadbeef->mutex_unlock (p->mutex);
+}
+
+static void
+ape_parallel_free (ape_info_t *info)
+{
+    ape_parallel_t *p = info->parallel;
+    if (p->mutex) {
+        deadbeef->mutex_lock (p->mutex);
+        p->quit = 1;
+        deadbeef->cond_broadcast (p->cond);
+        deadbeef->mutex_unlock (p->mutex);
+    }
+    for (int i = 0; i < APE_MAX_PARALLEL_THREADS; i++) {
+        ape_worker_t *w = &p->workers[i];
+        if (w->tid) {
+            deadbeef->thread_join (w->tid);
+        }
+        if (w->s) {
+            ape_free_ctx (w->s);
+            free (w->s);
+        }
+    }
+    if (p->slots) {
+        for (int i = 0; i < p->nslots; i++) {
+            if (p->slots[i].data) {
+                free (p->slots[i].data);
+            }
+            if (p->slots[i].pcm) {
+                free (p->slots[i].pcm);
+            }
+        }
+        free (p->slots);
+    }
+    if (p->cond) {
+        deadbeef->cond_free (p->cond);
+    }
+    if (p->mutex) {
+        deadbeef->mutex_free (p->mutex);
+    }
+    free (p);
+    info->parallel = NULL;
+}
+
+static int
+ape_parallel_init (ape_info_t *info)
+{
+    APEContext *ape = &info->ape_ctx;
+    if (!ape->totalframes) {
+        return -1;
+    }
+    // the workers wait on the queue with the mutex held
+    if (deadbeef->vminor < 7) {
+        return -1;
+    }
+
+    int nthreads = deadbeef->conf_get_int ("ffap.parallel_threads", 0);
+    if (nthreads <= 0) {
+        nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+    }
+    nthreads = max (1, min (nthreads, APE_MAX_PARALLEL_THREADS));
+
+    ape_parallel_t *p = calloc (1, sizeof (ape_parallel_t));
+    if (!p) {
+        return -1;
+    }
+    info->parallel = p;
+
+    // all buffers are allocated upfront for the largest frame
+    int maxsize = 0;
+    for (int i = 0; i < ape->totalframes; i++) {
+        maxsize = max (maxsize, ape->frames[i].size);
+    }
+    int pcmsize = ape->blocksperframe * info->info.fmt.bps / 8 * ape->channels;
+
+    p->nslots = nthreads + 2;
+    p->slots = calloc (p->nslots, sizeof (ape_slot_t));
+    if (!p->slots) {
+        goto error;
+    }
+    for (int i = 0; i < p->nslots; i++) {
+        p->slots[i].data = malloc (maxsize + 8 + APE_FRAME_PADDING);
+        p->slots[i].pcm = malloc (pcmsize);
+        if (!p->slots[i].data || !p->slots[i].pcm) {
+            fprintf (stderr, "ape: failed to allocate memory for parallel decoding, using sequential mode\n");
+            goto error;
+        }
+    }
+
+    p->mutex = deadbeef->mutex_create ();
+    p->cond = deadbeef->cond_create ();
+    p->nextframe = ape->currentframe;
+    for (int i = 0; i < nthreads; i++) {
+        ape_worker_t *w = &p->workers[p->nthreads];
+        w->info = info;
+        w->s = ape_parallel_ctx_new (ape);
+        if (!w->s) {
+            break;
+        }
+        w->tid = deadbeef->thread_start (ape_parallel_worker, w);
+        if (!w->tid) {
+            break;
+        }
+        p->nthreads++;
+    }
+    if (!p->nthreads) {
+        goto error;
+    }
+    trace ("ape: parallel decoding using %d threads\n", p->nthreads);
+    return 0;
+
+error:
+    ape_parallel_free (info);
+    return -1;
+}
+
+// drops all decoded and pending frames, next read starts at frame
+static void
+ape_parallel_reset (ape_info_t *info, int frame)
+{
+    ape_parallel_t *p = info->parallel;
+    deadbeef->mutex_lock (p->mutex);
+    for (int i = 0; i < p->nslots; i++) {
+        while (p->slots[i].state == APE_SLOT_DECODING) {
+            deadbeef->cond_wait_locked (p->cond, p->mutex);
+        }
+        p->slots[i].state = APE_SLOT_EMPTY;
+    }
+    p->head = 0;
+    p->nqueued = 0;
+    p->nextframe = frame;
+    deadbeef->mutex_unlock (p->mutex);
+}
+
+static int
+ape_parallel_read (ape_info_t *info, char *buffer, int size)
+{
+    ape_parallel_t *p = info->parallel;
+    APEContext *ape = &info->ape_ctx;
+    int samplesize = info->info.fmt.bps / 8 * ape->channels;
+    int inits = size;
+
+    while (size > 0) {
+        // keep all slots busy; only this thread touches empty slots, so the
+        // file is read without holding the lock
+        while (p->nqueued < p->nslots && p->nextframe < ape->totalframes) {
+            ape_slot_t *slot = &p->slots[(p->head + p->nqueued) % p->nslots];
+            int res = ape_parallel_load_frame (info, p->nextframe, slot);
+            deadbeef->mutex_lock (p->mutex);
+            slot->state = res < 0 ? APE_SLOT_ERROR : APE_SLOT_QUEUED;
+            p->nqueued++;
+            deadbeef->cond_broadcast (p->cond);
+            deadbeef->mutex_unlock (p->mutex);
+            p->nextframe++;
+        }
+        if (!p->nqueued) {
+            break;
+        }
+
+        ape_slot_t *slot = &p->slots[p->head];
+        deadbeef->mutex_lock (p->mutex);
+        while (slot->state == APE_SLOT_QUEUED || slot->state == APE_SLOT_DECODING) {
+            deadbeef->cond_wait_locked (p->cond, p->mutex);
+        }
+        deadbeef->mutex_unlock (p->mutex);
+        if (slot->state == APE_SLOT_ERROR) {
+            fprintf (stderr, "ape: error decoding frame\n");
+            break;
+        }
+
+        if (ape->samplestoskip > 0) {
+            slot->pcmpos = min (slot->pcmsize, ape->samplestoskip * samplesize);
+            ape->samplestoskip = 0;
+        }
+        int sz = min (size, slot->pcmsize - slot->pcmpos);
+        memcpy (buffer, slot->pcm + slot->pcmpos, sz);
+        buffer += sz;
+        size -= sz;
+        slot->pcmpos += sz;
+
+        if (slot->pcmpos == slot->pcmsize) {
+            deadbeef->mutex_lock (p->mutex);
+            slot->state = APE_SLOT_EMPTY;
+            p->head = (p->head + 1) % p->nslots;
+            p->nqueued--;
+            deadbeef->mutex_unlock (p->mutex);
+        }
+    }
+    return inits - size;
+}
+
+/** @} */ // group parallel
+
 static DB_playItem_t *
 ffap_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
     APEContext ape_ctx;
@@ -1742,7 +2145,10 @@ ffap_read (DB_fileinfo_t *_info, char *buffer, int size) {
         }
     }
     int inits = size;
-    while (size > 0) {
+    if (info->parallel) {
+        size -= ape_parallel_read (info, buffer, size);
+    }
+    while (!info->parallel && size > 0) {
         if (info->ape_ctx.remaining > 0) {
             int sz = min (size, info->ape_ctx.remaining);
             memcpy (buffer, info->ape_ctx.buffer, sz);
@@ -1803,6 +2209,9 @@ ffap_seek_sample (DB_fileinfo_t *_info, int sample) {
     info->ape_ctx.packet_remaining = 0;
     info->ape_ctx.samples = 0;
     info->ape_ctx.currentsample = newsample;
+    if (info->parallel) {
+        ape_parallel_reset (info, nframe);
+    }
     _info->readpos = (float)(newsample-info->startsample)/info->ape_ctx.samplerate;
     return 0;
 }
@@ -1829,6 +2238,73 @@ static int ffap_read_metadata (DB_playItem_t *it) {
     return 0;
 }
 
+// same results as insert, without the cuesheet handling; reads only the
+// header, the seek table and the tags
+static int
+ffap_probe (DB_playItem_t *it, uint32_t flags) {
+    deadbeef->pl_lock ();
+    char fname[strlen (deadbeef->pl_find_meta (it, ":URI")) + 1];
+    strcpy (fname, deadbeef->pl_find_meta (it, ":URI"));
+    deadbeef->pl_unlock ();
+
+    // the format of a subtrack comes from its cuesheet, not from the file
+    if (deadbeef->pl_get_item_flags (it) & DDB_IS_SUBTRACK) {
+        flags &= ~DDB_PROBE_FORMAT;
+    }
+    DB_FILE *fp = deadbeef->fopen (fname);
+    if (!fp) {
+        return -1;
+    }
+
+    if (flags & DDB_PROBE_FORMAT) {
+        APEContext ape_ctx;
+        memset (&ape_ctx, 0, sizeof (ape_ctx));
+        int64_t fsize = deadbeef->fgetlength (fp);
+        int skip = deadbeef->junk_get_leading_size (fp);
+        if (skip > 0) {
+            deadbeef->fseek (fp, skip, SEEK_SET);
+        }
+        if (ape_read_header (fp, &ape_ctx) < 0
+                || ape_ctx.fileversion < APE_MIN_VERSION || ape_ctx.fileversion > APE_MAX_VERSION) {
+            trace ("ape: failed to read ape header\n");
+            deadbeef->fclose (fp);
+            ape_free_ctx (&ape_ctx);
+            return -1;
+        }
+        float duration = ape_ctx.totalsamples / (float)ape_ctx.samplerate;
+        ddb_playlist_t *plt = deadbeef->pl_get_playlist (it);
+        deadbeef->plt_set_item_duration (plt, it, duration);
+        if (plt) {
+            deadbeef->plt_unref (plt);
+        }
+
+        char s[100];
+        deadbeef->pl_replace_meta (it, ":FILETYPE", "APE");
+        snprintf (s, sizeof (s), "%lld", fsize);
+        deadbeef->pl_replace_meta (it, ":FILE_SIZE", s);
+        snprintf (s, sizeof (s), "%d", ape_ctx.bps);
+        deadbeef->pl_replace_meta (it, ":BPS", s);
+        snprintf (s, sizeof (s), "%d", ape_ctx.channels);
+        deadbeef->pl_replace_meta (it, ":CHANNELS", s);
+        snprintf (s, sizeof (s), "%d", ape_ctx.samplerate);
+        deadbeef->pl_replace_meta (it, ":SAMPLERATE", s);
+        int br = (int)roundf(fsize / duration * 8 / 1000);
+        snprintf (s, sizeof (s), "%d", br);
+        deadbeef->pl_replace_meta (it, ":BITRATE", s);
+        ape_free_ctx (&ape_ctx);
+    }
+
+    if (flags & DDB_PROBE_TAGS) {
+        deadbeef->pl_delete_all_meta (it);
+        /*int apeerr = */deadbeef->junk_apev2_read (it, fp);
+        /*int v2err = */deadbeef->junk_id3v2_read (it, fp);
+        /*int v1err = */deadbeef->junk_id3v1_read (it, fp);
+        deadbeef->pl_add_meta (it, "title", NULL);
+    }
+    deadbeef->fclose (fp);
+    return 0;
+}
+
 static int ffap_write_metadata (DB_playItem_t *it) {
     // get options
     int strip_id3v2 = deadbeef->conf_get_int ("ape.strip_id3v2", 0);
@@ -1863,10 +2339,15 @@ static int ffap_write_metadata (DB_playItem_t *it) {
 
 static const char *exts[] = { "ape", NULL };
 
+static const char settings_dlg[] =
+    "property \"Frame-parallel decoding\" select[3] ffap.parallel 0 Off \"Conversion and scanning only\" Always;\n"
+    "property \"Decoding threads (0 = number of CPUs)\" entry ffap.parallel_threads 0;\n"
+;
+
 // define plugin interface
 static DB_decoder_t plugin = {
     .plugin.api_vmajor = 1,
-    .plugin.api_vminor = 0,
+    .plugin.api_vminor = 7,
     .plugin.version_major = 1,
     .plugin.version_minor = 0,
     .plugin.type = DB_PLUGIN_DECODER,
@@ -1894,6 +2375,7 @@ static DB_decoder_t plugin = {
         "Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.\n"
     ,
     .plugin.website = "http://deadbeef.sf.net",
+    .plugin.configdialog = settings_dlg,
     .open = ffap_open,
     .init = ffap_init,
     .free = ffap_free,
@@ -1904,6 +2386,7 @@ static DB_decoder_t plugin = {
     .read_metadata = ffap_read_metadata,
     .write_metadata = ffap_write_metadata,
     .exts = exts,
+    .probe = ffap_probe,
 };
 
 #if HAVE_SSE2 && !ARCH_UNKNOWN
@@ -49,13 +49,19 @@ static DB_artwork_plugin_t *coverart_plugin = NULL;
 #define min(x,y) ((x)<(y)?(x):(y))
 #define max(x,y) ((x)>(y)?(x):(y))
 
-#define BUFFERSIZE 100000
+// largest block size allowed by the format, used when STREAMINFO doesn't
+// declare one
+#define MAX_BLOCKSIZE 65535
 
 typedef struct {
     DB_fileinfo_t info;
     FLAC__StreamDecoder *decoder;
-    char *buffer; // this buffer always has float samples
+    char *buffer; // decoded samples, in native format or float, see float_output
+    int buffersize; // holds one largest frame as float, see cflac_alloc_buffer
+    int max_blocksize; // from STREAMINFO
     int remaining; // bytes remaining in buffer from last read
+    int readpos; // offset of the first unread byte in buffer
+    int float_output; // set when the last read came through read_float
     int64_t startsample;
     int64_t endsample;
     int64_t currentsample;
@@ -73,6 +79,7 @@ typedef struct {
     const char *fname;
     int bitrate;
     FLAC__StreamMetadata *flac_cue_sheet;
+    uint32_t probe_flags;
 } flac_info_t;
 
 // callbacks
@@ -125,15 +132,42 @@ cflac_write_callback (const FLAC__StreamDecoder *decoder, const FLAC__Frame *fra
     if (info->bitrate > 0) {
         deadbeef->streamer_set_bitrate (info->bitrate);
     }
-    int samplesize = _info->fmt.channels * _info->fmt.bps / 8;
-    int bufsize = BUFFERSIZE - info->remaining;
+    int samplesize = _info->fmt.channels * (info->float_output ? 4 : _info->fmt.bps / 8);
+    int readbytes = frame->header.blocksize * samplesize;
+    if (info->readpos > 0 && info->readpos + info->remaining + readbytes > info->buffersize) {
+        // only happens if a frame is decoded before the previous one was
+        // fully consumed, so this is at most one move per frame
+        memmove (info->buffer, &info->buffer[info->readpos], info->remaining);
+        info->readpos = 0;
+    }
+    // the buffered samples must still fit after cflac_set_float_output
+    // widened them to float in place
+    int floatsize = (info->remaining / (samplesize / _info->fmt.channels) + frame->header.blocksize * _info->fmt.channels) * 4;
+    if (floatsize > info->buffersize) {
+        // the frame is larger than STREAMINFO said, which only happens with
+        // broken encoders
+        char *buffer = realloc (info->buffer, floatsize);
+        if (buffer) {
+            info->buffer = buffer;
+            info->buffersize = floatsize;
+        }
+    }
+    int bufsize = info->buffersize - info->readpos - info->remaining;
     int bufsamples = bufsize / samplesize;
     int nsamples = min (bufsamples, frame->header.blocksize);
-    char *bufptr = &info->buffer[info->remaining];
+    char *bufptr = &info->buffer[info->readpos + info->remaining];
 
-    int readbytes = frame->header.blocksize * samplesize;
-
-    if (_info->fmt.bps == 32) {
+    if (info->float_output) {
+        float scale = 1.f / (float)(1U << (_info->fmt.bps - 1));
+        for (int i = 0; i <  nsamples; i++) {
+            for (int c = 0; c < _info->fmt.channels; c++) {
+                *((float*)bufptr) = inputbuffer[c][i] * scale;
+                bufptr += 4;
+                info->remaining += 4;
+            }
+        }
+    }
+    else if (_info->fmt.bps == 32) {
         for (int i = 0; i <  nsamples; i++) {
             for (int c = 0; c < _info->fmt.channels; c++) {
                 int32_t sample = inputbuffer[c][i];
@@ -185,6 +219,7 @@ cflac_metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__StreamMe
     DB_fileinfo_t *_info = (DB_fileinfo_t *)client_data;
     flac_info_t *info = (flac_info_t *)_info;
     info->totalsamples = metadata->data.stream_info.total_samples;
+    info->max_blocksize = metadata->data.stream_info.max_blocksize;
     _info->fmt.samplerate = metadata->data.stream_info.sample_rate;
     _info->fmt.channels = metadata->data.stream_info.channels;
     _info->fmt.bps = metadata->data.stream_info.bits_per_sample;
@@ -214,6 +249,21 @@ cflac_init_error_callback(const FLAC__StreamDecoder *decoder, FLAC__StreamDecode
     }
 }
 
+// the buffer always receives a whole frame, and is large enough for the
+// largest frame in the stream in float, the widest output format, so that
+// read_float never drops samples and switching formats can convert in place
+static int
+cflac_alloc_buffer (flac_info_t *info) {
+    int blocksize = info->max_blocksize > 0 ? info->max_blocksize : MAX_BLOCKSIZE;
+    info->buffersize = blocksize * info->info.fmt.channels * 4;
+    info->buffer = malloc (info->buffersize);
+    if (!info->buffer) {
+        info->buffersize = 0;
+        return -1;
+    }
+    return 0;
+}
+
 static DB_fileinfo_t *
 cflac_open (uint32_t hints) {
     DB_fileinfo_t *_info = malloc (sizeof (flac_info_t));
@@ -337,8 +387,12 @@ cflac_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
     }
     deadbeef->pl_unlock ();
 
-    info->buffer = malloc (BUFFERSIZE);
+    if (cflac_alloc_buffer (info) < 0) {
+        trace ("flac: failed to allocate %d bytes\n", info->buffersize);
+        return -1;
+    }
     info->remaining = 0;
+    info->readpos = 0;
     if (it->endsample > 0) {
         info->startsample = it->startsample;
         info->endsample = it->endsample;
@@ -383,10 +437,94 @@ cflac_free (DB_fileinfo_t *_info) {
     }
 }
 
+// switching between read and read_float converts whatever is left in the
+// buffer, so that no samples are lost or misinterpreted.
+// the conversion is done in place: int to float widens the samples, so it
+// runs from the end, float to int narrows them, so it runs from the start.
+// the buffer fits a whole frame as float, so the result always fits
+static void
+cflac_set_float_output (flac_info_t *info, int float_output) {
+    if (info->float_output == float_output) {
+        return;
+    }
+    DB_fileinfo_t *_info = &info->info;
+    if (info->remaining) {
+        if (info->readpos) {
+            memmove (info->buffer, &info->buffer[info->readpos], info->remaining);
+            info->readpos = 0;
+        }
+        int bps = _info->fmt.bps;
+        int bytes = bps / 8;
+        float scale = (float)(1U << (bps - 1));
+        uint8_t *buf = (uint8_t *)info->buffer;
+        if (float_output) {
+            int n = info->remaining / bytes;
+            if (n * 4 > info->buffersize) {
+                // growing the buffer for an oversized frame failed
+                n = info->buffersize / 4;
+            }
+            float *out = (float *)buf;
+            for (int i = n - 1; i >= 0; i--) {
+                const uint8_t *in = buf + i * bytes;
+                int32_t sample;
+                switch (bps) {
+                case 8:
+                    sample = (int8_t)in[0];
+                    break;
+                case 16:
+                    sample = (int16_t)(in[0] | (in[1] << 8));
+                    break;
+                case 24:
+                    sample = (int32_t)((in[0] << 8) | (in[1] << 16) | ((uint32_t)in[2] << 24)) >> 8;
+                    break;
+                default:
+                    sample = *(const int32_t *)in;
+                    break;
+                }
+                out[i] = sample / scale;
+            }
+            info->remaining = n * 4;
+        }
+        else {
+            int n = info->remaining / 4;
+            const float *in = (const float *)buf;
+            int64_t maxval = (int64_t)(1U << (bps - 1)) - 1;
+            for (int i = 0; i < n; i++) {
+                int64_t sample = (int64_t)(in[i] * scale);
+                if (sample > maxval) {
+                    sample = maxval;
+                }
+                else if (sample < -maxval - 1) {
+                    sample = -maxval - 1;
+                }
+                uint8_t *out = buf + i * bytes;
+                switch (bps) {
+                case 8:
+                    out[0] = sample & 0xff;
+                    break;
+                case 16:
+                    out[0] = sample & 0xff;
+                    out[1] = (sample >> 8) & 0xff;
+                    break;
+                case 24:
+                    out[0] = sample & 0xff;
+                    out[1] = (sample >> 8) & 0xff;
+                    out[2] = (sample >> 16) & 0xff;
+                    break;
+                default:
+                    *(int32_t *)out = (int32_t)sample;
+                    break;
+                }
+            }
+            info->remaining = n * bytes;
+        }
+    }
+    info->float_output = float_output;
+}
+
 static int
-cflac_read (DB_fileinfo_t *_info, char *bytes, int size) {
-    flac_info_t *info = (flac_info_t *)_info;
-    int samplesize = _info->fmt.channels * _info->fmt.bps / 8;
+cflac_read_buffer (flac_info_t *info, char *bytes, int size, int samplesize) {
+    DB_fileinfo_t *_info = &info->info;
     if (info->endsample >= 0) {
         if (size / samplesize + info->currentsample > info->endsample) {
             size = (info->endsample - info->currentsample + 1) * samplesize;
@@ -400,14 +538,14 @@ cflac_read (DB_fileinfo_t *_info, char *bytes, int size) {
     do {
         if (info->remaining) {
             int sz = min(size, info->remaining);
-            memcpy (bytes, info->buffer, sz);
+            memcpy (bytes, &info->buffer[info->readpos], sz);
 
             size -= sz;
             bytes += sz;
-            if (sz < info->remaining) {
-                memmove (info->buffer, &info->buffer[sz], info->remaining - sz);
-            }
+            // advance the cursor instead of moving the rest of the frame
+            // to the front on every read
             info->remaining -= sz;
+            info->readpos = info->remaining ? info->readpos + sz : 0;
             int n = sz / samplesize;
             info->currentsample += sz / samplesize;
             _info->readpos += (float)n / _info->fmt.samplerate;
@@ -432,68 +570,21 @@ cflac_read (DB_fileinfo_t *_info, char *bytes, int size) {
     return initsize - size;
 }
 
-#if 0
 static int
-cflac_read_float32 (DB_fileinfo_t *_info, char *bytes, int size) {
+cflac_read (DB_fileinfo_t *_info, char *bytes, int size) {
     flac_info_t *info = (flac_info_t *)_info;
-    if (size / (4 * _info->fmt.channels) + info->currentsample > info->endsample) {
-        size = (info->endsample - info->currentsample + 1) * 4 * _info->fmt.channels;
-        trace ("size truncated to %d bytes, cursample=%d, endsample=%d\n", size, info->currentsample, info->endsample);
-        if (size <= 0) {
-            return 0;
-        }
-    }
-    int n_output_channels = _info->fmt.channels;
-    if (n_output_channels > 2) {
-        n_output_channels = 2;
-    }
-    int initsize = size;
-    do {
-        if (info->remaining) {
-            int n_input_frames = info->remaining / sizeof (float) / n_output_channels;
-            int n_output_frames = size / n_output_channels / sizeof (float);
-            int n = min (n_input_frames, n_output_frames);
-
-            float *in = (float *)info->buffer;
-            for (int i = 0; i < n; i++) {
-                *((float *)bytes) = *in;
-                size -= sizeof (float);
-                bytes += sizeof (float);
-                if (n_output_channels == 2) {
-                    *((float *)bytes) = *(in+1);
-                    size -= sizeof (float);
-                    bytes += sizeof (float);
-                }
-                in += n_output_channels;
-            }
-            int sz = n * sizeof (float) * n_output_channels;
-            if (sz < info->remaining) {
-                memmove (info->buffer, &info->buffer[sz], info->remaining-sz);
-            }
-            info->remaining -= sz;
-            info->currentsample += n;
-            _info->readpos += (float)n / _info->fmt.samplerate;
-        }
-        if (!size) {
-            break;
-        }
-        if (!FLAC__stream_decoder_process_single (info->decoder)) {
-            trace ("FLAC__stream_decoder_process_single error\n");
-            break;
-        }
-        if (FLAC__stream_decoder_get_state (info->decoder) == FLAC__STREAM_DECODER_END_OF_STREAM) {
-            trace ("FLAC__stream_decoder_get_state eof\n");
-            break;
-        }
-        if (info->flac_critical_error) {
-            trace ("flac: got critical error while decoding\n");
-            return 0;
-        }
-    } while (size > 0);
+    cflac_set_float_output (info, 0);
+    return cflac_read_buffer (info, bytes, size, _info->fmt.channels * _info->fmt.bps / 8);
+}
 
-    return initsize - size;
+// converts straight from libFLAC's int32 planes to interleaved float,
+// skipping the intermediate packed integer representation
+static int
+cflac_read_float (DB_fileinfo_t *_info, float *buffer, int size) {
+    flac_info_t *info = (flac_info_t *)_info;
+    cflac_set_float_output (info, 1);
+    return cflac_read_buffer (info, (char *)buffer, size, _info->fmt.channels * sizeof (float));
 }
-#endif
 
 static int
 cflac_seek_sample (DB_fileinfo_t *_info, int sample) {
@@ -501,6 +592,7 @@ cflac_seek_sample (DB_fileinfo_t *_info, int sample) {
     sample += info->startsample;
     info->currentsample = sample;
     info->remaining = 0;
+    info->readpos = 0;
     if (!FLAC__stream_decoder_seek_absolute (info->decoder, (FLAC__uint64)(sample))) {
         return -1;
     }
@@ -597,7 +689,10 @@ cflac_init_metadata_callback(const FLAC__StreamDecoder *decoder, const FLAC__Str
         _info->fmt.channels = metadata->data.stream_info.channels;
         _info->fmt.bps = metadata->data.stream_info.bits_per_sample;
         info->totalsamples = metadata->data.stream_info.total_samples;
-        if (metadata->data.stream_info.total_samples > 0) {
+        if (!(info->probe_flags & DDB_PROBE_FORMAT)) {
+            // keep the existing duration
+        }
+        else if (metadata->data.stream_info.total_samples > 0) {
             deadbeef->plt_set_item_duration (info->plt, it, metadata->data.stream_info.total_samples / (float)metadata->data.stream_info.sample_rate);
         }
         else {
@@ -694,21 +789,17 @@ cflac_free_temp (DB_fileinfo_t *_info) {
 }
 
 
-static DB_playItem_t *
-cflac_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
-    trace ("flac: inserting %s\n", fname);
-    DB_playItem_t *it = NULL;
+// reads stream info and, if requested, tags of info->it through the
+// decoder's metadata callbacks; the stream itself is never decoded, and only
+// the metadata block types which are actually used get parsed
+static int
+cflac_read_header (flac_info_t *info, const char *fname, uint32_t flags) {
+    DB_playItem_t *it = info->it;
     FLAC__StreamDecoder *decoder = NULL;
-    flac_info_t info;
-    memset (&info, 0, sizeof (info));
-    DB_fileinfo_t *_info = &info.info;
-    info.fname = fname;
-    info.after = after;
-    info.last = after;
-    info.plt = plt;
-    info.file = deadbeef->fopen (fname);
-    if (!info.file) {
-        goto cflac_insert_fail;
+    info->probe_flags = flags;
+    info->file = deadbeef->fopen (fname);
+    if (!info->file) {
+        goto error;
     }
 
     const char *ext = fname + strlen (fname);
@@ -726,86 +817,146 @@ cflac_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
     int skip = 0;
     if (ext && !strcasecmp (ext, "flac")) {
         // skip id3 junk and verify fLaC signature
-        skip = deadbeef->junk_get_leading_size (info.file);
+        skip = deadbeef->junk_get_leading_size (info->file);
         if (skip > 0) {
-            deadbeef->fseek (info.file, skip, SEEK_SET);
+            deadbeef->fseek (info->file, skip, SEEK_SET);
         }
         char sign[4];
-        if (deadbeef->fread (sign, 1, 4, info.file) != 4) {
+        if (deadbeef->fread (sign, 1, 4, info->file) != 4) {
             trace ("flac: failed to read signature\n");
-            goto cflac_insert_fail;
+            goto error;
         }
         if (strncmp (sign, "fLaC", 4)) {
             trace ("flac: file signature is not fLaC\n");
-            goto cflac_insert_fail;
+            goto error;
         }
-        deadbeef->fseek (info.file, -4, SEEK_CUR);
+        deadbeef->fseek (info->file, -4, SEEK_CUR);
     }
     else if (!FLAC_API_SUPPORTS_OGG_FLAC) {
         trace ("flac: ogg transport support is not compiled into FLAC library\n");
-        goto cflac_insert_fail;
+        goto error;
     }
     else {
         isogg = 1;
     }
-    info.init_stop_decoding = 0;
+    info->init_stop_decoding = 0;
 
     // open decoder for metadata reading
     FLAC__StreamDecoderInitStatus status;
     decoder = FLAC__stream_decoder_new();
     if (!decoder) {
         trace ("flac: failed to create decoder\n");
-        goto cflac_insert_fail;
+        goto error;
     }
 
-    // read all metadata
+    // pictures, seektables and padding are skipped without being parsed
     FLAC__stream_decoder_set_md5_checking(decoder, 0);
-    FLAC__stream_decoder_set_metadata_respond_all (decoder);
-    it = deadbeef->pl_item_alloc_init (fname, plugin.plugin.id);
-    info.it = it;
+    if (flags & DDB_PROBE_TAGS) {
+        FLAC__stream_decoder_set_metadata_respond (decoder, FLAC__METADATA_TYPE_VORBIS_COMMENT);
+        FLAC__stream_decoder_set_metadata_respond (decoder, FLAC__METADATA_TYPE_CUESHEET);
+    }
     if (skip > 0) {
-        deadbeef->fseek (info.file, skip, SEEK_SET);
+        deadbeef->fseek (info->file, skip, SEEK_SET);
     }
     else {
-        deadbeef->rewind (info.file);
+        deadbeef->rewind (info->file);
     }
-    deadbeef->fseek (info.file, -4, SEEK_CUR);
+    deadbeef->fseek (info->file, -4, SEEK_CUR);
     if (isogg) {
-        status = FLAC__stream_decoder_init_ogg_stream (decoder, flac_read_cb, flac_seek_cb, flac_tell_cb, flac_lenght_cb, flac_eof_cb, cflac_init_write_callback, cflac_init_metadata_callback, cflac_init_error_callback, &info);
+        status = FLAC__stream_decoder_init_ogg_stream (decoder, flac_read_cb, flac_seek_cb, flac_tell_cb, flac_lenght_cb, flac_eof_cb, cflac_init_write_callback, cflac_init_metadata_callback, cflac_init_error_callback, info);
     }
     else {
-        status = FLAC__stream_decoder_init_stream (decoder, flac_read_cb, flac_seek_cb, flac_tell_cb, flac_lenght_cb, flac_eof_cb, cflac_init_write_callback, cflac_init_metadata_callback, cflac_init_error_callback, &info);
+        status = FLAC__stream_decoder_init_stream (decoder, flac_read_cb, flac_seek_cb, flac_tell_cb, flac_lenght_cb, flac_eof_cb, cflac_init_write_callback, cflac_init_metadata_callback, cflac_init_error_callback, info);
     }
-    if (status != FLAC__STREAM_DECODER_INIT_STATUS_OK || info.init_stop_decoding) {
+    if (status != FLAC__STREAM_DECODER_INIT_STATUS_OK || info->init_stop_decoding) {
         trace ("flac: FLAC__stream_decoder_init_stream [2] failed\n");
-        goto cflac_insert_fail;
+        goto error;
     }
-    if (!FLAC__stream_decoder_process_until_end_of_metadata (decoder) || info.init_stop_decoding) {
+    if (!FLAC__stream_decoder_process_until_end_of_metadata (decoder) || info->init_stop_decoding) {
         trace ("flac: FLAC__stream_decoder_process_until_end_of_metadata [2] failed\n");
-        goto cflac_insert_fail;
+        goto error;
+    }
+    // blocks which were skipped don't reach the metadata callback, so
+    // take the header size from the position of the first frame instead
+    FLAC__uint64 pos;
+    if (FLAC__stream_decoder_get_decode_position (decoder, &pos)) {
+        info->tagsize = pos;
     }
     FLAC__stream_decoder_delete(decoder);
     decoder = NULL;
 
-    if (info.info.fmt.samplerate <= 0) {
-        goto cflac_insert_fail;
+    if (info->info.fmt.samplerate <= 0) {
+        goto error;
     }
 
-    deadbeef->pl_add_meta (it, ":FILETYPE", isogg ? "OggFLAC" : "FLAC");
+    if (flags & DDB_PROBE_FORMAT) {
+        deadbeef->pl_replace_meta (it, ":FILETYPE", isogg ? "OggFLAC" : "FLAC");
+
+        char s[100];
+        int64_t fsize = deadbeef->fgetlength (info->file);
+        snprintf (s, sizeof (s), "%lld", fsize);
+        deadbeef->pl_replace_meta (it, ":FILE_SIZE", s);
+        snprintf (s, sizeof (s), "%d", info->info.fmt.channels);
+        deadbeef->pl_replace_meta (it, ":CHANNELS", s);
+        snprintf (s, sizeof (s), "%d", info->info.fmt.bps);
+        deadbeef->pl_replace_meta (it, ":BPS", s);
+        snprintf (s, sizeof (s), "%d", info->info.fmt.samplerate);
+        deadbeef->pl_replace_meta (it, ":SAMPLERATE", s);
+        if ( deadbeef->pl_get_item_duration (it) > 0) {
+            snprintf (s, sizeof (s), "%d", (int)roundf((fsize-info->tagsize) / deadbeef->pl_get_item_duration (it) * 8 / 1000));
+            deadbeef->pl_replace_meta (it, ":BITRATE", s);
+        }
+    }
+    return 0;
+error:
+    if (decoder) {
+        FLAC__stream_decoder_delete (decoder);
+    }
+    return -1;
+}
 
-    char s[100];
-    int64_t fsize = deadbeef->fgetlength (info.file);
-    snprintf (s, sizeof (s), "%lld", fsize);
-    deadbeef->pl_add_meta (it, ":FILE_SIZE", s);
-    snprintf (s, sizeof (s), "%d", info.info.fmt.channels);
-    deadbeef->pl_add_meta (it, ":CHANNELS", s);
-    snprintf (s, sizeof (s), "%d", info.info.fmt.bps);
-    deadbeef->pl_add_meta (it, ":BPS", s);
-    snprintf (s, sizeof (s), "%d", info.info.fmt.samplerate);
-    deadbeef->pl_add_meta (it, ":SAMPLERATE", s);
-    if ( deadbeef->pl_get_item_duration (it) > 0) {
-        snprintf (s, sizeof (s), "%d", (int)roundf((fsize-info.tagsize) / deadbeef->pl_get_item_duration (it) * 8 / 1000));
-        deadbeef->pl_add_meta (it, ":BITRATE", s);
+static int
+cflac_probe (DB_playItem_t *it, uint32_t flags) {
+    flac_info_t info;
+    memset (&info, 0, sizeof (info));
+    info.it = it;
+
+    deadbeef->pl_lock ();
+    char fname[strlen (deadbeef->pl_find_meta (it, ":URI")) + 1];
+    strcpy (fname, deadbeef->pl_find_meta (it, ":URI"));
+    deadbeef->pl_unlock ();
+
+    // the format of a subtrack comes from its cuesheet, not from the file
+    if (deadbeef->pl_get_item_flags (it) & DDB_IS_SUBTRACK) {
+        flags &= ~DDB_PROBE_FORMAT;
+    }
+    if (flags & DDB_PROBE_TAGS) {
+        deadbeef->pl_delete_all_meta (it);
+    }
+    info.plt = deadbeef->pl_get_playlist (it);
+    int res = cflac_read_header (&info, fname, flags);
+    if (info.plt) {
+        deadbeef->plt_unref (info.plt);
+    }
+    cflac_free_temp (&info.info);
+    return res;
+}
+
+static DB_playItem_t *
+cflac_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
+    trace ("flac: inserting %s\n", fname);
+    DB_playItem_t *it = NULL;
+    flac_info_t info;
+    memset (&info, 0, sizeof (info));
+    DB_fileinfo_t *_info = &info.info;
+    info.fname = fname;
+    info.after = after;
+    info.last = after;
+    info.plt = plt;
+    it = deadbeef->pl_item_alloc_init (fname, plugin.plugin.id);
+    info.it = it;
+    if (cflac_read_header (&info, fname, DDB_PROBE_FORMAT | DDB_PROBE_TAGS) < 0) {
+        goto cflac_insert_fail;
     }
 
     // try embedded cue
@@ -923,6 +1074,15 @@ error:
     return err;
 }
 
+// internal replaygain keys and the vorbis comments they are stored in
+static const char *rg_tags[] = {
+    ":REPLAYGAIN_ALBUMGAIN", "replaygain_album_gain=",
+    ":REPLAYGAIN_ALBUMPEAK", "replaygain_album_peak=",
+    ":REPLAYGAIN_TRACKGAIN", "replaygain_track_gain=",
+    ":REPLAYGAIN_TRACKPEAK", "replaygain_track_peak=",
+    NULL
+};
+
 int
 cflac_write_metadata (DB_playItem_t *it) {
     int err = -1;
@@ -965,10 +1125,18 @@ cflac_write_metadata (DB_playItem_t *it) {
         for (int i = 0; i < vc_comments; i++) {
             const FLAC__StreamMetadata_VorbisComment_Entry *c = &vc->comments[i];
             if (c->length > 0) {
-                if (strncasecmp (c->entry, "replaygain_album_gain=", 22)
-                && strncasecmp (c->entry, "replaygain_album_peak=", 22)
-                && strncasecmp (c->entry, "replaygain_track_gain=", 22)
-                && strncasecmp (c->entry, "replaygain_track_peak=", 22)) {
+                // keep replaygain comments, unless the item carries a value
+                // of its own (e.g. from the scanner), which is written below
+                int keep = 0;
+                for (int k = 0; rg_tags[k]; k += 2) {
+                    if (!strncasecmp (c->entry, rg_tags[k+1], 22)) {
+                        deadbeef->pl_lock ();
+                        keep = deadbeef->pl_find_meta (it, rg_tags[k]) == NULL;
+                        deadbeef->pl_unlock ();
+                        break;
+                    }
+                }
+                if (!keep) {
                     FLAC__metadata_object_vorbiscomment_delete_comment (data, i);
                     vc_comments--;
                     i--;
@@ -1029,6 +1197,19 @@ cflac_write_metadata (DB_playItem_t *it) {
         m = m->next;
     }
 
+    for (int k = 0; rg_tags[k]; k += 2) {
+        const char *val = deadbeef->pl_find_meta (it, rg_tags[k]);
+        if (val) {
+            char s[100];
+            snprintf (s, sizeof (s), "%s%s", rg_tags[k+1], val);
+            FLAC__StreamMetadata_VorbisComment_Entry ent = {
+                .length = strlen (s),
+                .entry = (FLAC__byte*)s
+            };
+            FLAC__metadata_object_vorbiscomment_append_comment (data, ent, 1);
+        }
+    }
+
     deadbeef->pl_unlock ();
 
 #if 0 // fetching covers is broken, disabling for 0.5.2
@@ -1147,9 +1328,9 @@ static const char *exts[] = { "flac", "oga", NULL };
 // define plugin interface
 static DB_decoder_t plugin = {
     .plugin.api_vmajor = 1,
-    .plugin.api_vminor = 0,
+    .plugin.api_vminor = 7,
     .plugin.version_major = 1,
-    .plugin.version_minor = 0,
+    .plugin.version_minor = 1,
     .plugin.type = DB_PLUGIN_DECODER,
     .plugin.id = "stdflac",
     .plugin.name = "FLAC decoder",
@@ -1197,6 +1378,8 @@ static DB_decoder_t plugin = {
     .read_metadata = cflac_read_metadata,
     .write_metadata = cflac_write_metadata,
     .exts = exts,
+    .read_float = cflac_read_float,
+    .probe = cflac_probe,
 };
 
 DB_plugin_t *
@@ -39,13 +39,19 @@ extern DB_artwork_plugin_t *coverart_plugin;
 GdkPixbuf *pixbuf_default;
 
 #define MAX_ID 256
-#define CACHE_SIZE 20
+// decoded images are kept until their pixel data exceeds this size
+#define CACHE_MAX_BYTES (32*1024*1024)
+#define CACHE_HASH_SIZE 256
+#define MAX_LOADERS 4
 
-typedef struct {
-    struct timeval tm;
+typedef struct cached_pixbuf_s {
     char *fname;
     int width;
     GdkPixbuf *pixbuf;
+    size_t size; // bytes of pixel data, 0 for the shared default image
+    struct cached_pixbuf_s *hnext; // next in hash bucket
+    struct cached_pixbuf_s *prev; // lru list, most recently used first
+    struct cached_pixbuf_s *next;
 } cached_pixbuf_t;
 
 #define MAX_CALLBACKS 200
@@ -63,26 +69,156 @@ typedef struct load_query_s {
     struct load_query_s *next;
 } load_query_t;
 
-static cached_pixbuf_t cache[CACHE_SIZE];
+static cached_pixbuf_t *cache_hash[CACHE_HASH_SIZE];
+static cached_pixbuf_t *cache_first;
+static cached_pixbuf_t *cache_last;
+static size_t cache_bytes;
 static int terminate = 0;
 static uintptr_t mutex;
 static uintptr_t cond;
-static uintptr_t tid;
+static intptr_t tids[MAX_LOADERS];
+static int num_loaders;
 load_query_t *queue;
 load_query_t *tail;
+// queries which are being decoded by the loaders
+static load_query_t *busy;
+
+// all cache_ functions must be called with the mutex locked
+static unsigned
+cache_hash_key (const char *fname, int width) {
+    unsigned h = width;
+    for (const char *p = fname; *p; p++) {
+        h = h * 31 + (unsigned char)*p;
+    }
+    return h % CACHE_HASH_SIZE;
+}
+
+static cached_pixbuf_t *
+cache_find (const char *fname, int width) {
+    cached_pixbuf_t *c;
+    for (c = cache_hash[cache_hash_key (fname, width)]; c; c = c->hnext) {
+        if (c->width == width && !strcmp (c->fname, fname)) {
+            break;
+        }
+    }
+    return c;
+}
+
+static void
+cache_unlink (cached_pixbuf_t *c) {
+    if (c->prev) {
+        c->prev->next = c->next;
+    }
+    else {
+        cache_first = c->next;
+    }
+    if (c->next) {
+        c->next->prev = c->prev;
+    }
+    else {
+        cache_last = c->prev;
+    }
+    c->prev = c->next = NULL;
+}
+
+static void
+cache_touch (cached_pixbuf_t *c) {
+    if (c == cache_first) {
+        return;
+    }
+    cache_unlink (c);
+    c->next = cache_first;
+    if (cache_first) {
+        cache_first->prev = c;
+    }
+    else {
+        cache_last = c;
+    }
+    cache_first = c;
+}
+
+static void
+cache_remove (cached_pixbuf_t *c) {
+    cached_pixbuf_t **pc = &cache_hash[cache_hash_key (c->fname, c->width)];
+    while (*pc != c) {
+        pc = &(*pc)->hnext;
+    }
+    *pc = c->hnext;
+    cache_unlink (c);
+    cache_bytes -= c->size;
+    g_object_unref (c->pixbuf);
+    free (c->fname);
+    free (c);
+}
+
+// takes over the pixbuf reference
+static void
+cache_insert (const char *fname, int width, GdkPixbuf *pixbuf) {
+    cached_pixbuf_t *c = cache_find (fname, width);
+    if (c) {
+        cache_remove (c);
+    }
+    size_t size = 0;
+    if (pixbuf != pixbuf_default) {
+        size = (size_t)gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+    }
+    while (cache_last && cache_bytes + size > CACHE_MAX_BYTES) {
+        trace ("covercache: evicting %s/%d\n", cache_last->fname, cache_last->width);
+        cache_remove (cache_last);
+    }
+    c = calloc (1, sizeof (cached_pixbuf_t));
+    c->fname = strdup (fname);
+    c->width = width;
+    c->pixbuf = pixbuf;
+    c->size = size;
+    unsigned h = cache_hash_key (fname, width);
+    c->hnext = cache_hash[h];
+    cache_hash[h] = c;
+    c->next = cache_first;
+    if (cache_first) {
+        cache_first->prev = c;
+    }
+    else {
+        cache_last = c;
+    }
+    cache_first = c;
+    cache_bytes += size;
+}
+
+static void
+cache_clear (void) {
+    while (cache_first) {
+        cache_remove (cache_first);
+    }
+}
+
+static int
+add_callback (load_query_t *q, void (*callback) (void *user_data), void *user_data) {
+    if (q->numcb < MAX_CALLBACKS && callback) {
+        q->callbacks[q->numcb].cb = callback;
+        q->callbacks[q->numcb].ud = user_data;
+        q->numcb++;
+        return 0;
+    }
+    return -1;
+}
 
 static void
 queue_add (const char *fname, int width, void (*callback) (void *user_data), void *user_data) {
     deadbeef->mutex_lock (mutex);
     load_query_t *q;
     if (fname) {
+        // the same image may be queued, or being decoded already
         for (q = queue; q; q = q->next) {
             if (q->fname && !strcmp (q->fname, fname) && width == q->width) {
-                if (q->numcb < MAX_CALLBACKS && callback) {
-                    q->callbacks[q->numcb].cb = callback;
-                    q->callbacks[q->numcb].ud = user_data;
-                    q->numcb++;
-                }
+                add_callback (q, callback, user_data);
+                deadbeef->mutex_unlock (mutex);
+                return;
+            }
+        }
+        for (q = busy; q; q = q->next) {
+            if (!strcmp (q->fname, fname) && width == q->width) {
+                add_callback (q, callback, user_data);
                 deadbeef->mutex_unlock (mutex);
                 return;
             }
@@ -104,80 +240,59 @@ queue_add (const char *fname, int width, void (*callback) (void *user_data), voi
     else {
         queue = tail = q;
     }
+    deadbeef->cond_broadcast (cond);
     deadbeef->mutex_unlock (mutex);
-    deadbeef->cond_signal (cond);
 }
 
 static void
+query_free (load_query_t *q) {
+    if (q->fname) {
+        free (q->fname);
+    }
+    free (q);
+}
+
+// must be called with the mutex locked;
+// a query without fname is a callback point, which must wait until all
+// queries before it are decoded
+static load_query_t *
 queue_pop (void) {
-    deadbeef->mutex_lock (mutex);
-    load_query_t *next = queue->next;
-    if (queue->fname) {
-        free (queue->fname);
+    if (!queue || (!queue->fname && busy)) {
+        return NULL;
     }
-    free (queue);
-    queue = next;
+    load_query_t *q = queue;
+    queue = q->next;
     if (!queue) {
         tail = NULL;
     }
-    deadbeef->mutex_unlock (mutex);
+    q->next = NULL;
+    return q;
 }
 
-void
+static void
 loading_thread (void *none) {
 #ifdef __linux__
     prctl (PR_SET_NAME, "deadbeef-gtkui-artwork", 0, 0, 0, 0);
 #endif
+    deadbeef->mutex_lock (mutex);
     for (;;) {
-        trace ("covercache: waiting for signal\n");
-        deadbeef->cond_wait (cond, mutex);
-        trace ("covercache: signal received (terminate=%d, queue=%p)\n", terminate, queue);
-        deadbeef->mutex_unlock (mutex);
-        while (!terminate && queue) {
-            int cache_min = 0;
-            deadbeef->mutex_lock (mutex);
-            for (int i = 0; i < CACHE_SIZE; i++) {
-                if (!cache[i].pixbuf) {
-                    cache_min = i;
-                    break;
-                }
-                if (cache[cache_min].pixbuf && cache[i].pixbuf) {
-                    if (cache[cache_min].tm.tv_sec > cache[i].tm.tv_sec) {
-                        cache_min = i;
-                    }
-                }
-            }
-            if (cache_min != -1) {
-                if (cache[cache_min].pixbuf) {
-                    g_object_unref (cache[cache_min].pixbuf);
-                    cache[cache_min].pixbuf = NULL;
-                }
-                if (cache[cache_min].fname) {
-                    free (cache[cache_min].fname);
-                    cache[cache_min].fname = NULL;
-                }
-            }
+        load_query_t *q = NULL;
+        while (!terminate && !(q = queue_pop ())) {
+            trace ("covercache: waiting for signal\n");
+            deadbeef->cond_wait_locked (cond, mutex);
+        }
+        if (terminate) {
+            break;
+        }
+        if (q->fname) {
+            q->next = busy;
+            busy = q;
             deadbeef->mutex_unlock (mutex);
-            if (!queue->fname) {
-                for (int i = 0; i < queue->numcb; i++) {
-                    if (queue->callbacks[i].cb) {
-                        queue->callbacks[i].cb (queue->callbacks[i].ud);
-                    }
-                }
-                queue_pop ();
-                continue;
-            }
 
-            if (cache_min == -1) {
-                trace ("coverart pixbuf cache overflow, waiting...\n");
-                usleep (500000);
-                continue;
-            }
-            GdkPixbuf *pixbuf = NULL;
             GError *error = NULL;
-            pixbuf = gdk_pixbuf_new_from_file_at_scale (queue->fname, queue->width, queue->width, TRUE, &error);
+            GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_scale (q->fname, q->width, q->width, TRUE, &error);
             if (error) {
-                //fprintf (stderr, "gdk_pixbuf_new_from_file_at_scale %s %d failed, error: %s\n", queue->fname, queue->width, error ? error->message : "n/a");
+                //fprintf (stderr, "gdk_pixbuf_new_from_file_at_scale %s %d failed, error: %s\n", q->fname, q->width, error ? error->message : "n/a");
                 g_error_free (error);
                 error = NULL;
             }
@@ -185,26 +300,28 @@ loading_thread (void *none) {
                 pixbuf = pixbuf_default;
                 g_object_ref (pixbuf);
             }
-            if (cache_min != -1) {
-                deadbeef->mutex_lock (mutex);
-                cache[cache_min].pixbuf = pixbuf;
-                cache[cache_min].fname = strdup (queue->fname);
-                gettimeofday (&cache[cache_min].tm, NULL);
-                cache[cache_min].width = queue->width;
-                deadbeef->mutex_unlock (mutex);
-            }
 
-            for (int i = 0; i < queue->numcb; i++) {
-                if (queue->callbacks[i].cb) {
-                    queue->callbacks[i].cb (queue->callbacks[i].ud);
-                }
+            deadbeef->mutex_lock (mutex);
+            cache_insert (q->fname, q->width, pixbuf);
+            load_query_t **pq = &busy;
+            while (*pq != q) {
+                pq = &(*pq)->next;
             }
-            queue_pop ();
+            *pq = q->next;
+            // a callback point may be waiting for this one
+            deadbeef->cond_broadcast (cond);
         }
-        if (terminate) {
-            break;
+        deadbeef->mutex_unlock (mutex);
+
+        for (int i = 0; i < q->numcb; i++) {
+            if (q->callbacks[i].cb) {
+                q->callbacks[i].cb (q->callbacks[i].ud);
+            }
         }
+        query_free (q);
+        deadbeef->mutex_lock (mutex);
     }
+    deadbeef->mutex_unlock (mutex);
 }
 
 typedef struct {
@@ -224,35 +341,28 @@ cover_avail_callback (const char *fname, const char *artist, const char *album,
     // load it into main memory
     GdkPixbuf *pb = get_cover_art_callb (fname, artist, album, dt->width, dt->callback, dt->user_data);
     if (pb) {
+        // it's already decoded, but whoever asked has drawn a placeholder
         g_object_unref (pb);
+        if (dt->callback) {
+            dt->callback (dt->user_data);
+        }
     }
     free (dt);
 }
 
 static GdkPixbuf *
 get_pixbuf (const char *fname, int width, void (*callback)(void *user_data), void *user_data) {
-    int requested_width = width;
     // find in cache
     deadbeef->mutex_lock (mutex);
-    for (int i = 0; i < CACHE_SIZE; i++) {
-        if (cache[i].pixbuf) {
-            if (!strcmp (fname, cache[i].fname) && cache[i].width == width) {
-                gettimeofday (&cache[i].tm, NULL);
-                GdkPixbuf *pb = cache[i].pixbuf;
-                g_object_ref (pb);
-                deadbeef->mutex_unlock (mutex);
-                return pb;
-            }
-        }
-    }
-#if 0
-    printf ("cache miss: %s/%d\n", fname, width);
-    for (int i = 0; i < CACHE_SIZE; i++) {
-        if (cache[i].pixbuf) {
-            printf ("    cache line %d: %s/%d\n", i, cache[i].fname, cache[i].width);
-        }
+    cached_pixbuf_t *c = cache_find (fname, width);
+    if (c) {
+        cache_touch (c);
+        GdkPixbuf *pb = c->pixbuf;
+        g_object_ref (pb);
+        deadbeef->mutex_unlock (mutex);
+        return pb;
     }
-#endif
+    trace ("cache miss: %s/%d\n", fname, width);
     deadbeef->mutex_unlock (mutex);
     queue_add (fname, width, callback, user_data);
     return NULL;
@@ -274,22 +384,15 @@ get_cover_art_callb (const char *fname, const char *artist, const char *album, i
         char path[2048];
         coverart_plugin->make_cache_path2 (path, sizeof (path), fname, album, artist, -1);
         deadbeef->mutex_lock (mutex);
-        int i_largest = -1;
-        int size_largest = -1;
-        for (int i = 0; i < CACHE_SIZE; i++) {
-            if (!cache[i].pixbuf) {
-                continue;
-            }
-            if (!strcmp (cache[i].fname, path)) {
-                gettimeofday (&cache[i].tm, NULL);
-                if (cache[i].width > size_largest) {
-                    size_largest = cache[i].width;
-                    i_largest = i;
-                }
+        cached_pixbuf_t *largest = NULL;
+        for (cached_pixbuf_t *c = cache_first; c; c = c->next) {
+            if (!strcmp (c->fname, path) && (!largest || c->width > largest->width)) {
+                largest = c;
             }
         }
-        if (i_largest != -1) {
-            GdkPixbuf *pb = cache[i_largest].pixbuf;
+        if (largest) {
+            cache_touch (largest);
+            GdkPixbuf *pb = largest->pixbuf;
             g_object_ref (pb);
             deadbeef->mutex_unlock (mutex);
             return pb;
@@ -314,19 +417,13 @@ get_cover_art_callb (const char *fname, const char *artist, const char *album, i
 void
 coverart_reset_queue (void) {
     deadbeef->mutex_lock (mutex);
-    if (queue) {
-        load_query_t *q = queue->next;
-        while (q) {
-            load_query_t *next = q->next;
-            if (q->fname) {
-                free (q->fname);
-            }
-            free (q);
-            q = next;
-        }
-        queue->next = NULL;
-        tail = queue;
+    // queries which are being decoded are not in the queue
+    while (queue) {
+        load_query_t *next = queue->next;
+        query_free (queue);
+        queue = next;
     }
+    tail = NULL;
     deadbeef->mutex_unlock (mutex);
     if (coverart_plugin) {
         coverart_plugin->reset (1);
@@ -338,7 +435,18 @@ cover_art_init (void) {
     terminate = 0;
     mutex = deadbeef->mutex_create_nonrecursive ();
     cond = deadbeef->cond_create ();
-    tid = deadbeef->thread_start_low_priority (loading_thread, NULL);
+    // decoding is cpu bound, but don't take all cores from the player
+    long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+    int n = ncpu > 1 ? ncpu - 1 : 1;
+    if (n > MAX_LOADERS) {
+        n = MAX_LOADERS;
+    }
+    for (num_loaders = 0; num_loaders < n; num_loaders++) {
+        tids[num_loaders] = deadbeef->thread_start_low_priority (loading_thread, NULL);
+        if (!tids[num_loaders]) {
+            break;
+        }
+    }
 }
 
 void
@@ -350,22 +458,25 @@ cover_art_free (void) {
         coverart_plugin->reset (0);
     }
     
-    if (tid) {
+    if (num_loaders) {
+        trace ("sending terminate signal to art loader threads...\n");
+        deadbeef->mutex_lock (mutex);
         terminate = 1;
-        trace ("sending terminate signal to art loader thread...\n");
-        deadbeef->cond_signal (cond);
-        deadbeef->thread_join (tid);
-        tid = 0;
+        deadbeef->cond_broadcast (cond);
+        deadbeef->mutex_unlock (mutex);
+        for (int i = 0; i < num_loaders; i++) {
+            deadbeef->thread_join (tids[i]);
+            tids[i] = 0;
+        }
+        num_loaders = 0;
     }
     while (queue) {
-        queue_pop ();
-    }
-    for (int i = 0; i < CACHE_SIZE; i++) {
-        if (cache[i].pixbuf) {
-            g_object_unref (cache[i].pixbuf);
-        }
+        load_query_t *next = queue->next;
+        query_free (queue);
+        queue = next;
     }
-    memset (cache, 0, sizeof (cache));
+    tail = NULL;
+    cache_clear ();
     if (pixbuf_default) {
         g_object_unref (pixbuf_default);
         pixbuf_default = NULL;
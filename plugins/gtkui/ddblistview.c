@@ -82,6 +82,16 @@ ddb_listview_build_groups (DdbListview *listview);
 // fwd decls
 void
 ddb_listview_free_groups (DdbListview *listview);
+static void
+ddb_listview_update_groups (DdbListview *listview);
+static void
+ddb_listview_layout_groups (DdbListview *listview, int first);
+static int
+ddb_listview_find_group_by_row (DdbListview *listview, int row);
+static int
+ddb_listview_find_group_by_y (DdbListview *listview, int y);
+static void
+ddb_listview_resize_groups (DdbListview *listview);
 
 //static inline void
 //draw_drawable (GdkDrawable *window, GdkGC *gc, GdkDrawable *drawable, int x1, int y1, int x2, int y2, int w, int h);
@@ -90,9 +100,9 @@ ddb_listview_free_groups (DdbListview *listview);
 void
 ddb_listview_list_render (DdbListview *ps, cairo_t *cr, int x, int y, int w, int h);
 void
-ddb_listview_list_render_row_background (DdbListview *ps, cairo_t *cr, DdbListviewIter it, int even, int cursor, int x, int y, int w, int h);
+ddb_listview_list_render_row_background (DdbListview *ps, cairo_t *cr, DdbListviewIter it, int sel, int even, int cursor, int x, int y, int w, int h);
 void
-ddb_listview_list_render_row_foreground (DdbListview *ps, cairo_t *cr, DdbListviewIter it, DdbListviewIter group_it, int even, int cursor, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int w, int h);
+ddb_listview_list_render_row_foreground (DdbListview *ps, cairo_t *cr, DdbListviewIter it, DdbListviewIter group_it, int sel, char **text, int even, int cursor, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int w, int h);
 void
 ddb_listview_list_track_dragdrop (DdbListview *ps, int y);
 int
@@ -319,6 +329,10 @@ ddb_listview_init(DdbListview *listview)
     listview->columns = NULL;
     listview->lock_columns = 1;
     listview->groups = NULL;
+    listview->groups_count = 0;
+    listview->groups_alloc = 0;
+    listview->group_items = NULL;
+    listview->group_items_count = 0;
 
     listview->block_redraw_on_scroll = 0;
     listview->calculated_grouptitle_height = DEFAULT_GROUP_TITLE_HEIGHT;
@@ -332,6 +346,10 @@ ddb_listview_init(DdbListview *listview)
     listview->cover_size = -1;
     listview->new_cover_size = -1;
     listview->cover_refresh_timeout_id = 0;
+    listview->cover_pending_count = 0;
+    listview->cover_prefetch_id = 0;
+    listview->cover_prefetch_y = -1;
+    listview->vscroll_dir = 1;
 
     GtkWidget *hbox;
     GtkWidget *vbox;
@@ -494,6 +512,11 @@ ddb_listview_destroy(GObject *object)
 
   listview = DDB_LISTVIEW(object);
 
+  if (listview->cover_prefetch_id) {
+      g_source_remove (listview->cover_prefetch_id);
+      listview->cover_prefetch_id = 0;
+  }
+
   ddb_listview_free_groups (listview);
 
   while (listview->columns) {
@@ -598,7 +621,7 @@ void
 ddb_listview_groupcheck (DdbListview *listview) {
     int idx = listview->binding->modification_idx ();
     if (idx != listview->groups_build_idx) {
-        ddb_listview_build_groups (listview);
+        ddb_listview_update_groups (listview);
     }
 }
 
@@ -627,20 +650,14 @@ ddb_listview_is_album_art_column (DdbListview *listview, int x)
 // returns Y coordinate of an item by its index
 int
 ddb_listview_get_row_pos (DdbListview *listview, int row_idx) {
-    int y = 0;
-    int idx = 0;
     deadbeef->pl_lock ();
     ddb_listview_groupcheck (listview);
-    DdbListviewGroup *grp = listview->groups;
-    while (grp) {
-        if (idx + grp->num_items > row_idx) {
-            int i = y + listview->grouptitle_height + (row_idx - idx) * listview->rowheight;
-            deadbeef->pl_unlock ();
-            return i;
+    int y = listview->fullheight;
+    if (listview->groups_count > 0) {
+        DdbListviewGroup *grp = &listview->groups[ddb_listview_find_group_by_row (listview, row_idx)];
+        if (grp->idx + grp->num_items > row_idx) {
+            y = grp->y + listview->grouptitle_height + (row_idx - grp->idx) * listview->rowheight;
         }
-        y += grp->height;
-        idx += grp->num_items;
-        grp = grp->next;
     }
     deadbeef->pl_unlock ();
     return y;
@@ -651,17 +668,16 @@ ddb_listview_get_row_pos (DdbListview *listview, int row_idx) {
 // item idx may be set to -1 if group title was hit
 static int
 ddb_listview_list_pickpoint_y (DdbListview *listview, int y, DdbListviewGroup **group, int *group_idx, int *global_idx) {
-    int idx = 0;
-    int grp_y = 0;
-    int gidx = 0;
     deadbeef->pl_lock ();
     ddb_listview_groupcheck (listview);
-    DdbListviewGroup *grp = listview->groups;
-    while (grp) {
-        int h = grp->height;
-        if (y >= grp_y && y < grp_y + h) {
+    // the first group which ends below y
+    int i = y >= 0 ? ddb_listview_find_group_by_y (listview, y + 1) : listview->groups_count;
+    if (i < listview->groups_count) {
+        DdbListviewGroup *grp = &listview->groups[i];
+        int idx = grp->idx;
+        if (y >= grp->y) {
             *group = grp;
-            y -= grp_y;
+            y -= grp->y;
             if (y < listview->grouptitle_height) {
                 *group_idx = -1;
                 *global_idx = idx;
@@ -677,10 +693,6 @@ ddb_listview_list_pickpoint_y (DdbListview *listview, int y, DdbListviewGroup **
             deadbeef->pl_unlock ();
             return 0;
         }
-        grp_y += grp->height;
-        idx += grp->num_items;
-        grp = grp->next;
-        gidx++;
     }
     deadbeef->pl_unlock ();
     return -1;
@@ -688,41 +700,99 @@ ddb_listview_list_pickpoint_y (DdbListview *listview, int y, DdbListviewGroup **
 
 int render_idx = 0;
 
-void
-ddb_listview_list_render (DdbListview *listview, cairo_t *cr, int x, int y, int w, int h) {
-    render_idx = 0;
-    cairo_set_line_width (cr, 1);
-    cairo_set_antialias (cr, CAIRO_ANTIALIAS_NONE);
-    GtkWidget *treeview = theme_treeview;
+// a visible row, captured under pl_lock, so that it can be drawn without it
+typedef struct {
+    DdbListviewIter it; // referenced
+    int selected;
+    int cursor;
+    int text; // index of the 1st column text in the snapshot
+} DdbListviewRowSnapshot;
+
+typedef struct {
+    DdbListviewGroup grp; // copy of the group, with the head referenced
+    int idx; // row index including group titles, for even/odd
+    int first_row; // index of the 1st visible row in the group
+    int row; // index of its snapshot
+    int nrows;
+} DdbListviewGroupSnapshot;
+
+typedef struct {
+    DdbListviewGroupSnapshot *groups;
+    int ngroups;
+    DdbListviewRowSnapshot *rows;
+    int nrows;
+    char **text; // formatted column text of each row, NULL if not textual
+    int ntext;
+    int ncolumns;
+    int end_y; // bottom of the last visible group
+} DdbListviewSnapshot;
+
+static void *
+ddb_listview_snapshot_append (void *arr, int *count, int size) {
+    // starts with 16, then doubles when full
+    if (!*count || (*count >= 16 && !(*count & (*count - 1)))) {
+        void *n = realloc (arr, (*count ? *count * 2 : 16) * size);
+        if (!n) {
+            return NULL;
+        }
+        arr = n;
+    }
+    (*count)++;
+    return arr;
+}
 
-#if !GTK_CHECK_VERSION(3,0,0)
-// FIXME?
-    if (gtk_widget_get_style (treeview)->depth == -1) {
-        return; // drawing was called too early
+static void
+ddb_listview_snapshot_free (DdbListview *listview, DdbListviewSnapshot *s) {
+    for (int i = 0; i < s->ngroups; i++) {
+        listview->binding->unref (s->groups[i].grp.head);
     }
-#endif
-    int idx = 0;
-    int abs_idx = 0;
+    for (int i = 0; i < s->nrows; i++) {
+        listview->binding->unref (s->rows[i].it);
+    }
+    for (int i = 0; i < s->ntext; i++) {
+        if (s->text[i]) {
+            free (s->text[i]);
+        }
+    }
+    free (s->groups);
+    free (s->rows);
+    free (s->text);
+}
+
+// captures groups, rows and column text which intersect [y, y+h) of the
+// list window, and updates pinned state of the groups
+static void
+ddb_listview_snapshot_build (DdbListview *listview, DdbListviewSnapshot *s, int y, int h) {
+    memset (s, 0, sizeof (DdbListviewSnapshot));
+    s->ncolumns = ddb_listview_column_get_count (listview);
+    int top = y + listview->scrollpos;
+    int bottom = y + h + listview->scrollpos;
+
     deadbeef->pl_lock ();
     ddb_listview_groupcheck (listview);
+    int cursor = listview->binding->cursor ();
     // find 1st group
-    DdbListviewGroup *grp = listview->groups;
+    DdbListviewGroup *grp = NULL;
     int grp_y = 0;
-    int grp_next_y = 0;
+    int idx = 0;
     DdbListviewGroup *pinned_grp = NULL;
 
-    while (grp && grp_y + grp->height < y + listview->scrollpos) {
-        if (grp_y < listview->scrollpos && grp_y + grp->height >= listview->scrollpos) {
-            pinned_grp = grp;
-            grp->pinned = 1;
+    int first = ddb_listview_find_group_by_y (listview, top);
+    if (first < listview->groups_count) {
+        grp = &listview->groups[first];
+        grp_y = grp->y;
+        idx = grp->idx + first;
+        // the group at the top of the view, if it's above the redrawn area
+        int pin = ddb_listview_find_group_by_y (listview, listview->scrollpos);
+        if (pin < first && listview->groups[pin].y < listview->scrollpos) {
+            pinned_grp = &listview->groups[pin];
+            pinned_grp->pinned = 1;
         }
-        grp_y += grp->height;
-        idx += grp->num_items + 1;
-        abs_idx += grp->num_items;
-        grp = grp->next;
     }
-
-    draw_begin (&listview->listctx, cr);
+    else if (listview->groups_count > 0) {
+        DdbListviewGroup *last = &listview->groups[listview->groups_count-1];
+        grp_y = last->y + last->height;
+    }
 
     if (grp && !pinned_grp && grp_y < listview->scrollpos) {
         grp->pinned = 1;
@@ -732,61 +802,152 @@ ddb_listview_list_render (DdbListview *listview, cairo_t *cr, int x, int y, int
         grp->pinned = 2;
     }
 
-    int ii = 0;
-    while (grp && grp_y < y + h + listview->scrollpos) {
+    while (grp && grp_y < bottom) {
+        DdbListviewGroupSnapshot *groups = ddb_listview_snapshot_append (s->groups, &s->ngroups, sizeof (DdbListviewGroupSnapshot));
+        if (!groups) {
+            break;
+        }
+        s->groups = groups;
+        DdbListviewGroupSnapshot *gs = &s->groups[s->ngroups-1];
+        memcpy (&gs->grp, grp, sizeof (DdbListviewGroup));
+        gs->grp.next = NULL;
+        listview->binding->ref (gs->grp.head);
+        gs->idx = idx;
+        gs->first_row = 0;
+        gs->row = s->nrows;
+        gs->nrows = 0;
+
+        DdbListviewIter it = grp->head;
+        listview->binding->ref (it);
+        for (int i = 0; i < grp->num_items && it; i++) {
+            int row_y = grp_y + listview->grouptitle_height + i * listview->rowheight;
+            if (row_y >= bottom) {
+                break;
+            }
+            if (row_y + listview->rowheight >= top) {
+                DdbListviewRowSnapshot *rows = ddb_listview_snapshot_append (s->rows, &s->nrows, sizeof (DdbListviewRowSnapshot));
+                if (!rows) {
+                    break;
+                }
+                s->rows = rows;
+                DdbListviewRowSnapshot *row = &s->rows[s->nrows-1];
+                if (!gs->nrows) {
+                    gs->first_row = i;
+                }
+                gs->nrows++;
+                row->it = it;
+                listview->binding->ref (it);
+                row->selected = listview->binding->is_selected (it);
+                row->cursor = grp->idx + i == cursor;
+                row->text = s->ntext;
+                for (int c = 0; c < s->ncolumns; c++) {
+                    char **text = ddb_listview_snapshot_append (s->text, &s->ntext, sizeof (char *));
+                    if (!text) {
+                        break;
+                    }
+                    s->text = text;
+                    char str[1024];
+                    if (listview->binding->get_column_text && !listview->binding->get_column_text (listview, it, c, str, sizeof (str))) {
+                        s->text[s->ntext-1] = strdup (str);
+                    }
+                    else {
+                        s->text[s->ntext-1] = NULL;
+                    }
+                }
+                if (s->ntext != row->text + s->ncolumns) {
+                    // out of memory, draw the row without text
+                    while (s->ntext > row->text) {
+                        free (s->text[--s->ntext]);
+                    }
+                    row->text = -1;
+                }
+            }
+            DdbListviewIter next = listview->binding->next (it);
+            listview->binding->unref (it);
+            it = next;
+        }
+        if (it) {
+            listview->binding->unref (it);
+        }
+
+        idx += grp->num_items + 1;
+        grp_y += grp->height;
+        if (grp->pinned == 1) {
+            grp = grp->next;
+            if (grp) {
+                grp->pinned = 2;
+            }
+        }
+        else {
+            grp = grp->next;
+            if (grp) {
+                grp->pinned = 0;
+            }
+        }
+    }
+    s->end_y = grp_y;
+    deadbeef->pl_unlock ();
+}
+
+// draws the list from a snapshot, without pl_lock; the callbacks only get
+// referenced items
+void
+ddb_listview_list_render (DdbListview *listview, cairo_t *cr, int x, int y, int w, int h) {
+    render_idx = 0;
+    cairo_set_line_width (cr, 1);
+    cairo_set_antialias (cr, CAIRO_ANTIALIAS_NONE);
+    GtkWidget *treeview = theme_treeview;
+
+#if !GTK_CHECK_VERSION(3,0,0)
+// FIXME?
+    if (gtk_widget_get_style (treeview)->depth == -1) {
+        return; // drawing was called too early
+    }
+#endif
+    DdbListviewSnapshot snapshot;
+    ddb_listview_snapshot_build (listview, &snapshot, y, h);
+
+    draw_begin (&listview->listctx, cr);
+
+    int grp_next_y = 0;
+    for (int g = 0; g < snapshot.ngroups; g++) {
+        DdbListviewGroupSnapshot *gs = &snapshot.groups[g];
+        DdbListviewGroup *grp = &gs->grp;
         // render title
         DdbListviewIter it = grp->head;
+        int grp_y = grp->y;
         int grpheight = grp->height;
         int pushback = 0;
-        int group_idx = idx;
+        int idx = gs->idx;
 
-        if (grp_y >= y + h + listview->scrollpos) {
-            break;
-        }
-        listview->binding->ref (it);
         if (grp_y + listview->grouptitle_height >= y + listview->scrollpos && grp_y < y + h + listview->scrollpos) {
-            ddb_listview_list_render_row_background (listview, cr, NULL, idx & 1, 0, -listview->hscrollpos, grp_y - listview->scrollpos, listview->totalwidth, listview->grouptitle_height);
+            ddb_listview_list_render_row_background (listview, cr, NULL, 0, idx & 1, 0, -listview->hscrollpos, grp_y - listview->scrollpos, listview->totalwidth, listview->grouptitle_height);
             if (listview->binding->draw_group_title && listview->grouptitle_height > 0) {
                 listview->binding->draw_group_title (listview, cr, it, -listview->hscrollpos, grp_y - listview->scrollpos, listview->totalwidth, listview->grouptitle_height);
             }
         }
 
-        for (int i = 0; i < grp->num_items; i++) {
-            ii++;
-            if (grp_y + listview->grouptitle_height + i * listview->rowheight >= y + h + listview->scrollpos) {
-                break;
-            }
-            grp_next_y = grp_y + grpheight;
-            if (grp->pinned == 1 && gtkui_groups_pinned && grp_next_y - listview->scrollpos <= listview->grouptitle_height) {
-                pushback = listview->grouptitle_height - (grp_next_y - listview->scrollpos);
-            }
-            if (grp_y + listview->grouptitle_height + (i+1) * listview->rowheight >= y + listview->scrollpos
-                    && grp_y + listview->grouptitle_height + i * listview->rowheight < y + h + listview->scrollpos) {
-                GtkStyle *st = gtk_widget_get_style (listview->list);
-                gdk_cairo_set_source_color (cr, &st->bg[GTK_STATE_NORMAL]);
-                cairo_rectangle (cr, -listview->hscrollpos, grp_y + listview->grouptitle_height + i * listview->rowheight - listview->scrollpos, listview->totalwidth, listview->rowheight);
-                cairo_fill (cr);
-                ddb_listview_list_render_row_background (listview, cr, it, (idx + 1 + i) & 1, (abs_idx+i) == listview->binding->cursor () ? 1 : 0, -listview->hscrollpos, grp_y + listview->grouptitle_height + i * listview->rowheight - listview->scrollpos, listview->totalwidth, listview->rowheight);
-                ddb_listview_list_render_row_foreground (listview, cr, it, grp->head, (idx + 1 + i) & 1, (idx+i) == listview->binding->cursor () ? 1 : 0, i * listview->rowheight, grp->height, grp->pinned, grp_next_y - listview->scrollpos, -listview->hscrollpos, grp_y + listview->grouptitle_height + i * listview->rowheight - listview->scrollpos, listview->totalwidth, listview->rowheight);
-            }
-            DdbListviewIter next = listview->binding->next (it);
-            listview->binding->unref (it);
-            it = next;
-            if (!it) {
-                break; // sanity check, in case groups were not rebuilt yet
-            }
+        grp_next_y = grp_y + grpheight;
+        if (grp->pinned == 1 && gtkui_groups_pinned && grp_next_y - listview->scrollpos <= listview->grouptitle_height) {
+            pushback = listview->grouptitle_height - (grp_next_y - listview->scrollpos);
+        }
+        for (int r = 0; r < gs->nrows; r++) {
+            DdbListviewRowSnapshot *row = &snapshot.rows[gs->row + r];
+            int i = gs->first_row + r;
+            GtkStyle *st = gtk_widget_get_style (listview->list);
+            gdk_cairo_set_source_color (cr, &st->bg[GTK_STATE_NORMAL]);
+            cairo_rectangle (cr, -listview->hscrollpos, grp_y + listview->grouptitle_height + i * listview->rowheight - listview->scrollpos, listview->totalwidth, listview->rowheight);
+            cairo_fill (cr);
+            ddb_listview_list_render_row_background (listview, cr, row->it, row->selected, (idx + 1 + i) & 1, row->cursor, -listview->hscrollpos, grp_y + listview->grouptitle_height + i * listview->rowheight - listview->scrollpos, listview->totalwidth, listview->rowheight);
+            ddb_listview_list_render_row_foreground (listview, cr, row->it, grp->head, row->selected, row->text >= 0 ? &snapshot.text[row->text] : NULL, (idx + 1 + i) & 1, row->cursor, i * listview->rowheight, grp->height, grp->pinned, grp_next_y - listview->scrollpos, -listview->hscrollpos, grp_y + listview->grouptitle_height + i * listview->rowheight - listview->scrollpos, listview->totalwidth, listview->rowheight);
         }
         if (grp->pinned == 1 && gtkui_groups_pinned && y <= 0) {
-            ddb_listview_list_render_row_background (listview, cr, NULL, group_idx & 1, 0, -listview->hscrollpos, y, listview->totalwidth, listview->grouptitle_height);
+            ddb_listview_list_render_row_background (listview, cr, NULL, 0, idx & 1, 0, -listview->hscrollpos, y, listview->totalwidth, listview->grouptitle_height);
             if (listview->binding->draw_group_title && listview->grouptitle_height > 0) {
                 listview->binding->draw_group_title (listview, cr, grp->head, -listview->hscrollpos, y - pushback, listview->totalwidth, listview->grouptitle_height);
             }
         }
 
-        idx += grp->num_items + 1;
-        abs_idx += grp->num_items;
-
-        DdbListviewIter prev = listview->binding->prev (it);
         int filler = grpheight - (listview->grouptitle_height + listview->rowheight * grp->num_items);
         if (filler > 0) {
             int theming = !gtkui_override_listview_colors ();
@@ -804,34 +965,17 @@ ddb_listview_list_render (DdbListview *listview, cairo_t *cr, int x, int y, int
                 cairo_rectangle (cr, x, grp_y - listview->scrollpos + listview->grouptitle_height + listview->rowheight * grp->num_items, w, filler);
                 cairo_fill (cr);
             }
-            ddb_listview_list_render_row_foreground (listview, cr, NULL, grp->head, 0, 0, grp->num_items * listview->rowheight, grp->height, grp->pinned, grp_next_y - listview->scrollpos, -listview->hscrollpos, grp_y - listview->scrollpos + listview->grouptitle_height + listview->rowheight * grp->num_items, listview->totalwidth, filler);
+            ddb_listview_list_render_row_foreground (listview, cr, NULL, grp->head, 0, NULL, 0, 0, grp->num_items * listview->rowheight, grp->height, grp->pinned, grp_next_y - listview->scrollpos, -listview->hscrollpos, grp_y - listview->scrollpos + listview->grouptitle_height + listview->rowheight * grp->num_items, listview->totalwidth, filler);
             if (grp->pinned == 1 && gtkui_groups_pinned && y <= 0) {
-                ddb_listview_list_render_row_background (listview, cr, NULL, group_idx & 1, 0, -listview->hscrollpos, y, listview->totalwidth, listview->grouptitle_height);
+                ddb_listview_list_render_row_background (listview, cr, NULL, 0, idx & 1, 0, -listview->hscrollpos, y, listview->totalwidth, listview->grouptitle_height);
                 if (listview->binding->draw_group_title && listview->grouptitle_height > 0) {
-                    listview->binding->draw_group_title (listview, cr, prev, -listview->hscrollpos, y - pushback, listview->totalwidth, listview->grouptitle_height);
+                    // any item of the group gives the same title
+                    listview->binding->draw_group_title (listview, cr, grp->head, -listview->hscrollpos, y - pushback, listview->totalwidth, listview->grouptitle_height);
                 }
             }
         }
-        if (prev) {
-            listview->binding->unref (prev);
-        }
-        if (it) {
-            listview->binding->unref (it);
-        }
-        grp_y += grpheight;
-        if (grp->pinned == 1) {
-            grp = grp->next;
-            if (grp) {
-                grp->pinned = 2;
-            }
-        }
-        else {
-            grp = grp->next;
-            if (grp) {
-                grp->pinned = 0;
-            }
-        }
     }
+    int grp_y = snapshot.end_y;
     if (grp_y < y + h + listview->scrollpos) {
         int hh = y + h - (grp_y - listview->scrollpos);
 //        gdk_draw_rectangle (listview->list->window, listview->list->style->bg_gc[GTK_STATE_NORMAL], TRUE, x, grp_y - listview->scrollpos, w, hh);
@@ -851,7 +995,7 @@ ddb_listview_list_render (DdbListview *listview, cairo_t *cr, int x, int y, int
             cairo_fill (cr);
         }
     }
-    deadbeef->pl_unlock ();
+    ddb_listview_snapshot_free (listview, &snapshot);
     draw_end (&listview->listctx);
 }
 
@@ -961,6 +1105,9 @@ ddb_listview_vscroll_value_changed            (GtkRange        *widget,
     if (ps->binding->vscroll_changed) {
         ps->binding->vscroll_changed (newscroll);
     }
+    if (newscroll != ps->scrollpos) {
+        ps->vscroll_dir = newscroll > ps->scrollpos ? 1 : -1;
+    }
     if (ps->block_redraw_on_scroll) {
         ps->scrollpos = newscroll; 
         return;
@@ -1247,30 +1394,23 @@ int
 ddb_listview_list_get_drawinfo (DdbListview *listview, int row, DdbListviewGroup **pgrp, int *even, int *cursor, int *group_y, int *x, int *y, int *w, int *h) {
     deadbeef->pl_lock ();
     ddb_listview_groupcheck (listview);
-    DdbListviewGroup *grp = listview->groups;
-    int idx = 0;
-    int idx2 = 0;
-    *y = -listview->scrollpos;
-    while (grp) {
-        int grpheight = grp->height;
-        if (idx <= row && idx + grp->num_items > row) {
-            // found
-            int idx_in_group = row - idx;
+    if (row >= 0 && listview->groups_count > 0) {
+        int i = ddb_listview_find_group_by_row (listview, row);
+        DdbListviewGroup *grp = &listview->groups[i];
+        if (grp->idx + grp->num_items > row) {
+            int idx_in_group = row - grp->idx;
             *pgrp = grp;
-            *even = (idx2 + 1 + idx_in_group) & 1;
+            // each group title takes a row in the even/odd sequence
+            *even = (grp->idx + i + 1 + idx_in_group) & 1;
             *cursor = (row == listview->binding->cursor ()) ? 1 : 0;
             *group_y = idx_in_group * listview->rowheight;
             *x = -listview->hscrollpos;
-            *y += listview->grouptitle_height + (row - idx) * listview->rowheight;
+            *y = grp->y - listview->scrollpos + listview->grouptitle_height + idx_in_group * listview->rowheight;
             *w = listview->totalwidth;
             *h = listview->rowheight;
             deadbeef->pl_unlock ();
             return 0;
         }
-        *y += grpheight;
-        idx += grp->num_items;
-        idx2 += grp->num_items + 1;
-        grp = grp->next;
     }
     deadbeef->pl_unlock ();
     return -1;
@@ -1302,7 +1442,7 @@ ddb_listview_draw_row (DdbListview *listview, int row, DdbListviewIter it) {
 
 // coords passed are window-relative
 void
-ddb_listview_list_render_row_background (DdbListview *ps, cairo_t *cr, DdbListviewIter it, int even, int cursor, int x, int y, int w, int h) {
+ddb_listview_list_render_row_background (DdbListview *ps, cairo_t *cr, DdbListviewIter it, int sel, int even, int cursor, int x, int y, int w, int h) {
 	// draw background
 	GtkWidget *treeview = theme_treeview;
 	int theming = !gtkui_override_listview_colors ();
@@ -1314,7 +1454,7 @@ ddb_listview_list_render_row_background (DdbListview *ps, cairo_t *cr, DdbListvi
         }
 #endif
     }
-    int sel = it && ps->binding->is_selected (it);
+    sel = it && sel;
     if (theming || !sel) {
         if (theming) {
             // draw background for selection -- workaround for New Wave theme (translucency)
@@ -1380,13 +1520,13 @@ ddb_listview_list_render_row_background (DdbListview *ps, cairo_t *cr, DdbListvi
 }
 
 void
-ddb_listview_list_render_row_foreground (DdbListview *ps, cairo_t *cr, DdbListviewIter it, DdbListviewIter group_it, int even, int cursor, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int w, int h) {
+ddb_listview_list_render_row_foreground (DdbListview *ps, cairo_t *cr, DdbListviewIter it, DdbListviewIter group_it, int sel, char **text, int even, int cursor, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int w, int h) {
 	int width, height;
 	GtkAllocation a;
 	gtk_widget_get_allocation (ps->list, &a);
 	width = a.width;
 	height = a.height;
-	if (it && ps->binding->is_selected (it)) {
+	if (it && sel) {
         GdkColor *clr = &gtk_widget_get_style (theme_treeview)->fg[GTK_STATE_SELECTED];
         float rgb[3] = { clr->red/65535.f, clr->green/65535.f, clr->blue/65535.f };
         draw_set_fg_color (&ps->listctx, rgb);
@@ -1400,7 +1540,7 @@ ddb_listview_list_render_row_foreground (DdbListview *ps, cairo_t *cr, DdbListvi
     int cidx = 0;
     for (c = ps->columns; c; c = c->next, cidx++) {
         int cw = c->width;
-        ps->binding->draw_column_data (ps, cr, it, ps->grouptitle_height > 0 ? group_it : NULL, cidx, group_y, group_height, group_pinned, grp_next_y, x, y, cw, h);
+        ps->binding->draw_column_data (ps, cr, it, ps->grouptitle_height > 0 ? group_it : NULL, cidx, text ? text[cidx] : NULL, group_y, group_height, group_pinned, grp_next_y, x, y, cw, h);
         x += cw;
     }
 }
@@ -1622,15 +1762,8 @@ ddb_listview_list_mouse1_pressed (DdbListview *ps, int state, int ex, int ey, Gd
         if (cursor == -1) {
             // find group
             ddb_listview_groupcheck (ps);
-            DdbListviewGroup *g = ps->groups;
-            int idx = 0;
-            while (g) {
-                if (g == grp) {
-                    cursor = idx - 1;
-                    break;
-                }
-                idx += g->num_items;
-                g = g->next;
+            if (grp >= ps->groups && grp < ps->groups + ps->groups_count) {
+                cursor = grp->idx - 1;
             }
         }
         int start = min (prev, cursor);
@@ -1851,14 +1984,8 @@ ddb_listview_list_mousemove (DdbListview *ps, GdkEventMotion *ev, int ex, int ey
             if (y == -1) {
                 // find group
                 ddb_listview_groupcheck (ps);
-                DdbListviewGroup *g = ps->groups;
-                while (g) {
-                    if (g == grp) {
-                        y = idx - 1;
-                        break;
-                    }
-                    idx += g->num_items;
-                    g = g->next;
+                if (grp >= ps->groups && grp < ps->groups + ps->groups_count) {
+                    y = grp->idx - 1;
                 }
             }
             int start = min (y, ps->shift_sel_anchor);
@@ -2561,7 +2688,7 @@ ddb_listview_header_motion_notify_event          (GtkWidget       *widget,
             c->fwidth = (float)c->width / ps->header_width;
         }
         if (c->minheight) {
-            ddb_listview_build_groups (ps);
+            ddb_listview_resize_groups (ps);
         }
         ps->block_redraw_on_scroll = 1;
         ddb_listview_list_setup_vscroll (ps);
@@ -3110,16 +3237,147 @@ ddb_listview_column_set_info (DdbListview *listview, int col, const char *title,
 /////// end of column management code
 
 /////// grouping /////
+// groups are kept in an array in playlist order, with the y position and the
+// index of the first item of each one, so that both can be looked up with a
+// binary search. the items which the groups were built from are kept (and
+// referenced) too, so that on playlist modification only the groups between
+// the unchanged head and tail of the list need to be recalculated.
+
+static void
+ddb_listview_free_group_items (DdbListview *listview) {
+    for (int i = 0; i < listview->group_items_count; i++) {
+        listview->binding->unref (listview->group_items[i]);
+    }
+    free (listview->group_items);
+    listview->group_items = NULL;
+    listview->group_items_count = 0;
+}
+
 void
 ddb_listview_free_groups (DdbListview *listview) {
-    DdbListviewGroup *next;
-    while (listview->groups) {
-        next = listview->groups->next;
-        if (listview->groups->head) {
-            listview->binding->unref (listview->groups->head);
+    for (int i = 0; i < listview->groups_count; i++) {
+        if (listview->groups[i].head) {
+            listview->binding->unref (listview->groups[i].head);
+        }
+    }
+    free (listview->groups);
+    listview->groups = NULL;
+    listview->groups_count = 0;
+    listview->groups_alloc = 0;
+    ddb_listview_free_group_items (listview);
+}
+
+static int
+ddb_listview_groups_reserve (DdbListview *listview, int count) {
+    if (count <= listview->groups_alloc) {
+        return 0;
+    }
+    int alloc = listview->groups_alloc ? listview->groups_alloc : 64;
+    while (alloc < count) {
+        alloc *= 2;
+    }
+    DdbListviewGroup *groups = realloc (listview->groups, alloc * sizeof (DdbListviewGroup));
+    if (!groups) {
+        return -1;
+    }
+    listview->groups = groups;
+    listview->groups_alloc = alloc;
+    return 0;
+}
+
+// updates heights, positions and links of the groups starting from the first
+static void
+ddb_listview_layout_groups (DdbListview *listview, int first) {
+    int min_height = 0;
+    // there's no min height for the single group of an ungrouped list
+    if (listview->grouptitle_height > 0) {
+        for (DdbListviewColumn *c = listview->columns; c; c = c->next) {
+            if (c->minheight && c->width > min_height) {
+                min_height = c->width;
+            }
         }
-        free (listview->groups);
-        listview->groups = next;
+    }
+    int y = 0;
+    int idx = 0;
+    if (first > 0) {
+        DdbListviewGroup *prev = &listview->groups[first-1];
+        y = prev->y + prev->height;
+        idx = prev->idx + prev->num_items;
+    }
+    for (int i = first; i < listview->groups_count; i++) {
+        DdbListviewGroup *grp = &listview->groups[i];
+        grp->height = listview->grouptitle_height + grp->num_items * listview->rowheight;
+        if (grp->height - listview->grouptitle_height < min_height) {
+            grp->height = min_height + listview->grouptitle_height;
+        }
+        grp->y = y;
+        grp->idx = idx;
+        grp->next = i < listview->groups_count - 1 ? grp + 1 : NULL;
+        y += grp->height;
+        idx += grp->num_items;
+    }
+    listview->fullheight = y;
+}
+
+// appends the groups of items [from, to) to the array of count groups;
+// key must contain the title of the last group in the array, if there's one,
+// and returns the title of the last appended group.
+// returns -1 if the list is not grouped, or on allocation failure
+static int
+ddb_listview_group_items (DdbListview *listview, DdbListviewGroup **groups, int *count, int *alloc, DdbListviewIter *items, int from, int to, char *key, int keysize) {
+    char curr[1024];
+    for (int i = from; i < to; i++) {
+        if (listview->binding->get_group (items[i], curr, sizeof (curr)) == -1) {
+            return -1;
+        }
+        if (!*count || strcmp (key, curr)) {
+            if (*count == *alloc) {
+                int n = *alloc ? *alloc * 2 : 64;
+                DdbListviewGroup *g = realloc (*groups, n * sizeof (DdbListviewGroup));
+                if (!g) {
+                    return -1;
+                }
+                *groups = g;
+                *alloc = n;
+            }
+            snprintf (key, keysize, "%s", curr);
+            DdbListviewGroup *grp = &(*groups)[(*count)++];
+            memset (grp, 0, sizeof (DdbListviewGroup));
+            grp->head = items[i];
+            listview->binding->ref (items[i]);
+        }
+        (*groups)[*count-1].num_items++;
+    }
+    return 0;
+}
+
+// walks the list and returns the referenced items in a new array
+static DdbListviewIter *
+ddb_listview_collect_items (DdbListview *listview, int *count) {
+    int n = listview->binding->count ();
+    DdbListviewIter *items = malloc ((n ? n : 1) * sizeof (DdbListviewIter));
+    if (!items) {
+        return NULL;
+    }
+    int i = 0;
+    DdbListviewIter it = listview->binding->head ();
+    while (it) {
+        if (i == n) {
+            // can't happen under pl_lock
+            listview->binding->unref (it);
+            break;
+        }
+        items[i++] = it;
+        it = listview->binding->next (it);
+    }
+    *count = i;
+    return items;
+}
+
+static void
+ddb_listview_groups_changed (DdbListview *listview, int old_height) {
+    if (old_height != listview->fullheight) {
+        ddb_listview_refresh (listview, DDB_REFRESH_VSCROLL);
     }
 }
 
@@ -3130,78 +3388,207 @@ ddb_listview_build_groups (DdbListview *listview) {
     listview->groups_build_idx = listview->binding->modification_idx ();
     ddb_listview_free_groups (listview);
     listview->fullheight = 0;
-
-    DdbListviewGroup *grp = NULL;
-    char str[1024];
-    char curr[1024];
-
-    int min_height= 0;
-    DdbListviewColumn *c;
-    for (c = listview->columns; c; c = c->next) {
-        if (c->minheight && c->width > min_height) {
-            min_height = c->width;
-        }
-    }
-
     listview->grouptitle_height = listview->calculated_grouptitle_height;
+
     DdbListviewIter it = listview->binding->head ();
-    while (it) {
-        int res = listview->binding->get_group (it, curr, sizeof (curr));
-        if (res == -1) {
-            grp = malloc (sizeof (DdbListviewGroup));
-            listview->groups = grp;
-            memset (grp, 0, sizeof (DdbListviewGroup));
-            grp->head = it;
-            grp->num_items = listview->binding->count ();
-            listview->grouptitle_height = 0;
-            grp->height = listview->grouptitle_height + grp->num_items * listview->rowheight;
-//            if (grp->height < min_height) {
-//                grp->height = min_height;
-//            }
-            listview->fullheight = grp->height;
-            listview->fullheight += listview->grouptitle_height;
+    if (!it) {
+        deadbeef->pl_unlock ();
+        ddb_listview_groups_changed (listview, old_height);
+        return;
+    }
+    char key[1024];
+    if (listview->binding->get_group (it, key, sizeof (key)) == -1) {
+        // not grouped, everything goes into a single group without a title
+        if (ddb_listview_groups_reserve (listview, 1) < 0) {
+            listview->binding->unref (it);
             deadbeef->pl_unlock ();
-            if (old_height != listview->fullheight) {
-                ddb_listview_refresh (listview, DDB_REFRESH_VSCROLL);
-            }
             return;
         }
-        if (!grp || strcmp (str, curr)) {
-            strcpy (str, curr);
-            DdbListviewGroup *newgroup = malloc (sizeof (DdbListviewGroup));
-            if (grp) {
-                if (grp->height - listview->grouptitle_height < min_height) {
-                    grp->height = min_height + listview->grouptitle_height;
-                }
-                listview->fullheight += grp->height;
-                grp->next = newgroup;
-            }
-            else {
-                listview->groups = newgroup;
-            }
-            grp = newgroup;
-            memset (grp, 0, sizeof (DdbListviewGroup));
-            grp->head = it;
-            listview->binding->ref (it);
-            grp->num_items = 0;
-            grp->height = listview->grouptitle_height;
-        }
-        grp->height += listview->rowheight;
-        grp->num_items++;
-        DdbListviewIter next = listview->binding->next (it);
-        listview->binding->unref (it);
-        it = next;
+        DdbListviewGroup *grp = &listview->groups[0];
+        memset (grp, 0, sizeof (DdbListviewGroup));
+        grp->head = it;
+        grp->num_items = listview->binding->count ();
+        listview->groups_count = 1;
+        listview->grouptitle_height = 0;
+        ddb_listview_layout_groups (listview, 0);
+        deadbeef->pl_unlock ();
+        ddb_listview_groups_changed (listview, old_height);
+        return;
     }
-    if (grp) {
-        if (grp->height - listview->grouptitle_height < min_height) {
-            grp->height = min_height + listview->grouptitle_height;
+    listview->binding->unref (it);
+
+    int count;
+    DdbListviewIter *items = ddb_listview_collect_items (listview, &count);
+    if (items) {
+        listview->group_items = items;
+        listview->group_items_count = count;
+        if (ddb_listview_group_items (listview, &listview->groups, &listview->groups_count, &listview->groups_alloc, items, 0, count, key, sizeof (key)) < 0) {
+            ddb_listview_free_groups (listview);
         }
-        listview->fullheight += grp->height;
     }
+    ddb_listview_layout_groups (listview, 0);
     deadbeef->pl_unlock ();
-    if (old_height != listview->fullheight) {
-        ddb_listview_refresh (listview, DDB_REFRESH_VSCROLL);
+    ddb_listview_groups_changed (listview, old_height);
+}
+
+// updates group heights after a column which sets min group height was resized
+static void
+ddb_listview_resize_groups (DdbListview *listview) {
+    deadbeef->pl_lock ();
+    int old_height = listview->fullheight;
+    ddb_listview_layout_groups (listview, 0);
+    deadbeef->pl_unlock ();
+    ddb_listview_groups_changed (listview, old_height);
+}
+
+// finds the group which contains row, or the last group if row is past the end
+static int
+ddb_listview_find_group_by_row (DdbListview *listview, int row) {
+    int l = 0;
+    int r = listview->groups_count - 1;
+    while (l < r) {
+        int m = (l + r + 1) / 2;
+        if (listview->groups[m].idx <= row) {
+            l = m;
+        }
+        else {
+            r = m - 1;
+        }
+    }
+    return l;
+}
+
+// finds the first group which ends at or below y, or returns groups_count
+static int
+ddb_listview_find_group_by_y (DdbListview *listview, int y) {
+    int l = 0;
+    int r = listview->groups_count;
+    while (l < r) {
+        int m = (l + r) / 2;
+        if (listview->groups[m].y + listview->groups[m].height < y) {
+            l = m + 1;
+        }
+        else {
+            r = m;
+        }
+    }
+    return l;
+}
+
+DdbListviewGroup *
+ddb_listview_get_group_by_y (DdbListview *listview, int y) {
+    int i = ddb_listview_find_group_by_y (listview, y);
+    return i < listview->groups_count ? &listview->groups[i] : NULL;
+}
+
+// regroups only the items between the unchanged head and tail of the list;
+// falls back to the full rebuild when the list was not grouped
+static void
+ddb_listview_update_groups (DdbListview *listview) {
+    if (!listview->group_items || !listview->groups_count || listview->grouptitle_height != listview->calculated_grouptitle_height) {
+        ddb_listview_build_groups (listview);
+        return;
+    }
+    deadbeef->pl_lock ();
+    int old_height = listview->fullheight;
+    listview->groups_build_idx = listview->binding->modification_idx ();
+
+    int n;
+    DdbListviewIter *items = ddb_listview_collect_items (listview, &n);
+    if (!items) {
+        deadbeef->pl_unlock ();
+        return;
     }
+    DdbListviewIter *old_items = listview->group_items;
+    int old_n = listview->group_items_count;
+
+    // the old items are still referenced, so the pointers can be compared
+    int head = 0;
+    while (head < n && head < old_n && items[head] == old_items[head]) {
+        head++;
+    }
+    int tail = 0;
+    while (tail < n - head && tail < old_n - head && items[n-1-tail] == old_items[old_n-1-tail]) {
+        tail++;
+    }
+    listview->group_items = items;
+    listview->group_items_count = n;
+    if (head == n && n == old_n) {
+        for (int i = 0; i < old_n; i++) {
+            listview->binding->unref (old_items[i]);
+        }
+        free (old_items);
+        deadbeef->pl_unlock ();
+        return;
+    }
+
+    // the group before the 1st changed item can get more items; a group can
+    // only be reused if it starts in the unchanged tail
+    int first = head > 0 ? ddb_listview_find_group_by_row (listview, head - 1) : 0;
+    int last = listview->groups_count;
+    if (old_n - tail < old_n) {
+        last = ddb_listview_find_group_by_row (listview, old_n - tail);
+        if (listview->groups[last].idx < old_n - tail) {
+            last++;
+        }
+    }
+    int from = listview->groups[first].idx;
+    int to = last < listview->groups_count ? listview->groups[last].idx - old_n + n : n;
+
+    DdbListviewGroup *region = NULL;
+    int region_count = 0;
+    int region_alloc = 0;
+    char key[1024] = "";
+    int res = ddb_listview_group_items (listview, &region, &region_count, &region_alloc, items, from, to, key, sizeof (key));
+
+    // the 1st reused group can have the same title as the last new one
+    int merge = 0;
+    if (res == 0 && region_count > 0 && last < listview->groups_count) {
+        char curr[1024];
+        res = listview->binding->get_group (listview->groups[last].head, curr, sizeof (curr));
+        merge = res == 0 && !strcmp (key, curr);
+    }
+
+    DdbListviewGroup *old_groups = listview->groups;
+    if (res == 0 && ddb_listview_groups_reserve (listview, first + region_count + listview->groups_count - last) < 0) {
+        res = -1;
+    }
+    if (res < 0) {
+        for (int i = 0; i < region_count; i++) {
+            listview->binding->unref (region[i].head);
+        }
+        free (region);
+        for (int i = 0; i < old_n; i++) {
+            listview->binding->unref (old_items[i]);
+        }
+        free (old_items);
+        deadbeef->pl_unlock ();
+        ddb_listview_build_groups (listview);
+        return;
+    }
+    for (int i = first; i < last; i++) {
+        listview->binding->unref (listview->groups[i].head);
+    }
+    if (merge) {
+        region[region_count-1].num_items += listview->groups[last].num_items;
+        listview->binding->unref (listview->groups[last].head);
+        last++;
+    }
+    int tail_count = listview->groups_count - last;
+    memmove (&listview->groups[first + region_count], &listview->groups[last], tail_count * sizeof (DdbListviewGroup));
+    memcpy (&listview->groups[first], region, region_count * sizeof (DdbListviewGroup));
+    listview->groups_count = first + region_count + tail_count;
+    free (region);
+
+    for (int i = 0; i < old_n; i++) {
+        listview->binding->unref (old_items[i]);
+    }
+    free (old_items);
+
+    // links are rebuilt from the start if the array has moved
+    ddb_listview_layout_groups (listview, listview->groups == old_groups ? first : 0);
+    deadbeef->pl_unlock ();
+    ddb_listview_groups_changed (listview, old_height);
 }
 
 void
@@ -38,6 +38,8 @@ G_BEGIN_DECLS
 #define DDB_IS_LISTVIEW_CLASS(obj) (G_TYPE_CHECK_CLASS_TYPE ((obj), DDB_TYPE_LISTVIEW))
 #define DDB_LISTVIEW_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), DDB_TYPE_LISTVIEW, DdbListviewClass))
 
+#define DDB_LISTVIEW_MAX_COVER_PENDING 32
+
 typedef struct {
     int id;
     char *format;
@@ -54,6 +56,8 @@ struct _DdbListviewGroup {
     int32_t height;
     int32_t num_items;
     int pinned;
+    int32_t y; // position in the list
+    int32_t idx; // index of the head item
     struct _DdbListviewGroup *next;
 };
 
@@ -90,7 +94,11 @@ typedef struct {
 
     // callbacks
     void (*draw_group_title) (DdbListview *listview, cairo_t *drawable, DdbListviewIter iter, int x, int y, int width, int height);
-    void (*draw_column_data) (DdbListview *listview, cairo_t *drawable, DdbListviewIter iter, DdbListviewIter group_iter, int column, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int width, int height);
+    // text is what get_column_text returned for the column, or NULL
+    void (*draw_column_data) (DdbListview *listview, cairo_t *drawable, DdbListviewIter iter, DdbListviewIter group_iter, int column, const char *text, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int width, int height);
+    // formats the text of a cell under pl_lock before drawing, so that drawing
+    // can happen without it; returns -1 if the column is not drawn as text
+    int (*get_column_text) (DdbListview *listview, DdbListviewIter iter, int column, char *text, int size);
     void (*list_context_menu) (DdbListview *listview, DdbListviewIter iter, int idx);
     void (*header_context_menu) (DdbListview *listview, int col);
     void (*handle_doubleclick) (DdbListview *listview, DdbListviewIter iter, int idx);
@@ -127,6 +135,7 @@ struct _DdbListview {
     int scrollpos;
     int hscrollpos;
     int rowheight;
+    int vscroll_dir; // -1 if the last vscroll was up, 1 if down
 
     int col_movepos;
 
@@ -160,7 +169,11 @@ struct _DdbListview {
     struct _DdbListviewColumn *columns;
     gboolean lock_columns;
 
-    struct _DdbListviewGroup *groups;
+    struct _DdbListviewGroup *groups; // array of groups_count, also linked by next
+    int groups_count;
+    int groups_alloc;
+    DdbListviewIter *group_items; // referenced items the groups were built from
+    int group_items_count;
     int groups_build_idx; // must be the same as playlist modification idx
     int fullheight;
     int block_redraw_on_scroll;
@@ -182,6 +195,13 @@ struct _DdbListview {
     int cover_size;
     int new_cover_size;
     guint cover_refresh_timeout_id;
+    // list areas where cover art placeholders were drawn, as y and height
+    // in list coordinates; -1 count means too many, redraw everything
+    int cover_pending[DDB_LISTVIEW_MAX_COVER_PENDING][2];
+    int cover_pending_count;
+    guint cover_prefetch_id;
+    int cover_prefetch_y;
+    int cover_prefetch_build_idx;
 };
 
 struct _DdbListviewClass {
@@ -294,6 +314,11 @@ ddb_listview_get_row_pos (DdbListview *listview, int row_idx);
 void
 ddb_listview_groupcheck (DdbListview *listview);
 
+// returns the first group which ends at or below y, or NULL;
+// the groups must be up to date, and pl_lock held
+DdbListviewGroup *
+ddb_listview_get_group_by_y (DdbListview *listview, int y);
+
 int
 ddb_listview_is_album_art_column (DdbListview *listview, int x);
 
@@ -312,6 +312,7 @@ DdbListviewBinding main_binding = {
     .external_drag_n_drop = main_external_drag_n_drop,
 
     .draw_column_data = draw_column_data,
+    .get_column_text = get_column_text,
     .draw_group_title = main_draw_group_title,
 
     // columns
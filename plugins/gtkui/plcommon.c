@@ -17,6 +17,7 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 #include <gdk/gdkkeysyms.h>
@@ -85,9 +86,22 @@ redraw_playlist (void *user_data) {
     g_idle_add (redraw_playlist_cb, user_data);
 }
 
+// redraws only the areas where placeholders were drawn, since any of them
+// may be waiting for the image which was just loaded
 static gboolean
 redraw_playlist_single_cb (gpointer user_data) {
-    gtk_widget_queue_draw (GTK_WIDGET(user_data));
+    DdbListview *lv = DDB_LISTVIEW (user_data);
+    if (lv->cover_pending_count < 0) {
+        gtk_widget_queue_draw (GTK_WIDGET(user_data));
+    }
+    else {
+        GtkAllocation a;
+        gtk_widget_get_allocation (lv->list, &a);
+        for (int i = 0; i < lv->cover_pending_count; i++) {
+            gtk_widget_queue_draw_area (lv->list, 0, lv->cover_pending[i][0] - lv->scrollpos, a.width, lv->cover_pending[i][1]);
+        }
+    }
+    lv->cover_pending_count = 0;
     g_object_unref (GTK_WIDGET (user_data));
     return FALSE;
 }
@@ -108,16 +122,8 @@ deferred_cover_load_cb (void *ctx) {
     deadbeef->pl_lock ();
     ddb_listview_groupcheck (lv);
     // find 1st group
-    DdbListviewGroup *grp = lv->groups;
-    int idx = 0;
-    int abs_idx = 0;
-    int grp_y = 0;
-    while (grp && grp_y + grp->height < lv->scrollpos) {
-        grp_y += grp->height;
-        idx += grp->num_items + 1;
-        abs_idx += grp->num_items;
-        grp = grp->next;
-    }
+    DdbListviewGroup *grp = ddb_listview_get_group_by_y (lv, lv->scrollpos);
+    int grp_y = grp ? grp->y : 0;
     GtkAllocation a;
     gtk_widget_get_allocation (GTK_WIDGET (lv), &a);
     while (grp && grp_y < a.height + lv->scrollpos) {
@@ -152,7 +158,104 @@ deferred_cover_load_cb (void *ctx) {
     return FALSE;
 }
 
-void draw_column_data (DdbListview *listview, cairo_t *cr, DdbListviewIter it, DdbListviewIter group_it, int column, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int width, int height) {
+static void
+cover_pending_add (DdbListview *lv, int y, int height) {
+    if (lv->cover_pending_count < 0) {
+        return;
+    }
+    for (int i = 0; i < lv->cover_pending_count; i++) {
+        if (lv->cover_pending[i][0] == y) {
+            return;
+        }
+    }
+    if (lv->cover_pending_count == DDB_LISTVIEW_MAX_COVER_PENDING) {
+        lv->cover_pending_count = -1;
+        return;
+    }
+    lv->cover_pending[lv->cover_pending_count][0] = y;
+    lv->cover_pending[lv->cover_pending_count][1] = height;
+    lv->cover_pending_count++;
+}
+
+// requests art for the groups within one screen past the visible area, in
+// the direction of the last scroll, so it's decoded before it scrolls in
+static gboolean
+cover_prefetch_cb (gpointer user_data) {
+    DdbListview *lv = user_data;
+    lv->cover_prefetch_id = 0;
+    if (lv->cover_size <= 0 || lv->cover_size != lv->new_cover_size) {
+        return FALSE;
+    }
+    GtkAllocation a;
+    gtk_widget_get_allocation (lv->list, &a);
+    int y1 = lv->vscroll_dir < 0 ? lv->scrollpos - a.height : lv->scrollpos + a.height;
+    int y2 = y1 + a.height;
+    if (y1 < 0) {
+        y1 = 0;
+    }
+    deadbeef->pl_lock ();
+    ddb_listview_groupcheck (lv);
+    if (y1 == lv->cover_prefetch_y && lv->groups_build_idx == lv->cover_prefetch_build_idx) {
+        deadbeef->pl_unlock ();
+        return FALSE;
+    }
+    lv->cover_prefetch_y = y1;
+    lv->cover_prefetch_build_idx = lv->groups_build_idx;
+    DdbListviewGroup *grp = y2 > 0 ? ddb_listview_get_group_by_y (lv, y1) : NULL;
+    for (; grp && grp->y < y2; grp = grp->next) {
+        DdbListviewIter group_it = grp->head;
+        const char *album = deadbeef->pl_find_meta (group_it, "album");
+        const char *artist = deadbeef->pl_find_meta (group_it, "artist");
+        if (!album || !*album) {
+            album = deadbeef->pl_find_meta (group_it, "title");
+        }
+        GdkPixbuf *pixbuf = get_cover_art_callb (deadbeef->pl_find_meta (((DB_playItem_t *)group_it), ":URI"), artist, album, lv->cover_size, NULL, NULL);
+        if (pixbuf) {
+            g_object_unref (pixbuf);
+        }
+    }
+    deadbeef->pl_unlock ();
+    return FALSE;
+}
+
+static void
+format_column_text (DB_playItem_t *it, col_info_t *cinf, char *text, int size) {
+    deadbeef->pl_format_title (it, -1, text, size, cinf->id, cinf->format);
+    char *lb = strchr (text, '\r');
+    if (lb) {
+        *lb = 0;
+    }
+    lb = strchr (text, '\n');
+    if (lb) {
+        *lb = 0;
+    }
+}
+
+int
+get_column_text (DdbListview *listview, DdbListviewIter it, int column, char *text, int size) {
+    const char *ctitle;
+    int cwidth;
+    int calign_right;
+    col_info_t *cinf;
+    int minheight;
+    int res = ddb_listview_column_get_info (listview, column, &ctitle, &cwidth, &calign_right, &minheight, (void **)&cinf);
+    if (res == -1 || cinf->id == DB_COLUMN_ALBUM_ART) {
+        return -1;
+    }
+    if (cinf->id == DB_COLUMN_PLAYING) {
+        DB_playItem_t *playing_track = deadbeef->streamer_get_playing_track ();
+        if (playing_track) {
+            deadbeef->pl_item_unref (playing_track);
+        }
+        if (it == playing_track) {
+            return -1;
+        }
+    }
+    format_column_text (it, cinf, text, size);
+    return 0;
+}
+
+void draw_column_data (DdbListview *listview, cairo_t *cr, DdbListviewIter it, DdbListviewIter group_it, int column, const char *text, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int width, int height) {
     const char *ctitle;
     int cwidth;
     int calign_right;
@@ -192,11 +295,27 @@ void draw_column_data (DdbListview *listview, cairo_t *cr, DdbListviewIter it, D
         }
         int real_art_width = width - ART_PADDING_HORZ * 2;
         if (real_art_width > 0 && group_it) {
-            const char *album = deadbeef->pl_find_meta (group_it, "album");
-            const char *artist = deadbeef->pl_find_meta (group_it, "artist");
-            if (!album || !*album) {
-                album = deadbeef->pl_find_meta (group_it, "title");
+            // the list is drawn without pl_lock, so the metadata is copied
+            char album[1024] = "";
+            char artist[1024] = "";
+            char uri[PATH_MAX] = "";
+            deadbeef->pl_lock ();
+            const char *meta = deadbeef->pl_find_meta (group_it, "album");
+            if (!meta || !*meta) {
+                meta = deadbeef->pl_find_meta (group_it, "title");
             }
+            if (meta) {
+                snprintf (album, sizeof (album), "%s", meta);
+            }
+            meta = deadbeef->pl_find_meta (group_it, "artist");
+            if (meta) {
+                snprintf (artist, sizeof (artist), "%s", meta);
+            }
+            meta = deadbeef->pl_find_meta (group_it, ":URI");
+            if (meta) {
+                snprintf (uri, sizeof (uri), "%s", meta);
+            }
+            deadbeef->pl_unlock ();
             if (listview->new_cover_size != real_art_width) {
                 listview->new_cover_size = real_art_width;
                 if (listview->cover_refresh_timeout_id) {
@@ -228,7 +347,21 @@ void draw_column_data (DdbListview *listview, cairo_t *cr, DdbListviewIter it, D
             h = min (height, art_h);
 
             int hq = 0;
-            GdkPixbuf *pixbuf = get_cover_art_callb (deadbeef->pl_find_meta (((DB_playItem_t *)group_it), ":URI"), artist, album, real_art_width == art_width ? art_width : -1, redraw_playlist_single, listview);
+            GdkPixbuf *pixbuf = get_cover_art_callb (uri, artist, album, real_art_width == art_width ? art_width : -1, redraw_playlist_single, listview);
+            if (real_art_width == art_width) {
+                if (!pixbuf) {
+                    // the group's rows, or the top of the list if it's pinned
+                    if (group_pinned == 1 && gtkui_groups_pinned) {
+                        cover_pending_add (listview, listview->scrollpos, group_height);
+                    }
+                    else {
+                        cover_pending_add (listview, y - group_y + listview->scrollpos, group_height - listview->grouptitle_height);
+                    }
+                }
+                if (!listview->cover_prefetch_id) {
+                    listview->cover_prefetch_id = g_idle_add_full (G_PRIORITY_LOW, cover_prefetch_cb, listview, NULL);
+                }
+            }
             if (!pixbuf) {
                 pixbuf = cover_get_default_pixbuf ();
             }
@@ -296,15 +429,10 @@ void draw_column_data (DdbListview *listview, cairo_t *cr, DdbListviewIter it, D
         cairo_fill (cr);
     }
     else if (it) {
-        char text[1024];
-        deadbeef->pl_format_title (it, -1, text, sizeof (text), cinf->id, cinf->format);
-        char *lb = strchr (text, '\r');
-        if (lb) {
-            *lb = 0;
-        }
-        lb = strchr (text, '\n');
-        if (lb) {
-            *lb = 0;
+        char str[1024];
+        if (!text) {
+            format_column_text (it, cinf, str, sizeof (str));
+            text = str;
         }
         GdkColor *color = NULL;
         if (theming) {
@@ -403,7 +531,11 @@ main_reload_metadata_activate
                 DB_decoder_t **decoders = deadbeef->plug_get_decoder_list ();
                 for (int i = 0; decoders[i]; i++) {
                     if (!strcmp (decoders[i]->plugin.id, decoder_id)) {
-                        if (decoders[i]->read_metadata) {
+                        // probe also picks up format and duration changes
+                        if (decoders[i]->plugin.api_vminor >= 7 && decoders[i]->probe) {
+                            decoders[i]->probe (it, DDB_PROBE_FORMAT | DDB_PROBE_TAGS);
+                        }
+                        else if (decoders[i]->read_metadata) {
                             decoders[i]->read_metadata (it);
                         }
                         break;
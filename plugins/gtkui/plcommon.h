@@ -30,7 +30,10 @@ write_column_config (const char *name, int idx, const char *title, int width, in
 void
 rewrite_column_config (DdbListview *listview, const char *name);
 
-void draw_column_data (DdbListview *listview, cairo_t *drawable, DdbListviewIter it, DdbListviewIter group_it, int column, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int width, int height);
+void draw_column_data (DdbListview *listview, cairo_t *drawable, DdbListviewIter it, DdbListviewIter group_it, int column, const char *text, int group_y, int group_height, int group_pinned, int grp_next_y, int x, int y, int width, int height);
+
+int
+get_column_text (DdbListview *listview, DdbListviewIter it, int column, char *text, int size);
 
 void
 list_context_menu (DdbListview *listview, DdbListviewIter it, int idx);
@@ -391,6 +391,7 @@ DdbListviewBinding search_binding = {
     .external_drag_n_drop = NULL,
 
     .draw_column_data = draw_column_data,
+    .get_column_text = get_column_text,
     .draw_group_title = NULL,
 
     // columns
@@ -57,7 +57,11 @@ action_reload_metadata_handler (DB_plugin_action_t *act, int ctx) {
                 DB_decoder_t **decoders = deadbeef->plug_get_decoder_list ();
                 for (int i = 0; decoders[i]; i++) {
                     if (!strcmp (decoders[i]->plugin.id, decoder_id)) {
-                        if (decoders[i]->read_metadata) {
+                        // probe also picks up format and duration changes
+                        if (decoders[i]->plugin.api_vminor >= 7 && decoders[i]->probe) {
+                            decoders[i]->probe (it, DDB_PROBE_FORMAT | DDB_PROBE_TAGS);
+                        }
+                        else if (decoders[i]->read_metadata) {
                             decoders[i]->read_metadata (it);
                         }
                         break;
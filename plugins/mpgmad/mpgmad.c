@@ -23,7 +23,9 @@
 #include <limits.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 #include "../../deadbeef.h"
+#include "../../strdupa.h"
 
 //#define trace(...) { fprintf(stderr, __VA_ARGS__); }
 #define trace(fmt,...)
@@ -62,6 +64,17 @@ static DB_functions_t *deadbeef;
 #define TOC_FLAG        0x0004
 #define VBR_SCALE_FLAG  0x0008
 
+// number of frames between seek index points
+// must be larger than MAX_LEAD_IN_FRAMES, since seeking starts one point
+// earlier than needed to fill the bit-reservoir
+#define SEEK_INDEX_INTERVAL 16
+
+typedef struct {
+    int64_t offs; // file position of the frame header
+    int sample; // first sample of the frame, relative to startoffset
+    int frame;
+} seekpoint_t;
+
 typedef struct {
     DB_FILE *file;
     DB_playItem_t *it;
@@ -110,6 +123,23 @@ typedef struct {
     int vbr;
     int have_xing_header;
     int lead_in_frames;
+
+    // sparse frame index, filled by seek scans, used to avoid rescanning
+    // from the start of file on every seek
+    seekpoint_t *seekpoints;
+    int nseekpoints;
+    int seekpoints_alloc;
+
+    // set when the scan results can be kept in the index cache, see
+    // cmp3_index_cache_load
+    int index_cacheable;
+    int index_cache_nseekpoints; // number of seek points in the cache file
+    // delay/padding as found by the scan, before cmp3_init adjusts them;
+    // the cache always stores these
+    int scan_delay;
+    int scan_padding;
+    int64_t index_cache_size;
+    int64_t index_cache_mtime;
 } buffer_t;
 
 typedef struct {
@@ -182,6 +212,246 @@ extract_f32 (unsigned char *buf) {
     return f;
 }
 
+static void
+cmp3_seek_index_add (buffer_t *buffer, int64_t offs, int sample, int frame) {
+    if (buffer->nseekpoints > 0 && buffer->seekpoints[buffer->nseekpoints-1].sample >= sample) {
+        return; // already indexed
+    }
+    if (buffer->nseekpoints == buffer->seekpoints_alloc) {
+        int sz = buffer->seekpoints_alloc ? buffer->seekpoints_alloc * 2 : 256;
+        seekpoint_t *pts = realloc (buffer->seekpoints, sz * sizeof (seekpoint_t));
+        if (!pts) {
+            return;
+        }
+        buffer->seekpoints = pts;
+        buffer->seekpoints_alloc = sz;
+    }
+    seekpoint_t *pt = &buffer->seekpoints[buffer->nseekpoints++];
+    pt->offs = offs;
+    pt->sample = sample;
+    pt->frame = frame;
+}
+
+// returns the point to resume scanning from when seeking to the sample,
+// leaving at least SEEK_INDEX_INTERVAL lead-in frames, or NULL
+static seekpoint_t *
+cmp3_seek_index_find (buffer_t *buffer, int sample) {
+    int lo = 0;
+    int hi = buffer->nseekpoints - 1;
+    int found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (buffer->seekpoints[mid].sample <= sample) {
+            found = mid;
+            lo = mid + 1;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    if (found < 1) {
+        return NULL;
+    }
+    return &buffer->seekpoints[found-1];
+}
+
+// the results of the full scan which gapless playback needs, and the seek
+// index collected while playing, are kept per file in
+// $XDG_CACHE_HOME/deadbeef/mp3index/, so that opening the same file again
+// doesn't read it through. entries are checked against the file size and
+// mtime
+#define INDEX_CACHE_MAGIC "DDBMP3I1"
+
+typedef struct {
+    char magic[8];
+    int64_t size;
+    int64_t mtime;
+    int32_t pathlen; // the path follows the header, then the seek points
+    int32_t nseekpoints;
+    int32_t version;
+    int32_t layer;
+    int32_t bitrate;
+    int32_t samplerate;
+    int32_t packetlength;
+    int32_t bitspersample;
+    int32_t channels;
+    float duration;
+    int32_t totalsamples;
+    int32_t startoffset;
+    int32_t endoffset;
+    int32_t delay;
+    int32_t padding;
+    float avg_packetlength;
+    int32_t avg_samplerate;
+    int32_t avg_samples_per_frame;
+    int32_t nframes;
+    int32_t vbr;
+    int32_t have_xing_header;
+} index_cache_header_t;
+
+static int
+cmp3_index_cache_path (char *path, int size, const char *fname) {
+    const char *cache = getenv ("XDG_CACHE_HOME");
+    if (!cache && !getenv ("HOME")) {
+        return -1;
+    }
+    uint8_t sig[16];
+    char name[33];
+    deadbeef->md5 (sig, fname, strlen (fname));
+    deadbeef->md5_to_str (name, sig);
+    return snprintf (path, size, cache ? "%s/deadbeef/mp3index/%s" : "%s/.cache/deadbeef/mp3index/%s", cache ? cache : getenv ("HOME"), name) < size ? 0 : -1;
+}
+
+// fills the scan results and the seek index from the cache;
+// returns -1 if the file is not in the cache, or was changed since
+static int
+cmp3_index_cache_load (buffer_t *buffer, const char *fname) {
+    struct stat st;
+    if (!deadbeef->conf_get_int ("mp3.index_cache", 1) || stat (fname, &st) || !S_ISREG (st.st_mode)) {
+        return -1;
+    }
+    buffer->index_cacheable = 1;
+    buffer->index_cache_size = st.st_size;
+    buffer->index_cache_mtime = st.st_mtime;
+
+    char path[PATH_MAX];
+    if (cmp3_index_cache_path (path, sizeof (path), fname) < 0) {
+        return -1;
+    }
+    FILE *fp = fopen (path, "rb");
+    if (!fp) {
+        return -1;
+    }
+    int res = -1;
+    index_cache_header_t h;
+    size_t l = strlen (fname);
+    char *p = NULL;
+    seekpoint_t *pts = NULL;
+    if (fread (&h, sizeof (h), 1, fp) != 1
+            || memcmp (h.magic, INDEX_CACHE_MAGIC, 8)
+            || h.size != st.st_size || h.mtime != st.st_mtime
+            || h.pathlen != l || h.nseekpoints < 0
+            || h.samplerate <= 0 || h.channels <= 0) {
+        goto error;
+    }
+    p = malloc (l);
+    if (!p || fread (p, 1, l, fp) != l || memcmp (p, fname, l)) {
+        goto error;
+    }
+    if (h.nseekpoints > 0) {
+        pts = malloc (h.nseekpoints * sizeof (seekpoint_t));
+        if (!pts || fread (pts, sizeof (seekpoint_t), h.nseekpoints, fp) != h.nseekpoints) {
+            goto error;
+        }
+    }
+
+    buffer->version = h.version;
+    buffer->layer = h.layer;
+    buffer->bitrate = h.bitrate;
+    buffer->samplerate = h.samplerate;
+    buffer->packetlength = h.packetlength;
+    buffer->bitspersample = h.bitspersample;
+    buffer->channels = h.channels;
+    buffer->duration = h.duration;
+    buffer->totalsamples = h.totalsamples;
+    buffer->startoffset = h.startoffset;
+    buffer->endoffset = h.endoffset;
+    buffer->delay = buffer->scan_delay = h.delay;
+    buffer->padding = buffer->scan_padding = h.padding;
+    buffer->avg_packetlength = h.avg_packetlength;
+    buffer->avg_samplerate = h.avg_samplerate;
+    buffer->avg_samples_per_frame = h.avg_samples_per_frame;
+    buffer->nframes = h.nframes;
+    buffer->vbr = h.vbr;
+    buffer->have_xing_header = h.have_xing_header;
+    if (buffer->seekpoints) {
+        free (buffer->seekpoints);
+    }
+    buffer->seekpoints = pts;
+    buffer->nseekpoints = buffer->seekpoints_alloc = h.nseekpoints;
+    buffer->index_cache_nseekpoints = h.nseekpoints;
+    pts = NULL;
+    res = 0;
+    trace ("mpgmad: %s: scan results and %d seek points from cache\n", fname, h.nseekpoints);
+error:
+    if (p) {
+        free (p);
+    }
+    if (pts) {
+        free (pts);
+    }
+    fclose (fp);
+    return res;
+}
+
+// writes the scan results and the seek index of the file to the cache;
+// the file is replaced by rename, so that readers never see a partial one
+static void
+cmp3_index_cache_save (buffer_t *buffer, const char *fname) {
+    if (!buffer->index_cacheable) {
+        return;
+    }
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    if (cmp3_index_cache_path (path, sizeof (path), fname) < 0 || snprintf (tmp, sizeof (tmp), "%s.part", path) >= sizeof (tmp)) {
+        return;
+    }
+    // create the cache dir, and its parents if they're the default ones
+    char *slash = strrchr (path, '/');
+    *slash = 0;
+    char *parent = strrchr (path, '/');
+    *parent = 0;
+    char *grandparent = strrchr (path, '/');
+    *grandparent = 0;
+    mkdir (path, 0755);
+    *grandparent = '/';
+    mkdir (path, 0755);
+    *parent = '/';
+    mkdir (path, 0755);
+    *slash = '/';
+
+    index_cache_header_t h;
+    memset (&h, 0, sizeof (h));
+    memcpy (h.magic, INDEX_CACHE_MAGIC, 8);
+    h.size = buffer->index_cache_size;
+    h.mtime = buffer->index_cache_mtime;
+    h.pathlen = strlen (fname);
+    h.nseekpoints = buffer->nseekpoints;
+    h.version = buffer->version;
+    h.layer = buffer->layer;
+    h.bitrate = buffer->bitrate;
+    h.samplerate = buffer->samplerate;
+    h.packetlength = buffer->packetlength;
+    h.bitspersample = buffer->bitspersample;
+    h.channels = buffer->channels;
+    h.duration = buffer->duration;
+    h.totalsamples = buffer->totalsamples;
+    h.startoffset = buffer->startoffset;
+    h.endoffset = buffer->endoffset;
+    h.delay = buffer->scan_delay;
+    h.padding = buffer->scan_padding;
+    h.avg_packetlength = buffer->avg_packetlength;
+    h.avg_samplerate = buffer->avg_samplerate;
+    h.avg_samples_per_frame = buffer->avg_samples_per_frame;
+    h.nframes = buffer->nframes;
+    h.vbr = buffer->vbr;
+    h.have_xing_header = buffer->have_xing_header;
+
+    FILE *fp = fopen (tmp, "wb");
+    if (!fp) {
+        trace ("mpgmad: failed to write %s\n", tmp);
+        return;
+    }
+    int err = fwrite (&h, sizeof (h), 1, fp) != 1
+        || fwrite (fname, 1, h.pathlen, fp) != h.pathlen
+        || (h.nseekpoints > 0 && fwrite (buffer->seekpoints, sizeof (seekpoint_t), h.nseekpoints, fp) != h.nseekpoints);
+    if (fclose (fp) || err || rename (tmp, path)) {
+        unlink (tmp);
+        return;
+    }
+    buffer->index_cache_nseekpoints = h.nseekpoints;
+}
+
 // sample=-1: scan entire stream, calculate precise duration
 // sample=0: read headers/tags, calculate approximate duration
 // sample>0: seek to the frame with the sample, update skipsamples
@@ -231,10 +501,23 @@ cmp3_scan_stream (buffer_t *buffer, int sample) {
     int64_t lead_in_frame_pos = buffer->startoffset;
     int64_t lead_in_frame_no = 0;
 
+    if (sample > 0) {
+        // resume from the closest indexed frame instead of the file start
+        seekpoint_t *pt = cmp3_seek_index_find (buffer, sample);
+        if (pt) {
+            trace ("cmp3_scan_stream: resuming from frame %d (offs %lld, sample %d)\n", pt->frame, pt->offs, pt->sample);
+            deadbeef->fseek (buffer->file, pt->offs, SEEK_SET);
+            lead_in_frame_pos = pt->offs;
+            lead_in_frame_no = pt->frame;
+            nframe = pt->frame;
+            scansamples = pt->sample;
+        }
+    }
+
 #define MAX_LEAD_IN_FRAMES 10
     int64_t frame_positions[MAX_LEAD_IN_FRAMES]; // positions of nframe-9, nframe-8, nframe-7, ...
     for (int i = 0; i < MAX_LEAD_IN_FRAMES; i++) {
-        frame_positions[i] = buffer->startoffset;
+        frame_positions[i] = lead_in_frame_pos;
     }
 
     for (;;) {
@@ -666,6 +949,11 @@ retry_sync:
                 return 0;
             }
         }
+        // only seek scans are indexed, since they count samples from
+        // startoffset, the same way the decoder does
+        if (sample > 0 && nframe % SEEK_INDEX_INTERVAL == 0) {
+            cmp3_seek_index_add (buffer, framepos, scansamples, nframe);
+        }
         scansamples += samples_per_frame;
         nframe++;
         if (packetlength > 0) {
@@ -820,7 +1108,24 @@ cmp3_init (DB_fileinfo_t *_info, DB_playItem_t *it) {
             trace ("mpgmad: skipping %d(%xH) bytes of junk\n", skip, skip);
             deadbeef->fseek (info->buffer.file, skip, SEEK_SET);
         }
-        int res = cmp3_scan_stream (&info->buffer, deadbeef->conf_get_int ("mp3.disable_gapless", 0) ? 0 : -1);
+        int res;
+        if (deadbeef->conf_get_int ("mp3.disable_gapless", 0)) {
+            res = cmp3_scan_stream (&info->buffer, 0);
+        }
+        else {
+            deadbeef->pl_lock ();
+            char *uri = strdupa (deadbeef->pl_find_meta (it, ":URI"));
+            deadbeef->pl_unlock ();
+            res = cmp3_index_cache_load (&info->buffer, uri);
+            if (res < 0) {
+                res = cmp3_scan_stream (&info->buffer, -1);
+                if (!res) {
+                    info->buffer.scan_delay = info->buffer.delay;
+                    info->buffer.scan_padding = info->buffer.padding;
+                    cmp3_index_cache_save (&info->buffer, uri);
+                }
+            }
+        }
         if (res < 0) {
             trace ("mpgmad: cmp3_init: initial cmp3_scan_stream failed\n");
             return -1;
@@ -1169,6 +1474,13 @@ static void
 cmp3_free (DB_fileinfo_t *_info) {
     mpgmad_info_t *info = (mpgmad_info_t *)_info;
     if (info->buffer.it) {
+        // keep the seek points found while playing for the next time
+        if (info->buffer.nseekpoints > info->buffer.index_cache_nseekpoints) {
+            deadbeef->pl_lock ();
+            char *uri = strdupa (deadbeef->pl_find_meta (info->buffer.it, ":URI"));
+            deadbeef->pl_unlock ();
+            cmp3_index_cache_save (&info->buffer, uri);
+        }
         deadbeef->pl_item_unref (info->buffer.it);
     }
     if (info->buffer.file) {
@@ -1179,6 +1491,9 @@ cmp3_free (DB_fileinfo_t *_info) {
         mad_frame_finish (&info->frame);
         mad_stream_finish (&info->stream);
     }
+    if (info->buffer.seekpoints) {
+        free (info->buffer.seekpoints);
+    }
     free (info);
 }
 
@@ -1408,6 +1723,72 @@ cmp3_read_metadata (DB_playItem_t *it) {
     return 0;
 }
 
+// same results as insert, without the cuesheet handling; the duration is
+// estimated from the headers, or comes from the index cache if the file was
+// played since it last changed, so the stream is never scanned
+static int
+cmp3_probe (DB_playItem_t *it, uint32_t flags) {
+    deadbeef->pl_lock ();
+    char *fname = strdupa (deadbeef->pl_find_meta (it, ":URI"));
+    deadbeef->pl_unlock ();
+
+    // the format of a subtrack comes from its cuesheet, not from the file
+    if (deadbeef->pl_get_item_flags (it) & DDB_IS_SUBTRACK) {
+        flags &= ~DDB_PROBE_FORMAT;
+    }
+    DB_FILE *fp = deadbeef->fopen (fname);
+    if (!fp) {
+        return -1;
+    }
+    if (fp->vfs->is_streaming ()) {
+        deadbeef->fclose (fp);
+        return -1;
+    }
+    buffer_t buffer;
+    memset (&buffer, 0, sizeof (buffer));
+    buffer.file = fp;
+    buffer.it = it;
+    if ((flags & DDB_PROBE_FORMAT) && cmp3_index_cache_load (&buffer, fname) < 0) {
+        int skip = deadbeef->junk_get_leading_size (fp);
+        if (skip > 0) {
+            deadbeef->fseek (fp, skip, SEEK_SET);
+        }
+        if (cmp3_scan_stream (&buffer, 0) < 0) {
+            trace ("mpgmad: cmp3_scan_stream returned error\n");
+            if (buffer.seekpoints) {
+                free (buffer.seekpoints);
+            }
+            deadbeef->fclose (fp);
+            return -1;
+        }
+    }
+
+    if (flags & DDB_PROBE_TAGS) {
+        deadbeef->rewind (fp);
+        deadbeef->pl_delete_all_meta (it);
+        /*int apeerr = */deadbeef->junk_apev2_read (it, fp);
+        /*int v2err = */deadbeef->junk_id3v2_read (it, fp);
+        /*int v1err = */deadbeef->junk_id3v1_read (it, fp);
+        deadbeef->pl_add_meta (it, "title", NULL);
+    }
+
+    if (flags & DDB_PROBE_FORMAT) {
+        deadbeef->pl_set_meta_int (it, ":MP3_DELAY", buffer.delay);
+        deadbeef->pl_set_meta_int (it, ":MP3_PADDING", buffer.padding);
+        cmp3_set_extra_properties (&buffer, 0);
+        ddb_playlist_t *plt = deadbeef->pl_get_playlist (it);
+        deadbeef->plt_set_item_duration (plt, it, buffer.duration);
+        if (plt) {
+            deadbeef->plt_unref (plt);
+        }
+    }
+    if (buffer.seekpoints) {
+        free (buffer.seekpoints);
+    }
+    deadbeef->fclose (fp);
+    return 0;
+}
+
 int
 cmp3_write_metadata (DB_playItem_t *it) {
     // get options
@@ -1454,12 +1835,13 @@ static const char *exts[] = {
 
 static const char settings_dlg[] =
     "property \"Disable gapless playback (faster scanning)\" checkbox mp3.disable_gapless 0;\n"
+    "property \"Cache stream scans and seek index\" checkbox mp3.index_cache 1;\n"
 ;
 
 // define plugin interface
 static DB_decoder_t plugin = {
     .plugin.api_vmajor = 1,
-    .plugin.api_vminor = 0,
+    .plugin.api_vminor = 7,
     .plugin.version_major = 1,
     .plugin.version_minor = 0,
     .plugin.type = DB_PLUGIN_DECODER,
@@ -1495,6 +1877,7 @@ static DB_decoder_t plugin = {
     .read_metadata = cmp3_read_metadata,
     .write_metadata = cmp3_write_metadata,
     .exts = exts,
+    .probe = cmp3_probe,
 };
 
 DB_plugin_t *
@@ -172,6 +172,12 @@ pnull_get_state (void) {
     return state;
 }
 
+// nothing is buffered after streamer_read
+int
+pnull_get_delay (void) {
+    return 0;
+}
+
 int
 null_start (void) {
     return 0;
@@ -191,9 +197,9 @@ nullout_load (DB_functions_t *api) {
 // define plugin interface
 static DB_output_t plugin = {
     .plugin.api_vmajor = 1,
-    .plugin.api_vminor = 0,
+    .plugin.api_vminor = 7,
     .plugin.version_major = 1,
-    .plugin.version_minor = 0,
+    .plugin.version_minor = 1,
     .plugin.type = DB_PLUGIN_OUTPUT,
     .plugin.id = "nullout",
     .plugin.name = "null output plugin",
@@ -226,5 +232,6 @@ static DB_output_t plugin = {
     .pause = pnull_pause,
     .unpause = pnull_unpause,
     .state = pnull_get_state,
+    .get_delay = pnull_get_delay,
     .fmt = {.samplerate = 44100, .channels = 2, .bps = 16, .channelmask = DDB_SPEAKER_FRONT_LEFT | DDB_SPEAKER_FRONT_RIGHT}
 };
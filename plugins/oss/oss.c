@@ -47,6 +47,8 @@ static int oss_rate = 44100;
 static int state;
 static int fd;
 static uintptr_t mutex;
+// frames written to the device which weren't played yet
+static int output_delay;
 
 static char oss_device[100];
 
@@ -160,6 +162,7 @@ oss_free (void) {
         }
         oss_tid = 0;
         state = OUTPUT_STATE_STOPPED;
+        output_delay = 0;
         oss_terminate = 0;
         if (fd) {
             close (fd);
@@ -307,6 +310,12 @@ oss_thread (void *context) {
         if ( write_size > 0 ) {
             res = write (fd, buf, write_size);
         }
+#ifdef SNDCTL_DSP_GETODELAY
+        int odelay;
+        if (ioctl (fd, SNDCTL_DSP_GETODELAY, &odelay) != -1) {
+            output_delay = odelay / sample_size;
+        }
+#endif
 
         deadbeef->mutex_unlock (mutex);
 //        if (res != write_size) {
@@ -327,6 +336,14 @@ oss_get_state (void) {
     return state;
 }
 
+static int
+oss_get_delay (void) {
+    if (state != OUTPUT_STATE_PLAYING) {
+        return 0;
+    }
+    return output_delay;
+}
+
 static int
 oss_configchanged (void) {
     deadbeef->conf_lock ();
@@ -374,9 +391,9 @@ static const char settings_dlg[] =
 // define plugin interface
 static DB_output_t plugin = {
     .plugin.api_vmajor = 1,
-    .plugin.api_vminor = 0,
+    .plugin.api_vminor = 7,
     .plugin.version_major = 1,
-    .plugin.version_minor = 0,
+    .plugin.version_minor = 1,
     .plugin.type = DB_PLUGIN_OUTPUT,
     .plugin.id = "oss",
     .plugin.name = "OSS output plugin",
@@ -411,5 +428,6 @@ static DB_output_t plugin = {
     .pause = oss_pause,
     .unpause = oss_unpause,
     .state = oss_get_state,
+    .get_delay = oss_get_delay,
     .fmt = {-1},
 };
@@ -23,7 +23,7 @@
 #  include "../../config.h"
 #endif
 
-#include <pulse/simple.h>
+#include <pulse/pulseaudio.h>
 
 #include <stdint.h>
 #include <unistd.h>
@@ -43,22 +43,32 @@ static DB_output_t plugin;
 DB_functions_t * deadbeef;
 
 #define CONFSTR_PULSE_SERVERADDR "pulse.serveraddr"
-#define CONFSTR_PULSE_BUFFERSIZE "pulse.buffersize"
+#define CONFSTR_PULSE_LATENCY "pulse.latency"
 
 static intptr_t pulse_tid;
 static int pulse_terminate;
 
-static pa_simple *s;
+// the mainloop thread runs the context and stream callbacks, everything
+// which touches the context or the stream holds the mainloop lock
+static pa_threaded_mainloop *mainloop;
+static pa_context *context;
+static pa_stream *stream;
 static pa_sample_spec ss;
 static ddb_waveformat_t requested_fmt;
 static int state;
+// held by pulse_thread while it fills a buffer of the stream, and when
+// the stream is replaced; taken before the mainloop lock
 static uintptr_t mutex;
 
-static int buffer_size;
+// pulse_thread is in streamer_read, filling a buffer of the stream
+static int write_pending;
+// setformat was called meanwhile, pulse_thread applies requested_fmt
+static int format_pending;
 
-static void pulse_thread(void *context);
+// frames written to the server which weren't played yet
+static int output_delay;
 
-static void pulse_callback(char *stream, int len);
+static void pulse_thread(void *ctx);
 
 static int pulse_init();
 
@@ -74,6 +84,61 @@ static int pulse_pause();
 
 static int pulse_unpause();
 
+static void pulse_state_callback(void *userdata)
+{
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void pulse_context_state_callback(pa_context *c, void *userdata)
+{
+    pulse_state_callback(userdata);
+}
+
+static void pulse_stream_state_callback(pa_stream *s, void *userdata)
+{
+    pulse_state_callback(userdata);
+}
+
+// the server wants more data, wakes up pulse_thread
+static void pulse_stream_request_callback(pa_stream *s, size_t nbytes, void *userdata)
+{
+    pulse_state_callback(userdata);
+}
+
+// must be called with the mainloop locked
+static void pulse_cork(int b)
+{
+    if (stream) {
+        pa_operation *o = pa_stream_cork(stream, b, NULL, NULL);
+        if (o) {
+            pa_operation_unref(o);
+        }
+    }
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+// must be called with the mainloop locked
+static void pulse_update_delay(void)
+{
+    pa_usec_t latency;
+    int negative;
+    // timing info is interpolated, so this doesn't need a server roundtrip
+    if (pa_stream_get_latency(stream, &latency, &negative) >= 0) {
+        output_delay = negative ? 0 : (int)(latency * plugin.fmt.samplerate / PA_USEC_PER_SEC);
+    }
+}
+
+// must be called with the mainloop locked
+static void pulse_free_stream(void)
+{
+    if (stream) {
+        pa_stream_disconnect(stream);
+        pa_stream_unref(stream);
+        stream = NULL;
+    }
+}
+
+// must be called with the mainloop locked
 static int pulse_set_spec(ddb_waveformat_t *fmt)
 {
     memcpy (&plugin.fmt, fmt, sizeof (ddb_waveformat_t));
@@ -94,8 +159,6 @@ static int pulse_set_spec(ddb_waveformat_t *fmt)
     pa_channel_map_init_extend(&channel_map, ss.channels, PA_CHANNEL_MAP_WAVEEX);
     trace ("pulse: channels: %d\n", ss.channels);
 
-    // Read samplerate from config
-    //ss.rate = deadbeef->conf_get_int(CONFSTR_PULSE_SAMPLERATE, 44100);
     ss.rate = plugin.fmt.samplerate;
     trace ("pulse: samplerate: %d\n", ss.rate);
 
@@ -121,79 +184,152 @@ static int pulse_set_spec(ddb_waveformat_t *fmt)
         return -1;
     };
 
-    if (s) {
-        pa_simple_free(s);
-    }
+    pulse_free_stream();
 
-    pa_buffer_attr * attr = NULL;
-    //attr->maxlength = Maximum length of the buffer.
-    //attr->tlength = Playback only: target length of the buffer.
-    //attr->prebuf = Playback only: pre-buffering.
-    //attr->minreq = Playback only: minimum request.
-    //attr->fragsize = Recording only: fragment size.
+    stream = pa_stream_new(context, "Music", &ss, &channel_map);
+    if (!stream) {
+        trace ("pulse: pa_stream_new failed: %s\n", pa_strerror(pa_context_errno(context)));
+        return -1;
+    }
+    pa_stream_set_state_callback(stream, pulse_stream_state_callback, NULL);
+    pa_stream_set_write_callback(stream, pulse_stream_request_callback, NULL);
+
+    // the server keeps tlength bytes queued, and asks for more whenever
+    // minreq bytes were played; without this it picks ~2 sec
+    int latency = deadbeef->conf_get_int(CONFSTR_PULSE_LATENCY, 50);
+    if (latency < 10) {
+        latency = 10;
+    }
+    pa_buffer_attr attr;
+    attr.maxlength = (uint32_t)-1;
+    attr.tlength = pa_usec_to_bytes(latency * PA_USEC_PER_MSEC, &ss);
+    attr.prebuf = (uint32_t)-1;
+    attr.minreq = pa_usec_to_bytes(latency * PA_USEC_PER_MSEC / 4, &ss);
+    attr.fragsize = (uint32_t)-1;
 
-    buffer_size = deadbeef->conf_get_int(CONFSTR_PULSE_BUFFERSIZE, 4096);
+    pa_stream_flags_t flags = PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_START_CORKED;
 
     // TODO: where list of all available devices? add this option to config too..
-    char * dev = NULL;
-
-    int error;
-
-    // Read serveraddr from config
-    deadbeef->conf_lock ();
-    const char * server = deadbeef->conf_get_str_fast (CONFSTR_PULSE_SERVERADDR, NULL);
-
-    if (server) {
-        server = strcmp(server, "default") ? server : NULL;
+    if (pa_stream_connect_playback(stream, NULL, &attr, flags, NULL, NULL) < 0) {
+        trace ("pulse: pa_stream_connect_playback failed: %s\n", pa_strerror(pa_context_errno(context)));
+        pulse_free_stream();
+        return -1;
     }
 
-    s = pa_simple_new(server, "Deadbeef", PA_STREAM_PLAYBACK, dev, "Music", &ss, &channel_map, attr, &error);
-    deadbeef->conf_unlock ();
+    for (;;) {
+        pa_stream_state_t st = pa_stream_get_state(stream);
+        if (st == PA_STREAM_READY) {
+            break;
+        }
+        if (!PA_STREAM_IS_GOOD(st)) {
+            trace ("pulse: stream failed: %s\n", pa_strerror(pa_context_errno(context)));
+            pulse_free_stream();
+            return -1;
+        }
+        pa_threaded_mainloop_wait(mainloop);
+    }
 
-    if (!s)
-    {
-        trace ("pulse_init failed (%d)\n", error);
-        return -1;
+    if (state == OUTPUT_STATE_PLAYING) {
+        pulse_cork(0);
     }
 
     return 0;
 }
 
+// tears down whatever pulse_init has set up
+static void pulse_disconnect(void)
+{
+    if (!mainloop) {
+        return;
+    }
+    pa_threaded_mainloop_lock(mainloop);
+    pulse_free_stream();
+    if (context) {
+        pa_context_disconnect(context);
+        pa_context_unref(context);
+        context = NULL;
+    }
+    pa_threaded_mainloop_unlock(mainloop);
+    pa_threaded_mainloop_stop(mainloop);
+    pa_threaded_mainloop_free(mainloop);
+    mainloop = NULL;
+}
+
 static int pulse_init(void)
 {
     trace ("pulse_init\n");
     state = OUTPUT_STATE_STOPPED;
     pulse_terminate = 0;
+    write_pending = 0;
+    format_pending = 0;
 
     if (requested_fmt.samplerate != 0) {
         memcpy (&plugin.fmt, &requested_fmt, sizeof (ddb_waveformat_t));
     }
 
-    if (0 != pulse_set_spec(&plugin.fmt)) {
+    mainloop = pa_threaded_mainloop_new();
+    if (!mainloop) {
+        return -1;
+    }
+    context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), "Deadbeef");
+    if (!context) {
+        pulse_disconnect();
         return -1;
     }
+    pa_context_set_state_callback(context, pulse_context_state_callback, NULL);
 
-    pulse_tid = deadbeef->thread_start(pulse_thread, NULL);
+    // Read serveraddr from config
+    deadbeef->conf_lock ();
+    const char * server = deadbeef->conf_get_str_fast (CONFSTR_PULSE_SERVERADDR, NULL);
 
-    return 0;
-}
+    if (server) {
+        server = strcmp(server, "default") ? server : NULL;
+    }
 
-static int pulse_setformat (ddb_waveformat_t *fmt)
-{
-    memcpy (&requested_fmt, fmt, sizeof (ddb_waveformat_t));
-    if (!s) {
+    int res = pa_context_connect(context, server, 0, NULL);
+    deadbeef->conf_unlock ();
+
+    if (res < 0 || pa_threaded_mainloop_start(mainloop) < 0) {
+        trace ("pulse_init failed: %s\n", pa_strerror(pa_context_errno(context)));
+        pulse_disconnect();
         return -1;
     }
-    if (!memcmp (fmt, &plugin.fmt, sizeof (ddb_waveformat_t))) {
-        trace ("pulse_setformat ignored\n");
-        return 0;
+
+    pa_threaded_mainloop_lock(mainloop);
+    for (;;) {
+        pa_context_state_t st = pa_context_get_state(context);
+        if (st == PA_CONTEXT_READY) {
+            break;
+        }
+        if (!PA_CONTEXT_IS_GOOD(st)) {
+            trace ("pulse_init failed: %s\n", pa_strerror(pa_context_errno(context)));
+            pa_threaded_mainloop_unlock(mainloop);
+            pulse_disconnect();
+            return -1;
+        }
+        pa_threaded_mainloop_wait(mainloop);
     }
-    trace ("pulse_setformat %dbit %s %dch %dHz channelmask=%X\n", fmt->bps, fmt->is_float ? "float" : "int", fmt->channels, fmt->samplerate, fmt->channelmask);
+    res = pulse_set_spec(&plugin.fmt);
+    pa_threaded_mainloop_unlock(mainloop);
 
+    if (0 != res) {
+        pulse_disconnect();
+        return -1;
+    }
+
+    pulse_tid = deadbeef->thread_start(pulse_thread, NULL);
+
+    return 0;
+}
+
+static int pulse_apply_format (ddb_waveformat_t *fmt)
+{
     int prev_state = state;
     pulse_stop ();
     deadbeef->mutex_lock(mutex);
+    pa_threaded_mainloop_lock(mainloop);
     pulse_set_spec(fmt);
+    pa_threaded_mainloop_unlock(mainloop);
     deadbeef->mutex_unlock(mutex);
     trace ("new format %dbit %s %dch %dHz channelmask=%X\n", plugin.fmt.bps, plugin.fmt.is_float ? "float" : "int", plugin.fmt.channels, plugin.fmt.samplerate, plugin.fmt.channelmask);
 
@@ -214,6 +350,31 @@ static int pulse_setformat (ddb_waveformat_t *fmt)
     return 0;
 }
 
+static int pulse_setformat (ddb_waveformat_t *fmt)
+{
+    memcpy (&requested_fmt, fmt, sizeof (ddb_waveformat_t));
+    if (!mainloop) {
+        return -1;
+    }
+    if (!memcmp (fmt, &plugin.fmt, sizeof (ddb_waveformat_t))) {
+        trace ("pulse_setformat ignored\n");
+        return 0;
+    }
+    trace ("pulse_setformat %dbit %s %dch %dHz channelmask=%X\n", fmt->bps, fmt->is_float ? "float" : "int", fmt->channels, fmt->samplerate, fmt->channelmask);
+
+    deadbeef->mutex_lock(mutex);
+    if (write_pending) {
+        // called by streamer_read from pulse_thread, which holds a buffer of
+        // the current stream; the stream is replaced when it's done with it
+        format_pending = 1;
+        deadbeef->mutex_unlock(mutex);
+        return 0;
+    }
+    deadbeef->mutex_unlock(mutex);
+
+    return pulse_apply_format (fmt);
+}
+
 static int pulse_free(void)
 {
     trace("pulse_free\n");
@@ -221,16 +382,16 @@ static int pulse_free(void)
     if (pulse_tid)
     {
         pulse_terminate = 1;
+        pa_threaded_mainloop_lock(mainloop);
+        pa_threaded_mainloop_signal(mainloop, 0);
+        pa_threaded_mainloop_unlock(mainloop);
         deadbeef->thread_join(pulse_tid);
     }
 
     pulse_tid = 0;
     state = OUTPUT_STATE_STOPPED;
-    if (s)
-    {
-        pa_simple_free(s);
-        s = NULL;
-    }
+    output_delay = 0;
+    pulse_disconnect();
 
     return 0;
 }
@@ -246,12 +407,29 @@ static int pulse_play(void)
     }
 
     state = OUTPUT_STATE_PLAYING;
+    pa_threaded_mainloop_lock(mainloop);
+    pulse_cork(0);
+    pa_threaded_mainloop_unlock(mainloop);
     return 0;
 }
 
 static int pulse_stop(void)
 {
     state = OUTPUT_STATE_STOPPED;
+    output_delay = 0;
+    if (mainloop) {
+        // drop what's queued on the server, so that it isn't heard on the
+        // next play
+        pa_threaded_mainloop_lock(mainloop);
+        pulse_cork(1);
+        if (stream) {
+            pa_operation *o = pa_stream_flush(stream, NULL, NULL);
+            if (o) {
+                pa_operation_unref(o);
+            }
+        }
+        pa_threaded_mainloop_unlock(mainloop);
+    }
     deadbeef->streamer_reset(1);
     return 0;
 }
@@ -264,6 +442,9 @@ static int pulse_pause(void)
     }
 
     state = OUTPUT_STATE_PAUSED;
+    pa_threaded_mainloop_lock(mainloop);
+    pulse_cork(1);
+    pa_threaded_mainloop_unlock(mainloop);
 
     return 0;
 }
@@ -273,12 +454,15 @@ static int pulse_unpause(void)
     if (state == OUTPUT_STATE_PAUSED)
     {
         state = OUTPUT_STATE_PLAYING;
+        pa_threaded_mainloop_lock(mainloop);
+        pulse_cork(0);
+        pa_threaded_mainloop_unlock(mainloop);
     }
 
     return 0;
 }
 
-static void pulse_thread(void *context)
+static void pulse_thread(void *ctx)
 {
 #ifdef __linux__
     prctl(PR_SET_NAME, "deadbeef-pulse", 0, 0, 0, 0);
@@ -292,43 +476,108 @@ static void pulse_thread(void *context)
             continue;
         }
 
-        int sample_size = plugin.fmt.channels * (plugin.fmt.bps / 8);
-        int bs = buffer_size;
-        int mod = bs % sample_size;
-        if (mod > 0) {
-            bs -= mod;
+        deadbeef->mutex_lock(mutex);
+        pa_threaded_mainloop_lock(mainloop);
+        if (!stream) {
+            pa_threaded_mainloop_unlock(mainloop);
+            deadbeef->mutex_unlock(mutex);
+            usleep(10000);
+            continue;
         }
 
-        char buf[bs];
-        pulse_callback (buf, sizeof (buf));
-        int error;
+        size_t frame_size = pa_frame_size(&ss);
+        size_t size = pa_stream_writable_size(stream);
+        if (size == (size_t)-1) {
+            fprintf(stderr, "pulse: %s\n", pa_strerror(pa_context_errno(context)));
+            pa_threaded_mainloop_unlock(mainloop);
+            deadbeef->mutex_unlock(mutex);
+            goto error;
+        }
+        if (size < frame_size) {
+            // wait for pulse_stream_request_callback, or a state change
+            deadbeef->mutex_unlock(mutex);
+            if (state == OUTPUT_STATE_PLAYING && !pulse_terminate) {
+                pa_threaded_mainloop_wait(mainloop);
+            }
+            pa_threaded_mainloop_unlock(mainloop);
+            continue;
+        }
 
-        deadbeef->mutex_lock(mutex);
-        int res = pa_simple_write(s, buf, sizeof (buf), &error);
+        // decode straight into the server's memory block
+        void *data = NULL;
+        if (pa_stream_begin_write(stream, &data, &size) < 0 || !data) {
+            pa_threaded_mainloop_unlock(mainloop);
+            deadbeef->mutex_unlock(mutex);
+            fprintf(stderr, "pulse: failed to get a buffer\n");
+            goto error;
+        }
+        size -= size % frame_size;
+        if (!size) {
+            pa_stream_cancel_write(stream);
+            pa_threaded_mainloop_unlock(mainloop);
+            deadbeef->mutex_unlock(mutex);
+            continue;
+        }
+
+        // streamer_read may call setformat or get_delay, don't hold the
+        // mainloop meanwhile
+        write_pending = 1;
+        pa_threaded_mainloop_unlock(mainloop);
+        int bytesread = deadbeef->streamer_read(data, size);
+        pa_threaded_mainloop_lock(mainloop);
+        write_pending = 0;
+
+        if (format_pending || state != OUTPUT_STATE_PLAYING) {
+            // the ring buffer was reset by the format change or stop, so
+            // there's nothing worth writing
+            pa_stream_cancel_write(stream);
+            pa_threaded_mainloop_unlock(mainloop);
+            deadbeef->mutex_unlock(mutex);
+            if (format_pending) {
+                format_pending = 0;
+                pulse_apply_format(&requested_fmt);
+            }
+            continue;
+        }
+
+        if (bytesread < 0) {
+            bytesread = 0;
+        }
+        if (bytesread < size) {
+            memset ((char *)data + bytesread, 0, size - bytesread);
+        }
+        int res = pa_stream_write(stream, data, size, NULL, 0, PA_SEEK_RELATIVE);
+        if (res >= 0) {
+            pulse_update_delay();
+        }
+        pa_threaded_mainloop_unlock(mainloop);
         deadbeef->mutex_unlock(mutex);
 
         if (res < 0)
         {
             fprintf(stderr, "pulse: failed to write buffer\n");
-            pulse_tid = 0;
-            pulse_free ();
-            break;
+            goto error;
         }
     }
+    return;
+error:
+    pulse_tid = 0;
+    pulse_free ();
 }
 
-static void pulse_callback(char *stream, int len)
+static int pulse_get_state(void)
 {
-    int bytesread = deadbeef->streamer_read(stream, len);
-    if (bytesread < len)
-    {
-        memset (stream + bytesread, 0, len-bytesread);
-    }
+    return state;
 }
 
-static int pulse_get_state(void)
+static int pulse_get_delay(void)
 {
-    return state;
+    if (state != OUTPUT_STATE_PLAYING)
+    {
+        return 0;
+    }
+
+    return output_delay;
 }
 
 static int pulse_plugin_start(void)
@@ -353,14 +602,14 @@ DB_plugin_t * pulse_load(DB_functions_t *api)
 
 static const char settings_dlg[] =
     "property \"PulseAudio server\" entry " CONFSTR_PULSE_SERVERADDR " default;\n"
-    "property \"Preferred buffer size\" entry " CONFSTR_PULSE_BUFFERSIZE " 8192;\n";
+    "property \"Target latency (ms)\" entry " CONFSTR_PULSE_LATENCY " 50;\n";
 
 static DB_output_t plugin =
 {
     .plugin.api_vmajor = 1,
-    .plugin.api_vminor = 0,
+    .plugin.api_vminor = 7,
     .plugin.version_major = 0,
-    .plugin.version_minor = 1,
+    .plugin.version_minor = 3,
     .plugin.type = DB_PLUGIN_OUTPUT,
     .plugin.id = "pulseaudio",
     .plugin.name = "PulseAudio output plugin",
@@ -395,4 +644,5 @@ static DB_output_t plugin =
     .pause = pulse_pause,
     .unpause = pulse_unpause,
     .state = pulse_get_state,
+    .get_delay = pulse_get_delay,
 };
@@ -0,0 +1,264 @@
+/*
+    DeaDBeeF - ultimate music player for GNU/Linux systems with X11
+    Copyright (C) 2009-2013 Alexey Yakovenko <waker@users.sourceforge.net>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "loudness.h"
+#include "../../deadbeef.h"
+
+#define ABSOLUTE_GATE -70.0
+#define RELATIVE_GATE -10.0
+
+typedef struct {
+    double b0, b1, b2, a1, a2;
+} biquad_t;
+
+struct loudness_meter_s {
+    int channels;
+    double *weights;
+    // two direct form II transposed stages per channel, z1/z2 each
+    double *state;
+    biquad_t shelf;
+    biquad_t highpass;
+
+    // 100ms segments; a 400ms gating block is the mean of 4 of them,
+    // which gives the 75% overlap required by BS.1770
+    int seg_size;
+    int seg_pos;
+    double seg_sum;
+    double prev_segs[3];
+    int nsegs;
+
+    double *blocks;
+    int nblocks;
+    int blocks_alloc;
+
+    float peak;
+};
+
+// K-weighting filter coefficients for arbitrary samplerates, derived from
+// the analog prototypes behind the 48kHz tables in BS.1770
+static void
+kweight_init (loudness_meter_t *m, int samplerate) {
+    double f0 = 1681.974450955533;
+    double G = 3.999843853973347;
+    double Q = 0.7071752369554196;
+    double K = tan (M_PI * f0 / samplerate);
+    double Vh = pow (10.0, G / 20.0);
+    double Vb = pow (Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    m->shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+    m->shelf.b1 = 2.0 * (K * K - Vh) / a0;
+    m->shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+    m->shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+    m->shelf.a2 = (1.0 - K / Q + K * K) / a0;
+
+    f0 = 38.13547087602444;
+    Q = 0.5003270373238773;
+    K = tan (M_PI * f0 / samplerate);
+    a0 = 1.0 + K / Q + K * K;
+    m->highpass.b0 = 1.0;
+    m->highpass.b1 = -2.0;
+    m->highpass.b2 = 1.0;
+    m->highpass.a1 = 2.0 * (K * K - 1.0) / a0;
+    m->highpass.a2 = (1.0 - K / Q + K * K) / a0;
+}
+
+static double
+channel_weight (uint32_t speaker) {
+    switch (speaker) {
+    case DDB_SPEAKER_LOW_FREQUENCY:
+        return 0;
+    case DDB_SPEAKER_BACK_LEFT:
+    case DDB_SPEAKER_BACK_RIGHT:
+    case DDB_SPEAKER_SIDE_LEFT:
+    case DDB_SPEAKER_SIDE_RIGHT:
+        return 1.41;
+    }
+    return 1.0;
+}
+
+loudness_meter_t *
+loudness_meter_new (int samplerate, int channels, uint32_t channelmask) {
+    if (samplerate <= 0 || channels <= 0) {
+        return NULL;
+    }
+    loudness_meter_t *m = calloc (1, sizeof (loudness_meter_t));
+    if (!m) {
+        return NULL;
+    }
+    m->channels = channels;
+    m->weights = malloc (channels * sizeof (double));
+    m->state = calloc (channels * 4, sizeof (double));
+    if (!m->weights || !m->state) {
+        loudness_meter_free (m);
+        return NULL;
+    }
+
+    // assign speakers to channels in mask bit order, like the rest of the
+    // player does
+    uint32_t bit = 1;
+    for (int c = 0; c < channels; c++) {
+        while (channelmask && bit && !(channelmask & bit)) {
+            bit <<= 1;
+        }
+        if (channelmask && bit) {
+            m->weights[c] = channel_weight (bit);
+            bit <<= 1;
+        }
+        else {
+            m->weights[c] = 1.0;
+        }
+    }
+
+    kweight_init (m, samplerate);
+    m->seg_size = (samplerate + 5) / 10;
+    return m;
+}
+
+void
+loudness_meter_free (loudness_meter_t *m) {
+    if (m->weights) {
+        free (m->weights);
+    }
+    if (m->state) {
+        free (m->state);
+    }
+    if (m->blocks) {
+        free (m->blocks);
+    }
+    free (m);
+}
+
+static void
+loudness_meter_push_segment (loudness_meter_t *m, double energy) {
+    if (m->nsegs >= 3) {
+        if (m->nblocks == m->blocks_alloc) {
+            int sz = m->blocks_alloc ? m->blocks_alloc * 2 : 1024;
+            double *b = realloc (m->blocks, sz * sizeof (double));
+            if (!b) {
+                return;
+            }
+            m->blocks = b;
+            m->blocks_alloc = sz;
+        }
+        m->blocks[m->nblocks++] = (m->prev_segs[0] + m->prev_segs[1] + m->prev_segs[2] + energy) * 0.25;
+    }
+    else {
+        m->nsegs++;
+    }
+    m->prev_segs[0] = m->prev_segs[1];
+    m->prev_segs[1] = m->prev_segs[2];
+    m->prev_segs[2] = energy;
+}
+
+void
+loudness_meter_process (loudness_meter_t *m, const float *samples, int nframes) {
+    const int nch = m->channels;
+    const biquad_t s = m->shelf;
+    const biquad_t h = m->highpass;
+
+    // the peak doesn't care about segment boundaries
+    float peak = m->peak;
+    for (int i = 0; i < nframes * nch; i++) {
+        float a = fabsf (samples[i]);
+        if (a > peak) {
+            peak = a;
+        }
+    }
+    m->peak = peak;
+
+    while (nframes > 0) {
+        int n = m->seg_size - m->seg_pos;
+        if (n > nframes) {
+            n = nframes;
+        }
+        for (int c = 0; c < nch; c++) {
+            double w = m->weights[c];
+            if (w == 0) {
+                continue;
+            }
+            double *z = m->state + c * 4;
+            double z1 = z[0], z2 = z[1], z3 = z[2], z4 = z[3];
+            double sum = 0;
+            const float *in = samples + c;
+            for (int i = 0; i < n; i++, in += nch) {
+                double x = *in;
+                double y = s.b0 * x + z1;
+                z1 = s.b1 * x - s.a1 * y + z2;
+                z2 = s.b2 * x - s.a2 * y;
+                double o = h.b0 * y + z3;
+                z3 = h.b1 * y - h.a1 * o + z4;
+                z4 = h.b2 * y - h.a2 * o;
+                sum += o * o;
+            }
+            z[0] = z1; z[1] = z2; z[2] = z3; z[3] = z4;
+            m->seg_sum += w * sum;
+        }
+        samples += n * nch;
+        nframes -= n;
+        m->seg_pos += n;
+        if (m->seg_pos == m->seg_size) {
+            loudness_meter_push_segment (m, m->seg_sum / m->seg_size);
+            m->seg_pos = 0;
+            m->seg_sum = 0;
+        }
+    }
+}
+
+float
+loudness_meter_peak (loudness_meter_t *m) {
+    return m->peak;
+}
+
+double
+loudness_meter_integrated (loudness_meter_t **meters, int count) {
+    const double abs_gate = pow (10.0, (ABSOLUTE_GATE + 0.691) / 10.0);
+
+    double sum = 0;
+    int64_t n = 0;
+    for (int k = 0; k < count; k++) {
+        for (int i = 0; i < meters[k]->nblocks; i++) {
+            if (meters[k]->blocks[i] > abs_gate) {
+                sum += meters[k]->blocks[i];
+                n++;
+            }
+        }
+    }
+    if (!n) {
+        return -HUGE_VAL;
+    }
+
+    const double rel_gate = sum / n * pow (10.0, RELATIVE_GATE / 10.0);
+    sum = 0;
+    n = 0;
+    for (int k = 0; k < count; k++) {
+        for (int i = 0; i < meters[k]->nblocks; i++) {
+            double b = meters[k]->blocks[i];
+            if (b > abs_gate && b > rel_gate) {
+                sum += b;
+                n++;
+            }
+        }
+    }
+    if (!n) {
+        return -HUGE_VAL;
+    }
+    return -0.691 + 10.0 * log10 (sum / n);
+}
@@ -0,0 +1,51 @@
+/*
+    DeaDBeeF - ultimate music player for GNU/Linux systems with X11
+    Copyright (C) 2009-2013 Alexey Yakovenko <waker@users.sourceforge.net>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// EBU R128 / ITU-R BS.1770 integrated loudness meter.
+// each meter keeps the energies of all 400ms gating blocks it has seen, so
+// that album loudness can be gated over several tracks without re-decoding.
+
+#ifndef __LOUDNESS_H
+#define __LOUDNESS_H
+
+#include <stdint.h>
+
+typedef struct loudness_meter_s loudness_meter_t;
+
+// channelmask uses DDB_SPEAKER_* bits; 0 means "front left/right, then center"
+loudness_meter_t *
+loudness_meter_new (int samplerate, int channels, uint32_t channelmask);
+
+void
+loudness_meter_free (loudness_meter_t *m);
+
+// samples are interleaved 32 bit floats
+void
+loudness_meter_process (loudness_meter_t *m, const float *samples, int nframes);
+
+// absolute sample peak seen so far, 1.0 = full scale
+float
+loudness_meter_peak (loudness_meter_t *m);
+
+// gated integrated loudness in LUFS over the union of blocks of all meters;
+// returns -HUGE_VAL if nothing passed the absolute gate
+double
+loudness_meter_integrated (loudness_meter_t **meters, int count);
+
+#endif
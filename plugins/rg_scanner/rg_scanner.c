@@ -0,0 +1,541 @@
+/*
+    ReplayGain scanner plugin for DeaDBeeF
+    Copyright (C) 2009-2013 Alexey Yakovenko <waker@users.sourceforge.net>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "../../deadbeef.h"
+#include "loudness.h"
+
+//#define trace(...) { fprintf(stderr, __VA_ARGS__); }
+#define trace(fmt,...)
+
+// ReplayGain 2.0 reference level
+#define RG_REFERENCE_LOUDNESS -18.0
+
+#define RG_MAX_THREADS 32
+#define RG_READ_FRAMES 4096
+
+static DB_functions_t *deadbeef;
+static DB_misc_t plugin;
+
+typedef struct {
+    DB_playItem_t *it;
+    DB_decoder_t *dec;
+    // album grouping key: directory + album tag, NULL for standalone tracks
+    char *album;
+    loudness_meter_t *meter;
+    int64_t frames;
+    int samplerate;
+    double loudness;
+} rg_track_t;
+
+typedef struct {
+    rg_track_t *tracks;
+    int count;
+    int next; // next track to be picked up by a worker
+    uintptr_t mutex;
+    uintptr_t serial_mutex; // held while scanning a track of a decoder not known to be reentrant
+    ddb_playlist_t *plt; // the playlist the tracks came from
+} rg_job_t;
+
+// decoders which keep no state shared between open files; their tracks are
+// scanned on several threads at once, tracks of other decoders one by one
+static const char *reentrant_decoders[] = {
+    "stdmpg", "stdflac", "stdogg", "wv", "ffap", "musepack", "tta", "alac", "sndfile",
+    "stddumb", "stdgme", "stdsid", "adplug", "wmidi", NULL
+};
+
+static uintptr_t mutex;
+static intptr_t scan_tid;
+static int scanning;
+static volatile int abort_scan;
+
+static void
+rg_scan_track (rg_track_t *t) {
+    DB_playItem_t *it = t->it;
+    DB_fileinfo_t *fileinfo = NULL;
+    char *in = NULL;
+    float *out = NULL;
+
+    deadbeef->pl_lock ();
+    t->dec = (DB_decoder_t *)deadbeef->plug_get_for_id (deadbeef->pl_find_meta (it, ":DECODER"));
+    deadbeef->pl_unlock ();
+
+    if (!t->dec) {
+        goto error;
+    }
+    fileinfo = t->dec->open (DDB_DECODER_HINT_OFFLINE);
+    if (!fileinfo) {
+        goto error;
+    }
+    if (t->dec->init (fileinfo, DB_PLAYITEM (it)) != 0) {
+        goto error;
+    }
+
+    ddb_waveformat_t outfmt = fileinfo->fmt;
+    outfmt.bps = 32;
+    outfmt.is_float = 1;
+    const int channels = fileinfo->fmt.channels;
+    // prefer the decoder's native float output, if it has one
+    const int read_float = t->dec->plugin.api_vminor >= 7 && t->dec->read_float;
+    const int passthrough = read_float || (fileinfo->fmt.bps == 32 && fileinfo->fmt.is_float);
+    const int insize = RG_READ_FRAMES * channels * (read_float ? sizeof (float) : fileinfo->fmt.bps / 8);
+
+    in = malloc (insize);
+    out = passthrough ? NULL : malloc (RG_READ_FRAMES * channels * sizeof (float));
+    t->meter = loudness_meter_new (fileinfo->fmt.samplerate, channels, fileinfo->fmt.channelmask);
+    if (!in || (!passthrough && !out) || !t->meter) {
+        goto error;
+    }
+    t->samplerate = fileinfo->fmt.samplerate;
+
+    while (!abort_scan) {
+        int sz = read_float ? t->dec->read_float (fileinfo, (float *)in, insize) : t->dec->read (fileinfo, in, insize);
+        if (sz <= 0) {
+            break;
+        }
+        if (fileinfo->fmt.channels != channels || fileinfo->fmt.samplerate != t->samplerate) {
+            // format changes mid-stream can't be measured consistently
+            goto error;
+        }
+        const float *samples = (const float *)in;
+        if (!passthrough) {
+            sz = deadbeef->pcm_convert (&fileinfo->fmt, in, &outfmt, (char *)out, sz);
+            samples = out;
+        }
+        int nframes = sz / (channels * sizeof (float));
+        loudness_meter_process (t->meter, samples, nframes);
+        t->frames += nframes;
+    }
+
+    free (in);
+    if (out) {
+        free (out);
+    }
+    t->dec->free (fileinfo);
+    return;
+
+error:
+    deadbeef->pl_lock ();
+    fprintf (stderr, "rg_scanner: failed to decode %s\n", deadbeef->pl_find_meta (it, ":URI"));
+    deadbeef->pl_unlock ();
+    if (in) {
+        free (in);
+    }
+    if (out) {
+        free (out);
+    }
+    if (t->meter) {
+        loudness_meter_free (t->meter);
+        t->meter = NULL;
+    }
+    if (fileinfo) {
+        t->dec->free (fileinfo);
+    }
+}
+
+static int
+rg_is_reentrant (DB_playItem_t *it) {
+    int res = 0;
+    deadbeef->pl_lock ();
+    const char *dec = deadbeef->pl_find_meta (it, ":DECODER");
+    for (int i = 0; dec && reentrant_decoders[i]; i++) {
+        if (!strcmp (dec, reentrant_decoders[i])) {
+            res = 1;
+            break;
+        }
+    }
+    deadbeef->pl_unlock ();
+    return res;
+}
+
+static void
+rg_worker (void *ctx) {
+    rg_job_t *job = ctx;
+    for (;;) {
+        deadbeef->mutex_lock (job->mutex);
+        int idx = (job->next < job->count && !abort_scan) ? job->next++ : -1;
+        deadbeef->mutex_unlock (job->mutex);
+        if (idx < 0) {
+            break;
+        }
+        rg_track_t *t = &job->tracks[idx];
+        int serial = !rg_is_reentrant (t->it);
+        if (serial) {
+            deadbeef->mutex_lock (job->serial_mutex);
+        }
+        rg_scan_track (t);
+        if (serial) {
+            deadbeef->mutex_unlock (job->serial_mutex);
+        }
+    }
+}
+
+static int
+rg_album_cmp (const void *a, const void *b) {
+    const rg_track_t *x = *(const rg_track_t **)a;
+    const rg_track_t *y = *(const rg_track_t **)b;
+    if (!x->album || !y->album) {
+        return (x->album != NULL) - (y->album != NULL);
+    }
+    return strcmp (x->album, y->album);
+}
+
+static void
+rg_set_gain (rg_track_t *t, int gain_idx, int peak_idx, double loudness, float peak) {
+    deadbeef->pl_set_item_replaygain (t->it, gain_idx, RG_REFERENCE_LOUDNESS - loudness);
+    deadbeef->pl_set_item_replaygain (t->it, peak_idx, peak);
+}
+
+// computes album values from the per-track gating blocks collected during
+// the scan, so no second decoding pass is needed
+static void
+rg_apply_results (rg_job_t *job) {
+    rg_track_t **sorted = malloc (job->count * sizeof (rg_track_t *));
+    loudness_meter_t **meters = malloc (job->count * sizeof (loudness_meter_t *));
+    if (!sorted || !meters) {
+        goto out;
+    }
+
+    int n = 0;
+    for (int i = 0; i < job->count; i++) {
+        rg_track_t *t = &job->tracks[i];
+        if (t->meter) {
+            t->loudness = loudness_meter_integrated (&t->meter, 1);
+            if (isfinite (t->loudness)) {
+                sorted[n++] = t;
+            }
+            else {
+                deadbeef->pl_lock ();
+                fprintf (stderr, "rg_scanner: %s is too short or silent, skipped\n", deadbeef->pl_find_meta (t->it, ":URI"));
+                deadbeef->pl_unlock ();
+            }
+        }
+    }
+    qsort (sorted, n, sizeof (rg_track_t *), rg_album_cmp);
+
+    int write_tags = deadbeef->conf_get_int ("rg_scanner.write_tags", 1);
+    for (int i = 0; i < n; ) {
+        int e = i + 1;
+        if (sorted[i]->album) {
+            while (e < n && sorted[e]->album && !strcmp (sorted[i]->album, sorted[e]->album)) {
+                e++;
+            }
+        }
+
+        float album_peak = 0;
+        for (int k = i; k < e; k++) {
+            meters[k-i] = sorted[k]->meter;
+            float peak = loudness_meter_peak (sorted[k]->meter);
+            if (peak > album_peak) {
+                album_peak = peak;
+            }
+        }
+        double album_loudness = loudness_meter_integrated (meters, e - i);
+
+        for (int k = i; k < e; k++) {
+            rg_track_t *t = sorted[k];
+            rg_set_gain (t, DDB_REPLAYGAIN_TRACKGAIN, DDB_REPLAYGAIN_TRACKPEAK, t->loudness, loudness_meter_peak (t->meter));
+            rg_set_gain (t, DDB_REPLAYGAIN_ALBUMGAIN, DDB_REPLAYGAIN_ALBUMPEAK, album_loudness, album_peak);
+            trace ("rg_scanner: track %.2f LUFS, album %.2f LUFS\n", t->loudness, album_loudness);
+
+            uint32_t flags = deadbeef->pl_get_item_flags (t->it);
+            if (write_tags && t->dec->write_metadata && !(flags & (DDB_IS_SUBTRACK | DDB_IS_READONLY))) {
+                if (t->dec->write_metadata (t->it)) {
+                    deadbeef->pl_lock ();
+                    fprintf (stderr, "rg_scanner: failed to write tags to %s\n", deadbeef->pl_find_meta (t->it, ":URI"));
+                    deadbeef->pl_unlock ();
+                }
+            }
+        }
+        i = e;
+    }
+
+out:
+    if (sorted) {
+        free (sorted);
+    }
+    if (meters) {
+        free (meters);
+    }
+}
+
+static void
+rg_job_free (rg_job_t *job) {
+    for (int i = 0; i < job->count; i++) {
+        rg_track_t *t = &job->tracks[i];
+        if (t->meter) {
+            loudness_meter_free (t->meter);
+        }
+        if (t->album) {
+            free (t->album);
+        }
+        deadbeef->pl_item_unref (t->it);
+    }
+    free (job->tracks);
+    if (job->mutex) {
+        deadbeef->mutex_free (job->mutex);
+    }
+    if (job->serial_mutex) {
+        deadbeef->mutex_free (job->serial_mutex);
+    }
+    if (job->plt) {
+        deadbeef->plt_unref (job->plt);
+    }
+    free (job);
+}
+
+static void
+rg_scan_thread (void *ctx) {
+    rg_job_t *job = ctx;
+    struct timeval tm1, tm2;
+    gettimeofday (&tm1, NULL);
+
+    int nthreads = deadbeef->conf_get_int ("rg_scanner.num_threads", 0);
+    if (nthreads <= 0) {
+        nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+    }
+    if (nthreads > job->count) {
+        nthreads = job->count;
+    }
+    if (nthreads > RG_MAX_THREADS) {
+        nthreads = RG_MAX_THREADS;
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    intptr_t tids[RG_MAX_THREADS];
+    int nstarted = 0;
+    for (int i = 0; i < nthreads; i++) {
+        tids[nstarted] = deadbeef->thread_start (rg_worker, job);
+        if (tids[nstarted]) {
+            nstarted++;
+        }
+    }
+    if (!nstarted) {
+        rg_worker (job);
+    }
+    for (int i = 0; i < nstarted; i++) {
+        deadbeef->thread_join (tids[i]);
+    }
+
+    if (!abort_scan) {
+        rg_apply_results (job);
+
+        gettimeofday (&tm2, NULL);
+        float elapsed = (tm2.tv_sec - tm1.tv_sec) + (tm2.tv_usec - tm1.tv_usec) / 1000000.f;
+        double duration = 0;
+        for (int i = 0; i < job->count; i++) {
+            if (job->tracks[i].samplerate > 0) {
+                duration += (double)job->tracks[i].frames / job->tracks[i].samplerate;
+            }
+        }
+        fprintf (stderr, "rg_scanner: scanned %d tracks (%.1f sec of audio) in %.2f sec using %d threads, %.1fx realtime\n", job->count, duration, elapsed, nstarted ? nstarted : 1, elapsed > 0 ? duration / elapsed : 0);
+
+        deadbeef->plt_modified (job->plt);
+        deadbeef->sendmessage (DB_EV_PLAYLISTCHANGED, 0, 0, 0);
+    }
+
+    rg_job_free (job);
+
+    deadbeef->mutex_lock (mutex);
+    scanning = 0;
+    deadbeef->mutex_unlock (mutex);
+}
+
+static char *
+rg_album_key (DB_playItem_t *it) {
+    const char *album = deadbeef->pl_find_meta (it, "album");
+    if (!album || !*album) {
+        return NULL;
+    }
+    // same album title in different directories is treated as different albums
+    const char *uri = deadbeef->pl_find_meta (it, ":URI");
+    const char *slash = strrchr (uri, '/');
+    int dirlen = slash ? slash - uri : 0;
+    char *key = malloc (dirlen + strlen (album) + 2);
+    if (key) {
+        memcpy (key, uri, dirlen);
+        key[dirlen] = '\n';
+        strcpy (key + dirlen + 1, album);
+    }
+    return key;
+}
+
+static int
+rg_scan_action (DB_plugin_action_t *act, int ctx) {
+    deadbeef->mutex_lock (mutex);
+    if (scanning) {
+        deadbeef->mutex_unlock (mutex);
+        fprintf (stderr, "rg_scanner: scan already in progress\n");
+        return -1;
+    }
+    scanning = 1;
+    deadbeef->mutex_unlock (mutex);
+
+    if (scan_tid) {
+        deadbeef->thread_join (scan_tid);
+        scan_tid = 0;
+    }
+
+    rg_job_t *job = calloc (1, sizeof (rg_job_t));
+    ddb_playlist_t *plt = deadbeef->plt_get_curr ();
+    if (!job || !plt) {
+        goto error;
+    }
+
+    deadbeef->pl_lock ();
+    int count = ctx == DDB_ACTION_CTX_PLAYLIST ? deadbeef->plt_get_item_count (plt, PL_MAIN) : deadbeef->plt_getselcount (plt);
+    if (count > 0) {
+        job->tracks = calloc (count, sizeof (rg_track_t));
+    }
+    if (job->tracks) {
+        DB_playItem_t *it = deadbeef->pl_get_first (PL_MAIN);
+        while (it && job->count < count) {
+            if ((ctx == DDB_ACTION_CTX_PLAYLIST || deadbeef->pl_is_selected (it))
+                    && deadbeef->pl_get_item_duration (it) > 0) {
+                rg_track_t *t = &job->tracks[job->count++];
+                deadbeef->pl_item_ref (it);
+                t->it = it;
+                t->album = rg_album_key (it);
+            }
+            DB_playItem_t *next = deadbeef->pl_get_next (it, PL_MAIN);
+            deadbeef->pl_item_unref (it);
+            it = next;
+        }
+        if (it) {
+            deadbeef->pl_item_unref (it);
+        }
+    }
+    deadbeef->pl_unlock ();
+    // the current playlist may change before the scan ends
+    job->plt = plt;
+    plt = NULL;
+
+    if (!job->count) {
+        goto error;
+    }
+
+    job->mutex = deadbeef->mutex_create ();
+    job->serial_mutex = deadbeef->mutex_create ();
+    abort_scan = 0;
+    scan_tid = deadbeef->thread_start (rg_scan_thread, job);
+    if (!scan_tid) {
+        goto error;
+    }
+    return 0;
+
+error:
+    if (plt) {
+        deadbeef->plt_unref (plt);
+    }
+    if (job) {
+        rg_job_free (job);
+    }
+    deadbeef->mutex_lock (mutex);
+    scanning = 0;
+    deadbeef->mutex_unlock (mutex);
+    return -1;
+}
+
+static DB_plugin_action_t scan_action = {
+    .title = "Scan ReplayGain",
+    .name = "rg_scan",
+    .flags = DB_ACTION_MULTIPLE_TRACKS | DB_ACTION_SINGLE_TRACK,
+    .callback2 = rg_scan_action,
+    .next = NULL
+};
+
+static DB_plugin_action_t *
+rg_scanner_get_actions (DB_playItem_t *it) {
+    return &scan_action;
+}
+
+static int
+rg_scanner_start (void) {
+    mutex = deadbeef->mutex_create ();
+    return 0;
+}
+
+static int
+rg_scanner_stop (void) {
+    abort_scan = 1;
+    if (scan_tid) {
+        deadbeef->thread_join (scan_tid);
+        scan_tid = 0;
+    }
+    if (mutex) {
+        deadbeef->mutex_free (mutex);
+        mutex = 0;
+    }
+    return 0;
+}
+
+static const char settings_dlg[] =
+    "property \"Number of threads (0 = number of CPUs)\" entry rg_scanner.num_threads 0;\n"
+    "property \"Write tags to files\" checkbox rg_scanner.write_tags 1;\n"
+;
+
+static DB_misc_t plugin = {
+    .plugin.api_vmajor = 1,
+    .plugin.api_vminor = 5,
+    .plugin.version_major = 1,
+    .plugin.version_minor = 0,
+    .plugin.type = DB_PLUGIN_MISC,
+    .plugin.id = "rg_scanner",
+    .plugin.name = "ReplayGain scanner",
+    .plugin.descr = "Computes ReplayGain 2.0 track and album gain/peak values using EBU R128 loudness measurement.\n"
+        "Usage:\n"
+        "· select some tracks in playlist\n"
+        "· right click\n"
+        "· select «Scan ReplayGain»\n"
+        "Tracks are decoded in parallel, album values are computed for tracks sharing album tag and directory.",
+    .plugin.copyright =
+        "Copyright (C) 2009-2013 Alexey Yakovenko <waker@users.sourceforge.net>\n"
+        "\n"
+        "This program is free software; you can redistribute it and/or\n"
+        "modify it under the terms of the GNU General Public License\n"
+        "as published by the Free Software Foundation; either version 2\n"
+        "of the License, or (at your option) any later version.\n"
+        "\n"
+        "This program is distributed in the hope that it will be useful,\n"
+        "but WITHOUT ANY WARRANTY; without even the implied warranty of\n"
+        "MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the\n"
+        "GNU General Public License for more details.\n"
+        "\n"
+        "You should have received a copy of the GNU General Public License\n"
+        "along with this program; if not, write to the Free Software\n"
+        "Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.\n"
+    ,
+    .plugin.website = "http://deadbeef.sf.net",
+    .plugin.start = rg_scanner_start,
+    .plugin.stop = rg_scanner_stop,
+    .plugin.get_actions = rg_scanner_get_actions,
+    .plugin.configdialog = settings_dlg,
+};
+
+DB_plugin_t *
+rg_scanner_load (DB_functions_t *api) {
+    deadbeef = api;
+    return DB_PLUGIN (&plugin);
+}
@@ -19,6 +19,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #ifdef HAVE_CONFIG_H
 #  include <config.h>
 #endif
@@ -60,17 +65,32 @@ le_int16 (int16_t in, unsigned char *out) {
 #endif
 }
 
-// SLDB support costs ~1M!!!
-// current hvsc sldb size is ~35k songs
-#define SLDB_MAX_SONGS 40000
-// ~50k subsongs in current sldb
-#define SLDB_POOL_SIZE 55000
+// the song length database is kept in one block, which is also the format
+// of its binary cache: a header, entries sorted by digest, then the pool of
+// subsong lengths in seconds
+#define SLDB_CACHE_MAGIC "DDBSLDB1"
 typedef struct {
-    uint8_t sldb_digests[SLDB_MAX_SONGS][16];
-    int16_t sldb_pool[SLDB_POOL_SIZE];
-    int sldb_poolmark;
-    int16_t *sldb_lengths[SLDB_MAX_SONGS];
-    int sldb_size;
+    char magic[8];
+    int64_t src_mtime;
+    int64_t src_size;
+    int32_t nsongs;
+    int32_t poolsize;
+    char src_path[1024];
+} sldb_header_t;
+
+typedef struct {
+    uint8_t digest[16];
+    int32_t lengths; // index of the 1st subsong length in the pool
+    int32_t count;
+} sldb_entry_t;
+
+typedef struct {
+    const sldb_header_t *hdr;
+    const sldb_entry_t *entries;
+    const int16_t *pool;
+    void *mem;
+    size_t memsize;
+    int mapped;
 } sldb_t;
 static int sldb_loaded;
 static sldb_t *sldb;
@@ -80,33 +100,133 @@ static int chip_voices = 0xff;
 static int chip_voices_changed = 0;
 
 static void
-sldb_load()
-{
-    if (sldb_disable) {
+sldb_free (void) {
+    if (!sldb) {
         return;
     }
-    trace ("sldb_load\n");
-    int conf_hvsc_enable = deadbeef->conf_get_int ("hvsc_enable", 0);
-    if (sldb_loaded || !conf_hvsc_enable) {
-        sldb_disable = 1;
+    if (sldb->mapped) {
+        munmap (sldb->mem, sldb->memsize);
+    }
+    else {
+        free (sldb->mem);
+    }
+    free (sldb);
+    sldb = NULL;
+}
+
+static int
+sldb_cache_path (char *path, int size) {
+    const char *cache = getenv ("XDG_CACHE_HOME");
+    if (!cache && !getenv ("HOME")) {
+        return -1;
+    }
+    return snprintf (path, size, cache ? "%s/deadbeef/sldb.bin" : "%s/.cache/deadbeef/sldb.bin", cache ? cache : getenv ("HOME")) < size ? 0 : -1;
+}
+
+static void
+sldb_set_mem (void *mem, size_t memsize, int mapped) {
+    sldb = (sldb_t *)malloc (sizeof (sldb_t));
+    sldb->mem = mem;
+    sldb->memsize = memsize;
+    sldb->mapped = mapped;
+    sldb->hdr = (const sldb_header_t *)mem;
+    sldb->entries = (const sldb_entry_t *)(sldb->hdr + 1);
+    sldb->pool = (const int16_t *)(sldb->entries + sldb->hdr->nsongs);
+}
+
+// maps the cache, if it was built from the same file
+static int
+sldb_cache_load (const char *fname, const struct stat *st) {
+    char path[PATH_MAX];
+    if (sldb_cache_path (path, sizeof (path)) < 0) {
+        return -1;
+    }
+    int fd = open (path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat cst;
+    if (fstat (fd, &cst) < 0 || cst.st_size < (off_t)sizeof (sldb_header_t)) {
+        close (fd);
+        return -1;
+    }
+    size_t memsize = cst.st_size;
+    void *mem = mmap (NULL, memsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (mem == MAP_FAILED) {
+        return -1;
+    }
+    const sldb_header_t *hdr = (const sldb_header_t *)mem;
+    if (memcmp (hdr->magic, SLDB_CACHE_MAGIC, 8)
+            || hdr->src_mtime != (int64_t)st->st_mtime
+            || hdr->src_size != (int64_t)st->st_size
+            || strncmp (hdr->src_path, fname, sizeof (hdr->src_path))
+            || hdr->nsongs < 0 || hdr->poolsize < 0
+            || memsize != sizeof (sldb_header_t) + (size_t)hdr->nsongs * sizeof (sldb_entry_t) + (size_t)hdr->poolsize * sizeof (int16_t)) {
+        trace ("sid: stale sldb cache %s\n", path);
+        munmap (mem, memsize);
+        return -1;
+    }
+    sldb_set_mem (mem, memsize, 1);
+    trace ("sid: mapped sldb cache %s, %d songs\n", path, hdr->nsongs);
+    return 0;
+}
+
+static void
+sldb_cache_save (void) {
+    char path[PATH_MAX];
+    if (sldb_cache_path (path, sizeof (path)) < 0) {
         return;
     }
-    char conf_hvsc_path[1000];
-    deadbeef->conf_get_str ("hvsc_path", "", conf_hvsc_path, sizeof (conf_hvsc_path));
-    if (!conf_hvsc_path[0]) {
-        sldb_disable = 1;
+    // create the cache dir, and its parent if it's the default one
+    char *slash = strrchr (path, '/');
+    *slash = 0;
+    char *parent = strrchr (path, '/');
+    *parent = 0;
+    mkdir (path, 0755);
+    *parent = '/';
+    mkdir (path, 0755);
+    *slash = '/';
+
+    char tmp[PATH_MAX+10];
+    snprintf (tmp, sizeof (tmp), "%s.part", path);
+    FILE *fp = fopen (tmp, "wb");
+    if (!fp) {
+        trace ("sid: failed to create %s\n", tmp);
         return;
     }
-    sldb_loaded = 1;
-    const char *fname = conf_hvsc_path;
+    int err = fwrite (sldb->mem, 1, sldb->memsize, fp) != sldb->memsize;
+    if (fclose (fp) || err) {
+        unlink (tmp);
+        return;
+    }
+    if (rename (tmp, path)) {
+        unlink (tmp);
+    }
+}
+
+static int
+sldb_entry_cmp (const void *a, const void *b) {
+    return memcmp (((const sldb_entry_t *)a)->digest, ((const sldb_entry_t *)b)->digest, 16);
+}
+
+// parses Songlengths.txt into sldb
+static int
+sldb_parse (const char *fname, const struct stat *st) {
     FILE *fp = fopen (fname, "r");
     if (!fp) {
         trace ("sid: failed to open file %s\n", fname);
-        sldb_disable = 1;
-        return;
+        return -1;
     }
     char str[1024];
 
+    sldb_entry_t *entries = NULL;
+    int nsongs = 0;
+    int songs_alloc = 0;
+    int16_t *pool = NULL;
+    int poolsize = 0;
+    int pool_alloc = 0;
+
     int line = 1;
     if (fgets (str, 1024, fp) != str) {
         goto fail; // eof
@@ -115,15 +235,7 @@ sldb_load()
         goto fail; // bad format
     }
 
-    if (!sldb) {
-        sldb = (sldb_t *)malloc (sizeof (sldb_t));
-        memset (sldb, 0, sizeof (sldb_t));
-    }
     while (fgets (str, 1024, fp) == str) {
-        if (sldb->sldb_size >= SLDB_MAX_SONGS) {
-            trace ("sldb loader ran out of memory.\n");
-            break;
-        }
         line++;
         if (str[0] == ';') {
 //            trace ("reading songlength for %s", str);
@@ -171,17 +283,19 @@ sldb_load()
             trace ("bad md5 (sz=%d, line=%d)\n", sz, line);
             continue; // bad song md5
         }
-//        else {
-//            trace ("digest: ");
-//            for (int j = 0; j < 16; j++) {
-//                trace ("%02x", (int)digest[j]);
-//            }
-//            trace ("\n");
-//            exit (0);
-//        }
-        memcpy (sldb->sldb_digests[sldb->sldb_size], digest, 16);
-        sldb->sldb_lengths[sldb->sldb_size] = &sldb->sldb_pool[sldb->sldb_poolmark];
-        sldb->sldb_size++;
+        if (nsongs == songs_alloc) {
+            songs_alloc = songs_alloc ? songs_alloc * 2 : 1024;
+            sldb_entry_t *n = (sldb_entry_t *)realloc (entries, songs_alloc * sizeof (sldb_entry_t));
+            if (!n) {
+                trace ("sldb loader ran out of memory.\n");
+                break;
+            }
+            entries = n;
+        }
+        sldb_entry_t *e = &entries[nsongs++];
+        memcpy (e->digest, digest, 16);
+        e->lengths = poolsize;
+        e->count = 0;
         // check '=' sign
         if (*p != '=') {
             continue; // no '=' sign
@@ -190,7 +304,6 @@ sldb_load()
         if (!(*p)) {
             continue; // unexpected eol
         }
-        int subsong = 0;
         while (*p >= ' ') {
             // read subsong lengths until eol
             char timestamp[7]; // up to MMM:SS
@@ -224,14 +337,17 @@ sldb_load()
                 //trace ("subsong %d, time %s:%s\n", subsong, minute, second);
                 time = atoi (minute) * 60 + atoi (second);
             }
-            if (sldb->sldb_poolmark >= SLDB_POOL_SIZE) {
-                trace ("sldb ran out of memory\n");
-                goto fail;
+            if (poolsize == pool_alloc) {
+                pool_alloc = pool_alloc ? pool_alloc * 2 : 4096;
+                int16_t *n = (int16_t *)realloc (pool, pool_alloc * sizeof (int16_t));
+                if (!n) {
+                    trace ("sldb ran out of memory\n");
+                    goto fail;
+                }
+                pool = n;
             }
-            
-            sldb->sldb_lengths[sldb->sldb_size-1][subsong] = time;
-            sldb->sldb_poolmark++;
-            subsong++;
+            pool[poolsize++] = time;
+            e->count++;
 
             // prepare for next timestamp
             if (*p == '(') {
@@ -254,9 +370,68 @@ sldb_load()
     }
 
 fail:
-    sldb_disable = 1;
     fclose (fp);
-    trace ("HVSC sldb loaded %d songs, %d subsongs total\n", sldb->sldb_size, sldb->sldb_poolmark);
+    if (nsongs) {
+        qsort (entries, nsongs, sizeof (sldb_entry_t), sldb_entry_cmp);
+        size_t memsize = sizeof (sldb_header_t) + nsongs * sizeof (sldb_entry_t) + poolsize * sizeof (int16_t);
+        void *mem = calloc (1, memsize);
+        if (mem) {
+            sldb_header_t *hdr = (sldb_header_t *)mem;
+            memcpy (hdr->magic, SLDB_CACHE_MAGIC, 8);
+            hdr->src_mtime = st->st_mtime;
+            hdr->src_size = st->st_size;
+            hdr->nsongs = nsongs;
+            hdr->poolsize = poolsize;
+            strncpy (hdr->src_path, fname, sizeof (hdr->src_path) - 1);
+            memcpy (hdr + 1, entries, nsongs * sizeof (sldb_entry_t));
+            if (poolsize) {
+                memcpy ((sldb_entry_t *)(hdr + 1) + nsongs, pool, poolsize * sizeof (int16_t));
+            }
+            sldb_set_mem (mem, memsize, 0);
+        }
+    }
+    free (entries);
+    free (pool);
+    if (!sldb) {
+        return -1;
+    }
+    trace ("HVSC sldb loaded %d songs, %d subsongs total\n", sldb->hdr->nsongs, sldb->hdr->poolsize);
+    return 0;
+}
+
+static void
+sldb_load()
+{
+    if (sldb_disable) {
+        return;
+    }
+    trace ("sldb_load\n");
+    int conf_hvsc_enable = deadbeef->conf_get_int ("hvsc_enable", 0);
+    if (sldb_loaded || !conf_hvsc_enable) {
+        sldb_disable = 1;
+        return;
+    }
+    char conf_hvsc_path[1000];
+    deadbeef->conf_get_str ("hvsc_path", "", conf_hvsc_path, sizeof (conf_hvsc_path));
+    if (!conf_hvsc_path[0]) {
+        sldb_disable = 1;
+        return;
+    }
+    sldb_loaded = 1;
+    sldb_disable = 1;
+    const char *fname = conf_hvsc_path;
+    struct stat st;
+    if (stat (fname, &st) < 0) {
+        trace ("sid: failed to stat file %s\n", fname);
+        return;
+    }
+    sldb_free ();
+    if (!sldb_cache_load (fname, &st)) {
+        return;
+    }
+    if (!sldb_parse (fname, &st)) {
+        sldb_cache_save ();
+    }
 }
 
 static int
@@ -265,12 +440,20 @@ sldb_find (const uint8_t *digest) {
         trace ("sldb not loaded\n");
         return -1;
     }
-    for (int i = 0; i < sldb->sldb_size; i++) {
-        if (!memcmp (digest, sldb->sldb_digests[i], 16)) {
-            return i;
-        }
+    sldb_entry_t key;
+    memcpy (key.digest, digest, 16);
+    const sldb_entry_t *e = (const sldb_entry_t *)bsearch (&key, sldb->entries, sldb->hdr->nsongs, sizeof (sldb_entry_t), sldb_entry_cmp);
+    return e ? (int)(e - sldb->entries) : -1;
+}
+
+// returns length of the subsong in seconds, or -1 if it's unknown
+static int
+sldb_get_length (int song, int subsong) {
+    const sldb_entry_t *e = &sldb->entries[song];
+    if (subsong >= e->count) {
+        return -1;
     }
-    return -1;
+    return sldb->pool[e->lengths + subsong];
 }
 
 DB_fileinfo_t *
@@ -539,8 +722,8 @@ csid_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
 
             float length = deadbeef->conf_get_float ("sid.defaultlength", 180);
             if (sldb_loaded) {
-                if (song >= 0 && sldb->sldb_lengths[song][s] >= 0) {
-                    length = sldb->sldb_lengths[song][s];
+                if (song >= 0 && sldb_get_length (song, s) >= 0) {
+                    length = sldb_get_length (song, s);
                 }
                 //        if (song < 0) {
                 //            trace ("song %s not found in db, md5: ", fname);
@@ -572,8 +755,7 @@ sid_configchanged (void) {
 
     // pick up new sldb filename in case it was changed
     if (sldb) {
-        free (sldb);
-        sldb = NULL;
+        sldb_free ();
         sldb_loaded = 0;
     }
 
@@ -601,10 +783,7 @@ csid_start (void) {
 
 int
 csid_stop (void) {
-    if (sldb) {
-        free (sldb);
-        sldb = NULL;
-    }
+    sldb_free ();
     sldb_loaded = 0;
     return 0;
 }
@@ -33,8 +33,10 @@
 
 static DB_functions_t *deadbeef;
 
-#define BUFFER_SIZE (0x10000)
-#define BUFFER_MASK 0xffff
+// ringbuffer size is configurable (in KB), and rounded up to power of 2
+#define DEFAULT_BUFFER_SIZE 64
+#define MIN_BUFFER_SIZE 0x10000
+#define MAX_BUFFER_SIZE 0x1000000
 
 #define MAX_METADATA 1024
 
@@ -52,10 +54,12 @@ enum {
 typedef struct {
     DB_vfs_t *vfs;
     char *url;
-    uint8_t buffer[BUFFER_SIZE];
+    uint8_t *buffer;
+    int32_t buffer_size;
+    int32_t buffer_mask;
 
     DB_playItem_t *track;
-    int64_t pos; // position in stream; use "& BUFFER_MASK" to make it index into ringbuffer
+    int64_t pos; // position in stream; use "& buffer_mask" to make it index into ringbuffer
     int64_t length;
     int32_t remaining; // remaining bytes in buffer read from stream
     int64_t skipbytes;
@@ -91,6 +95,11 @@ http_content_header_handler (void *ptr, size_t size, size_t nmemb, void *stream)
 
 static int64_t biglock;
 
+// connections, dns and ssl sessions are shared between all streams,
+// so that consecutive requests to the same server can reuse them
+static CURLSH *curl_share;
+static intptr_t sharelock;
+
 #define MAX_ABORT_FILES 100
 static DB_FILE *open_files[MAX_ABORT_FILES];
 static int num_open_files = 0;
@@ -128,14 +137,14 @@ http_curl_write_wrapper (HTTP_FILE *fp, void *ptr, size_t size) {
             deadbeef->mutex_unlock (fp->mutex);
             break;
         }
-        int sz = BUFFER_SIZE/2 - fp->remaining; // number of bytes free in buffer
+        int sz = fp->buffer_size/2 - fp->remaining; // number of bytes free in buffer
                                                 // don't allow to fill more than half -- used for seeking backwards
 
         if (sz > 5000) { // wait until there are at least 5k bytes free
             int cp = min (avail, sz);
-            int writepos = (fp->pos + fp->remaining) & BUFFER_MASK;
+            int writepos = (fp->pos + fp->remaining) & fp->buffer_mask;
             // copy 1st portion (before end of buffer
-            int part1 = BUFFER_SIZE - writepos;
+            int part1 = fp->buffer_size - writepos;
             // may not be more than total
             part1 = min (part1, cp);
             memcpy (fp->buffer+writepos, ptr, part1);
@@ -557,6 +566,9 @@ http_destroy (HTTP_FILE *fp) {
     if (fp->mutex) {
         deadbeef->mutex_free (fp->mutex);
     }
+    if (fp->buffer) {
+        free (fp->buffer);
+    }
     free (fp);
 }
 
@@ -583,7 +595,10 @@ http_thread_func (void *ctx) {
         curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, http_curl_write);
         curl_easy_setopt (curl, CURLOPT_WRITEDATA, ctx);
         curl_easy_setopt (curl, CURLOPT_ERRORBUFFER, fp->http_err);
-        curl_easy_setopt (curl, CURLOPT_BUFFERSIZE, BUFFER_SIZE/2);
+        curl_easy_setopt (curl, CURLOPT_BUFFERSIZE, min (fp->buffer_size/2, CURL_MAX_WRITE_SIZE*2));
+        if (curl_share) {
+            curl_easy_setopt (curl, CURLOPT_SHARE, curl_share);
+        }
         curl_easy_setopt (curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
         curl_easy_setopt (curl, CURLOPT_HEADERFUNCTION, http_content_header_handler);
         curl_easy_setopt (curl, CURLOPT_HEADERDATA, ctx);
@@ -597,7 +612,7 @@ http_thread_func (void *ctx) {
         headers = curl_slist_append (headers, "Icy-Metadata:1");
         curl_easy_setopt (curl, CURLOPT_HTTPHEADER, headers);
         if (fp->pos > 0 && fp->length >= 0) {
-            curl_easy_setopt (curl, CURLOPT_RESUME_FROM, (long)fp->pos);
+            curl_easy_setopt (curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)fp->pos);
         }
         if (deadbeef->conf_get_int ("network.proxy", 0)) {
             deadbeef->conf_lock ();
@@ -676,6 +691,7 @@ http_thread_func (void *ctx) {
         if (fp->status != STATUS_SEEK) {
             trace ("vfs_curl: break loop\n");
             deadbeef->mutex_unlock (fp->mutex);
+            curl_slist_free_all (headers);
             break;
         }
         else {
@@ -733,6 +749,18 @@ http_open (const char *fname) {
     http_reg_open_file ((DB_FILE *)fp);
     memset (fp, 0, sizeof (HTTP_FILE));
     fp->vfs = &plugin;
+    int64_t size = (int64_t)deadbeef->conf_get_int ("vfs_curl.buffer_size", DEFAULT_BUFFER_SIZE) * 1024;
+    fp->buffer_size = MIN_BUFFER_SIZE;
+    while (fp->buffer_size < size && fp->buffer_size < MAX_BUFFER_SIZE) {
+        fp->buffer_size <<= 1;
+    }
+    fp->buffer_mask = fp->buffer_size - 1;
+    fp->buffer = malloc (fp->buffer_size);
+    if (!fp->buffer) {
+        http_unreg_open_file ((DB_FILE *)fp);
+        free (fp);
+        return NULL;
+    }
     fp->url = strdup (fname);
     return (DB_FILE*)fp;
 }
@@ -757,8 +785,9 @@ http_close (DB_FILE *stream) {
         deadbeef->thread_join (fp->tid);
     }
     http_cancel_abort ((DB_FILE *)fp);
-    http_destroy (fp);
+    // unregister first, so that vfs_curl_stop never sees a freed file
     http_unreg_open_file ((DB_FILE *)fp);
+    http_destroy (fp);
     trace ("http_close done\n");
 }
 
@@ -813,8 +842,8 @@ http_read (void *ptr, size_t size, size_t nmemb, DB_FILE *stream) {
         deadbeef->mutex_lock (fp->mutex);
         //trace ("http_read %lld/%lld/%d\n", fp->pos, fp->length, fp->remaining);
         int cp = min (sz, fp->remaining);
-        int readpos = fp->pos & BUFFER_MASK;
-        int part1 = BUFFER_SIZE-readpos;
+        int readpos = fp->pos & fp->buffer_mask;
+        int part1 = fp->buffer_size-readpos;
         part1 = min (part1, cp);
 //        trace ("readpos=%d, remaining=%d, req=%d, cp=%d, part1=%d, part2=%d\n", readpos, fp->remaining, sz, cp, part1, cp-part1);
         memcpy (ptr, fp->buffer+readpos, part1);
@@ -872,12 +901,12 @@ http_seek (DB_FILE *stream, int64_t offset, int whence) {
             deadbeef->mutex_unlock (fp->mutex);
             return 0;
         }
-        else if (fp->pos < offset && fp->pos + BUFFER_SIZE > offset) {
+        else if (fp->pos < offset && fp->pos + fp->buffer_size > offset) {
             fp->skipbytes = offset - fp->pos;
             deadbeef->mutex_unlock (fp->mutex);
             return 0;
         }
-        else if (fp->pos-offset >= 0 && fp->pos-offset <= BUFFER_SIZE-fp->remaining) {
+        else if (fp->pos-offset >= 0 && fp->pos-offset <= fp->buffer_size-fp->remaining) {
             fp->skipbytes = 0;
             fp->remaining += fp->pos - offset;
             fp->pos = offset;
@@ -1060,16 +1089,75 @@ http_unreg_open_file (DB_FILE *fp) {
     deadbeef->mutex_unlock (biglock);
 }
 
+static void
+http_share_lock (CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    deadbeef->mutex_lock (sharelock);
+}
+
+static void
+http_share_unlock (CURL *handle, curl_lock_data data, void *userptr) {
+    deadbeef->mutex_unlock (sharelock);
+}
+
 static int
 vfs_curl_start (void) {
     allow_new_streams = 1;
     biglock = deadbeef->mutex_create ();
+    sharelock = deadbeef->mutex_create ();
+    curl_share = curl_share_init ();
+    if (curl_share) {
+        curl_share_setopt (curl_share, CURLSHOPT_LOCKFUNC, http_share_lock);
+        curl_share_setopt (curl_share, CURLSHOPT_UNLOCKFUNC, http_share_unlock);
+        curl_share_setopt (curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+#if LIBCURL_VERSION_NUM >= 0x071700
+        curl_share_setopt (curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073900
+        curl_share_setopt (curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    }
     return 0;
 }
 
 static int
 vfs_curl_stop (void) {
     allow_new_streams = 0;
+
+    // transfers which are still running use the share and the locks; abort
+    // them, and wait until their threads are done with curl.
+    // the threads are joined by http_close, which the owners of the files
+    // call, so they're only waited for here
+    int busy = 0;
+    for (int i = 0; i < TIMEOUT * 100; i++) {
+        busy = 0;
+        deadbeef->mutex_lock (biglock);
+        for (int f = 0; f < num_open_files; f++) {
+            HTTP_FILE *fp = (HTTP_FILE *)open_files[f];
+            if (fp->tid && fp->status != STATUS_FINISHED) {
+                http_abort (open_files[f]);
+                busy = 1;
+            }
+        }
+        deadbeef->mutex_unlock (biglock);
+        if (!busy) {
+            break;
+        }
+        usleep (10000);
+    }
+    if (busy) {
+        // leak rather than pull the share from under a running transfer
+        fprintf (stderr, "vfs_curl: transfers didn't stop in %d seconds, not releasing the connection cache\n", TIMEOUT);
+        return 0;
+    }
+
+    if (curl_share) {
+        curl_share_cleanup (curl_share);
+        curl_share = NULL;
+    }
+    if (sharelock) {
+        deadbeef->mutex_free (sharelock);
+        sharelock = 0;
+    }
     if (biglock) {
         deadbeef->mutex_free (biglock);
         biglock = 0;
@@ -1089,6 +1177,10 @@ http_is_streaming (void) {
     return 1;
 }
 
+static const char settings_dlg[] =
+    "property \"Buffer size (KB)\" entry vfs_curl.buffer_size 64;\n"
+;
+
 // standard stdio vfs
 static DB_vfs_t plugin = {
     .plugin.api_vmajor = 1,
@@ -1119,6 +1211,7 @@ static DB_vfs_t plugin = {
     .plugin.website = "http://deadbeef.sf.net",
     .plugin.start = vfs_curl_start,
     .plugin.stop = vfs_curl_stop,
+    .plugin.configdialog = settings_dlg,
     .open = http_open,
     .set_track = http_set_track,
     .close = http_close,
@@ -19,6 +19,7 @@
 
 #include <string.h>
 #include <zip.h>
+#include <zlib.h>
 #include <stdlib.h>
 #include <assert.h>
 #include "../../deadbeef.h"
@@ -33,6 +34,21 @@ static DB_vfs_t plugin;
 
 #define ZIP_BUFFER_SIZE 8192
 
+// distance between inflate checkpoints, in uncompressed bytes
+// each checkpoint holds a copy of the inflate state with its 32K window
+#define ZIP_CHECKPOINT_INTERVAL 0x100000
+#define ZIP_MAX_CHECKPOINTS 1024
+
+#if defined(LIBZIP_VERSION_MAJOR) && (LIBZIP_VERSION_MAJOR > 1 || (LIBZIP_VERSION_MAJOR == 1 && LIBZIP_VERSION_MINOR >= 2))
+#define HAVE_ZIP_FSEEK 1
+#endif
+
+typedef struct {
+    z_stream strm;
+    int64_t in_offset; // position in the compressed stream
+    int64_t out_offset; // position in the uncompressed stream
+} zip_checkpoint_t;
+
 typedef struct {
     DB_FILE file;
     struct zip* z;
@@ -44,6 +60,19 @@ typedef struct {
     uint8_t buffer[ZIP_BUFFER_SIZE];
     int buffer_remaining;
     int buffer_pos;
+
+    // deflated entries are read raw and inflated here, so that seeks can
+    // resume from the closest checkpoint instead of the start of file
+    int inflating;
+    z_stream strm;
+    uint8_t inbuf[ZIP_BUFFER_SIZE];
+    // zlib keeps a back pointer to the z_stream, so checkpoints must not move
+    zip_checkpoint_t **checkpoints;
+    int ncheckpoints;
+
+    // set when the stream couldn't be restarted; reads fail until a seek
+    // restarts it successfully
+    int error;
 } zip_file_t;
 
 static const char *scheme_names[] = { "zip://", NULL };
@@ -92,7 +121,9 @@ vfs_zip_open (const char *fname) {
         return NULL;
     }
 
-    struct zip_file *zf = zip_fopen_index (z, st.index, 0);
+    int inflating = st.comp_method == ZIP_CM_DEFLATE && st.encryption_method == ZIP_EM_NONE;
+
+    struct zip_file *zf = zip_fopen_index (z, st.index, inflating ? ZIP_FL_COMPRESSED : 0);
     if (!zf) {
         zip_close (z);
         return NULL;
@@ -105,6 +136,15 @@ vfs_zip_open (const char *fname) {
     f->zf = zf;
     f->index = st.index;
     f->size = st.size;
+    if (inflating) {
+        if (inflateInit2 (&f->strm, -MAX_WBITS) != Z_OK) {
+            zip_fclose (zf);
+            zip_close (z);
+            free (f);
+            return NULL;
+        }
+        f->inflating = 1;
+    }
     trace ("vfs_zip: end open %s\n", fname);
     return (DB_FILE*)f;
 }
@@ -113,6 +153,14 @@ void
 vfs_zip_close (DB_FILE *f) {
     trace ("vfs_zip: close\n");
     zip_file_t *zf = (zip_file_t *)f;
+    if (zf->inflating) {
+        inflateEnd (&zf->strm);
+        for (int i = 0; i < zf->ncheckpoints; i++) {
+            inflateEnd (&zf->checkpoints[i]->strm);
+            free (zf->checkpoints[i]);
+        }
+        free (zf->checkpoints);
+    }
     if (zf->zf) {
         zip_fclose (zf->zf);
     }
@@ -122,16 +170,138 @@ vfs_zip_close (DB_FILE *f) {
     free (zf);
 }
 
+static void
+vfs_zip_add_checkpoint (zip_file_t *zf) {
+    if (zf->ncheckpoints >= ZIP_MAX_CHECKPOINTS) {
+        return;
+    }
+    int64_t last = zf->ncheckpoints ? zf->checkpoints[zf->ncheckpoints-1]->out_offset : 0;
+    if (zf->strm.total_out < last + ZIP_CHECKPOINT_INTERVAL) {
+        return;
+    }
+    if (zf->ncheckpoints % 16 == 0) {
+        zip_checkpoint_t **cps = realloc (zf->checkpoints, (zf->ncheckpoints + 16) * sizeof (zip_checkpoint_t *));
+        if (!cps) {
+            return;
+        }
+        zf->checkpoints = cps;
+    }
+    zip_checkpoint_t *cp = malloc (sizeof (zip_checkpoint_t));
+    if (!cp) {
+        return;
+    }
+    if (inflateCopy (&cp->strm, &zf->strm) != Z_OK) {
+        free (cp);
+        return;
+    }
+    cp->in_offset = zf->strm.total_in;
+    cp->out_offset = zf->strm.total_out;
+    zf->checkpoints[zf->ncheckpoints++] = cp;
+    trace ("vfs_zip: checkpoint %d at %lld (compressed %lld)\n", zf->ncheckpoints, cp->out_offset, cp->in_offset);
+}
+
+// read uncompressed data from the current stream position
+static int
+vfs_zip_fill (zip_file_t *zf, uint8_t *buf, int size) {
+    if (!zf->inflating) {
+        return zip_fread (zf->zf, buf, size);
+    }
+    zf->strm.next_out = buf;
+    zf->strm.avail_out = size;
+    while (zf->strm.avail_out > 0) {
+        if (zf->strm.avail_in == 0) {
+            int rb = zip_fread (zf->zf, zf->inbuf, sizeof (zf->inbuf));
+            if (rb <= 0) {
+                break;
+            }
+            zf->strm.next_in = zf->inbuf;
+            zf->strm.avail_in = rb;
+        }
+        int ret = inflate (&zf->strm, Z_NO_FLUSH);
+        if (ret != Z_OK) {
+            if (ret != Z_STREAM_END) {
+                trace ("vfs_zip: inflate error %d\n", ret);
+            }
+            break;
+        }
+        vfs_zip_add_checkpoint (zf);
+    }
+    return size - zf->strm.avail_out;
+}
+
+// skip n bytes of the underlying (possibly raw compressed) zip stream
+static int
+vfs_zip_skip_raw (zip_file_t *zf, int64_t n) {
+#if HAVE_ZIP_FSEEK
+    if (n > 0 && !zip_fseek (zf->zf, n, SEEK_SET)) {
+        return 0;
+    }
+#endif
+    while (n > 0) {
+        int sz = min (n, sizeof (zf->inbuf));
+        int rb = zip_fread (zf->zf, zf->inbuf, sz);
+        if (rb <= 0) {
+            return -1;
+        }
+        n -= rb;
+    }
+    return 0;
+}
+
+// restart the stream at the given checkpoint, or at the start of file if cp is NULL
+// returns the new uncompressed stream position, or -1 on error;
+// sets zf->error on failure, and clears it on success
+static int64_t
+vfs_zip_restart (zip_file_t *zf, zip_checkpoint_t *cp) {
+    zf->error = 1;
+    if (zf->zf) {
+        zip_fclose (zf->zf);
+    }
+    zf->zf = zip_fopen_index (zf->z, zf->index, zf->inflating ? ZIP_FL_COMPRESSED : 0);
+    if (!zf->zf) {
+        return -1;
+    }
+    if (!zf->inflating) {
+        zf->error = 0;
+        return 0;
+    }
+    if (!cp) {
+        if (inflateReset (&zf->strm) != Z_OK) {
+            return -1;
+        }
+        zf->strm.avail_in = 0;
+        zf->error = 0;
+        return 0;
+    }
+    if (vfs_zip_skip_raw (zf, cp->in_offset) < 0) {
+        return -1;
+    }
+    inflateEnd (&zf->strm);
+    if (inflateCopy (&zf->strm, &cp->strm) != Z_OK) {
+        // leave a valid stream for inflateEnd and the next restart
+        inflateInit2 (&zf->strm, -MAX_WBITS);
+        return -1;
+    }
+    zf->strm.next_in = zf->inbuf;
+    zf->strm.avail_in = 0;
+    zf->error = 0;
+    return cp->out_offset;
+}
+
 size_t
 vfs_zip_read (void *ptr, size_t size, size_t nmemb, DB_FILE *f) {
     zip_file_t *zf = (zip_file_t *)f;
 //    printf ("read: %d\n", size*nmemb);
 
+    if (zf->error) {
+        return 0;
+    }
+
     int sz = size * nmemb;
     while (sz) {
         if (zf->buffer_remaining == 0) {
             zf->buffer_pos = 0;
-            int rb = zip_fread (zf->zf, zf->buffer, ZIP_BUFFER_SIZE);
+            int rb = vfs_zip_fill (zf, zf->buffer, ZIP_BUFFER_SIZE);
             if (rb <= 0) {
                 break;
             }
@@ -189,32 +359,55 @@ vfs_zip_seek (DB_FILE *f, int64_t offset, int whence) {
 //        printf ("cache miss: abs_offs: %lld, offs: %lld, rem: %d, pos: %d\n", offset, offs, zf->buffer_remaining, zf->buffer_pos);
 //    }
 
-    if (offset < zf->offset) {
-        // reopen
-        zip_fclose (zf->zf);
-        zf->zf = zip_fopen_index (zf->z, zf->index, 0);
-        if (!zf->zf) {
-            return -1;
-        }
-        zf->offset = 0;
-    }
+    // position of the underlying stream
+    int64_t pos = zf->offset + zf->buffer_remaining;
     zf->buffer_pos = 0;
     zf->buffer_remaining = 0;
-    char buf[4096];
-    int64_t n = offset - zf->offset;
-    while (n > 0) {
-        int sz = min (n, sizeof (buf));
-        ssize_t rb = zip_fread (zf->zf, buf, sz);
-        n -= rb;
-        assert (n >= 0);
-        zf->offset += rb;
-        if (rb != sz) {
+
+    if (offset < 0) {
+        return -1;
+    }
+
+#if HAVE_ZIP_FSEEK
+    // stored entries can be read directly by offset
+    if (!zf->inflating && !zf->error && !zip_fseek (zf->zf, offset, SEEK_SET)) {
+        zf->offset = offset;
+        return 0;
+    }
+#endif
+
+    // find the closest checkpoint before the target
+    zip_checkpoint_t *cp = NULL;
+    for (int i = zf->ncheckpoints-1; i >= 0; i--) {
+        if (zf->checkpoints[i]->out_offset <= offset) {
+            cp = zf->checkpoints[i];
             break;
         }
     }
-    if (n > 0) {
-        return -1;
+
+    if (zf->error || offset < pos || (cp && cp->out_offset >= pos + ZIP_CHECKPOINT_INTERVAL)) {
+        pos = vfs_zip_restart (zf, cp);
+        if (pos < 0) {
+            return -1;
+        }
+    }
+
+    // read forward, keeping the tail of the last block in the buffer
+    zf->offset = pos;
+    while (pos < offset) {
+        int rb = vfs_zip_fill (zf, zf->buffer, ZIP_BUFFER_SIZE);
+        if (rb <= 0) {
+            zf->offset = pos;
+            return -1;
+        }
+        if (pos + rb > offset) {
+            zf->buffer_pos = offset - pos;
+            zf->buffer_remaining = rb - zf->buffer_pos;
+            break;
+        }
+        pos += rb;
     }
+    zf->offset = offset;
     return 0;
 }
 
@@ -227,10 +420,11 @@ vfs_zip_tell (DB_FILE *f) {
 void
 vfs_zip_rewind (DB_FILE *f) {
     zip_file_t *zf = (zip_file_t *)f;
-    zip_fclose (zf->zf);
-    zf->zf = zip_fopen_index (zf->z, zf->index, 0);
-    assert (zf->zf); // FIXME: better error handling?
+    if (vfs_zip_restart (zf, NULL) < 0) {
+        trace ("vfs_zip: failed to rewind\n");
+    }
     zf->offset = 0;
+    zf->buffer_pos = 0;
     zf->buffer_remaining = 0;
 }
 
@@ -311,16 +311,21 @@ cvorbis_free (DB_fileinfo_t *_info) {
     }
 }
 
-static int
-cvorbis_read (DB_fileinfo_t *_info, char *bytes, int size) {
-    ogg_info_t *info = (ogg_info_t *)_info;
-//    trace ("cvorbis_read %d bytes\n", size);
-
-    _info->fmt.channels = info->vi->channels;
-    _info->fmt.samplerate = info->vi->rate;
-
-    int samplesize = _info->fmt.channels * _info->fmt.bps / 8;
+// vorbis channel order -> wav channel order, indexed by channels-3
+static const int remap[6][8] = {
+    {0,2,1},
+    {0,1,2,3}, // should not be used
+    {0,2,1,3,4},
+    {0,2,1,4,5,3},
+    {0,2,1,4,5,6,3},
+    {0,2,1,6,7,4,5,3}
+};
 
+// common part of read and read_float: truncates the request to the track
+// end, and refreshes stream comments; returns the number of bytes to read
+static int
+cvorbis_read_prepare (ogg_info_t *info, int size, int samplesize) {
+    DB_fileinfo_t *_info = &info->info;
     if (!info->info.file->vfs->is_streaming ()) {
         if (info->currentsample + size / samplesize > info->endsample) {
             size = (info->endsample - info->currentsample + 1) * samplesize;
@@ -348,6 +353,23 @@ cvorbis_read (DB_fileinfo_t *_info, char *bytes, int size) {
             }
         }
     }
+    return size;
+}
+
+static int
+cvorbis_read (DB_fileinfo_t *_info, char *bytes, int size) {
+    ogg_info_t *info = (ogg_info_t *)_info;
+//    trace ("cvorbis_read %d bytes\n", size);
+
+    _info->fmt.channels = info->vi->channels;
+    _info->fmt.samplerate = info->vi->rate;
+
+    int samplesize = _info->fmt.channels * _info->fmt.bps / 8;
+
+    size = cvorbis_read_prepare (info, size, samplesize);
+    if (size <= 0) {
+        return 0;
+    }
 //    trace ("cvorbis_read %d bytes[2]\n", size);
     int initsize = size;
     long ret;
@@ -368,14 +390,6 @@ cvorbis_read (DB_fileinfo_t *_info, char *bytes, int size) {
             if (ret > 0) {
                 // remap channels to wav format
                 int idx = _info->fmt.channels - 3;
-                static int remap[6][8] = {
-                    {0,2,1},
-                    {0,1,2,3}, // should not be used
-                    {0,2,1,3,4},
-                    {0,2,1,4,5,3},
-                    {0,2,1,4,5,6,3},
-                    {0,2,1,6,7,4,5,3}
-                };
 
                 if (_info->fmt.channels > 8) {
                     fprintf (stderr, "vorbis plugin doesn't support more than 8 channels\n");
@@ -433,6 +447,60 @@ cvorbis_read (DB_fileinfo_t *_info, char *bytes, int size) {
     return initsize - size;
 }
 
+// vorbisfile decodes to planar float internally; ov_read_float hands out
+// those planes directly, so interleaving them here skips the round trip
+// through 16 bit integers
+static int
+cvorbis_read_float (DB_fileinfo_t *_info, float *buffer, int size) {
+    ogg_info_t *info = (ogg_info_t *)_info;
+
+    _info->fmt.channels = info->vi->channels;
+    _info->fmt.samplerate = info->vi->rate;
+
+    int nchannels = _info->fmt.channels;
+    if (nchannels > 8) {
+        fprintf (stderr, "vorbis plugin doesn't support more than 8 channels\n");
+        return -1;
+    }
+
+    int samplesize = nchannels * sizeof (float);
+
+    size = cvorbis_read_prepare (info, size, samplesize);
+    if (size <= 0) {
+        return 0;
+    }
+    int initsize = size;
+    int nframes = size / samplesize;
+    const int *map = (nchannels <= 2 || nchannels == 4) ? NULL : remap[nchannels - 3];
+    while (nframes > 0) {
+        float **pcm;
+        long ret = ov_read_float (&info->vorbis_file, &pcm, nframes, &info->cur_bit_stream);
+        if (ret == OV_HOLE) {
+            trace ("OV_HOLE\n");
+            continue;
+        }
+        if (ret <= 0) {
+            // error or eof
+            break;
+        }
+        for (int c = 0; c < nchannels; c++) {
+            const float *in = pcm[c];
+            float *out = buffer + (map ? map[c] : c);
+            for (long i = 0; i < ret; i++) {
+                *out = in[i];
+                out += nchannels;
+            }
+        }
+        buffer += ret * nchannels;
+        nframes -= ret;
+        size -= ret * samplesize;
+        info->currentsample += ret;
+    }
+    _info->readpos = (float)(ov_pcm_tell(&info->vorbis_file)-info->startsample)/info->vi->rate;
+    deadbeef->streamer_set_bitrate (ov_bitrate (&info->vorbis_file, info->cur_bit_stream)/1000);
+    return initsize - size;
+}
+
 static int
 cvorbis_seek_sample (DB_fileinfo_t *_info, int sample) {
     ogg_info_t *info = (ogg_info_t *)_info;
@@ -791,7 +859,7 @@ static const char * exts[] = { "ogg", "ogx", "oga", NULL };
 // define plugin interface
 static DB_decoder_t plugin = {
     .plugin.api_vmajor = 1,
-    .plugin.api_vminor = 0,
+    .plugin.api_vminor = 7,
     .plugin.version_major = 1,
     .plugin.version_minor = 0,
     .plugin.type = DB_PLUGIN_DECODER,
@@ -822,14 +890,13 @@ static DB_decoder_t plugin = {
     .init = cvorbis_init,
     .free = cvorbis_free,
     .read = cvorbis_read,
-    // vorbisfile can't output float32
-//    .read_float32 = cvorbis_read_float32,
     .seek = cvorbis_seek,
     .seek_sample = cvorbis_seek_sample,
     .insert = cvorbis_insert,
     .read_metadata = cvorbis_read_metadata,
     .write_metadata = cvorbis_write_metadata,
-    .exts = exts
+    .exts = exts,
+    .read_float = cvorbis_read_float,
 };
 
 DB_plugin_t *
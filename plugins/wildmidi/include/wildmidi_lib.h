@@ -52,5 +52,9 @@ extern struct _WM_Info * WildMidi_GetInfo ( midi * handle );
 extern int WildMidi_FastSeek ( midi * handle, unsigned long int *sample_pos);
 extern int WildMidi_SampledSeek ( midi * handle, unsigned long int *sample_pos);
 extern int WildMidi_Close (midi * handle);
+/* keeps up to size bytes of unused patch samples loaded between midis */
+extern int WildMidi_SetPatchCache (unsigned long int size);
+/* loads all patches of the config into the patch cache, until it's full */
+extern int WildMidi_PreloadPatches (volatile int *abort);
 extern int WildMidi_Shutdown ( void );
 // extern void WildMidi_ReverbSet(midi * handle, float width, float wet, float dry, float damp, float roomsize);
@@ -170,6 +170,12 @@ signed short int WM_MasterVolume = 948;
 unsigned short int WM_SampleRate = 0;
 unsigned short int WM_MixerOptions = 0;
 
+/* patches which no open midi uses stay loaded, up to this many bytes of
+ * sample data, so that the next midi doesn't have to load them again */
+unsigned long int WM_PatchCacheSize = 0;
+unsigned long int WM_PatchCacheUsed = 0;
+unsigned long int WM_PatchCacheStamp = 0;
+
 char WM_Version[] = "WildMidi Processing Library " WILDMIDILIB_VERSION;
 
 struct _lowpass {
@@ -222,6 +228,8 @@ struct _patch {
 	struct _env env[6];
 	unsigned char note;
 	unsigned long int inuse_count;
+	unsigned long int size; /* bytes of sample data, when loaded */
+	unsigned long int last_used; /* for evicting from the patch cache */
 	struct _sample *first_sample;
 	struct _patch *next;
 };
@@ -444,6 +452,8 @@ struct _hndl {
 };
 
 struct _hndl * first_handle = NULL;
+/* protects first_handle, handles are opened and closed from several threads */
+int handle_lock;
 
 //f: ( VOLUME / 127 )
 //f: pow(( VOLUME / 127 ), 1.660964047 )
@@ -674,12 +684,8 @@ WM_BufferFile (const char *filename, unsigned long int *size) {
 static inline void
 WM_Lock (int * wmlock) {
 	LOCK_START:
-	if (__builtin_expect(((*wmlock) == 0),1)) {
-		(*wmlock)++;
-		if (__builtin_expect(((*wmlock) == 1), 1)) {
-			return;
-		}
-		(*wmlock)--;
+	if (__builtin_expect(__sync_bool_compare_and_swap(wmlock, 0, 1), 1)) {
+		return;
 	}
 #ifdef _WIN32
 	Sleep(10);
@@ -691,7 +697,7 @@ WM_Lock (int * wmlock) {
 
 static inline void
 WM_Unlock (int *wmlock) {
-	(*wmlock)--;
+	__sync_lock_release(wmlock);
 }
 
 void
@@ -730,6 +736,7 @@ WM_FreePatches ( void ) {
 			}
 		}
 	}
+	WM_PatchCacheUsed = 0;
 	WM_Unlock(&patch_lock);
 }
 
@@ -2331,6 +2338,69 @@ load_sample (struct _patch *sample_patch) {
 }
 
 
+/* patch cache, all of these are called with patch_lock held */
+
+static void
+free_patch_samples (struct _patch *sample_patch) {
+	struct _sample *tmp_sample;
+
+	while (sample_patch->first_sample != NULL) {
+		tmp_sample = sample_patch->first_sample->next;
+		if (sample_patch->first_sample->data)
+			free(sample_patch->first_sample->data);
+		free(sample_patch->first_sample);
+		sample_patch->first_sample = tmp_sample;
+	}
+	sample_patch->loaded = 0;
+}
+
+static void
+set_patch_size (struct _patch *sample_patch) {
+	struct _sample *tmp_sample = sample_patch->first_sample;
+
+	sample_patch->size = 0;
+	while (tmp_sample != NULL) {
+		sample_patch->size += sizeof(struct _sample) + ((tmp_sample->data_length >> 10) + 1) * sizeof(signed short int);
+		tmp_sample = tmp_sample->next;
+	}
+}
+
+/* frees least recently used patches until the unused ones fit the cache */
+static void
+trim_patch_cache (void) {
+	int i;
+	struct _patch *tmp_patch;
+	struct _patch *oldest;
+
+	while (WM_PatchCacheUsed > WM_PatchCacheSize) {
+		oldest = NULL;
+		for (i = 0; i < 128; i++) {
+			for (tmp_patch = patch[i]; tmp_patch != NULL; tmp_patch = tmp_patch->next) {
+				if (tmp_patch->inuse_count == 0 && tmp_patch->first_sample != NULL && (oldest == NULL || tmp_patch->last_used < oldest->last_used)) {
+					oldest = tmp_patch;
+				}
+			}
+		}
+		if (oldest == NULL) {
+			WM_PatchCacheUsed = 0;
+			break;
+		}
+		WM_PatchCacheUsed -= oldest->size;
+		free_patch_samples(oldest);
+	}
+}
+
+/* the patch is no longer used by any midi */
+static void
+release_patch (struct _patch *sample_patch) {
+	if (sample_patch->first_sample == NULL) {
+		return;
+	}
+	sample_patch->last_used = ++WM_PatchCacheStamp;
+	WM_PatchCacheUsed += sample_patch->size;
+	trim_patch_cache();
+}
+
 struct _patch *
 get_patch_data(struct _mdi *mdi, unsigned short patchid) {
 	struct _patch *search_patch;
@@ -2381,6 +2451,10 @@ load_patch (struct _mdi *mdi, unsigned short patchid) {
 			WM_Unlock(&patch_lock);
 			return;
 		}
+		set_patch_size(tmp_patch);
+	} else if (tmp_patch->inuse_count == 0 && tmp_patch->first_sample != NULL) {
+		/* taken from the patch cache */
+		WM_PatchCacheUsed -= tmp_patch->size;
 	}
 	
 	if (tmp_patch->first_sample == NULL) {
@@ -3496,9 +3570,11 @@ WM_ParseNewMidi(unsigned char *mididata, unsigned long int midisize ) {
 
 	tmp_trackdata = calloc(no_tracks, sizeof(struct _miditrack));
 
+	WM_Lock(&handle_lock);
 	if (first_handle == NULL) {
 		first_handle = malloc(sizeof(struct _hndl));
 		if (first_handle == NULL) {
+			WM_Unlock(&handle_lock);
 			WM_ERROR(__FUNCTION__, __LINE__, WM_ERR_MEM," to parse midi data", errno);
 			free (tmp_trackdata);
 			free(mdi->data);
@@ -3516,6 +3592,7 @@ WM_ParseNewMidi(unsigned char *mididata, unsigned long int midisize ) {
 		}
 		tmp_handle->next = malloc(sizeof(struct _hndl));
 		if (tmp_handle->next == NULL) {
+			WM_Unlock(&handle_lock);
 			WM_ERROR(__FUNCTION__, __LINE__, WM_ERR_MEM," to parse midi data", errno);
             free(tmp_trackdata);
 			free(mdi->data);
@@ -3527,6 +3604,7 @@ WM_ParseNewMidi(unsigned char *mididata, unsigned long int midisize ) {
 		tmp_handle->next = NULL;
 		tmp_handle->handle = (void *)mdi;
 	}
+	WM_Unlock(&handle_lock);
 
 
 	// grab track offsets;
@@ -3754,6 +3832,7 @@ WildMidi_Init (const char * config_file, unsigned short int rate, unsigned short
 	WM_SampleRate = rate;
 	WM_Initialized = 1;
 	patch_lock = 0;
+	handle_lock = 0;
 	
 	init_gauss();
 	init_lowpass();
@@ -3763,7 +3842,7 @@ WildMidi_Init (const char * config_file, unsigned short int rate, unsigned short
 int
 WildMidi_MasterVolume (unsigned char master_volume) {
 	struct _mdi *mdi = NULL;
-	struct _hndl * tmp_handle = first_handle;
+	struct _hndl * tmp_handle;
 	int i = 0;
 
 	if (!WM_Initialized) {
@@ -3777,6 +3856,8 @@ WildMidi_MasterVolume (unsigned char master_volume) {
 	
 	WM_MasterVolume = lin_volume[master_volume];
 
+	WM_Lock(&handle_lock);
+	tmp_handle = first_handle;
 	if (tmp_handle != NULL) {
 		while(tmp_handle != NULL) {
 			mdi = (struct _mdi *)tmp_handle->handle;
@@ -3786,6 +3867,7 @@ WildMidi_MasterVolume (unsigned char master_volume) {
 			tmp_handle = tmp_handle->next;
 		}
 	}
+	WM_Unlock(&handle_lock);
 	
 	return 0;
 }
@@ -3794,7 +3876,6 @@ int
 WildMidi_Close (midi * handle) {
 	struct _mdi *mdi = (struct _mdi *)handle;
 	struct _hndl * tmp_handle;
-	struct _sample *tmp_sample;
 	int i;
 
 	if (!WM_Initialized) {
@@ -3805,11 +3886,14 @@ WildMidi_Close (midi * handle) {
 		WM_ERROR(__FUNCTION__, __LINE__, WM_ERR_INVALID_ARG, "(NULL handle)", 0);
 		return -1;
 	}
+	WM_Lock(&mdi->lock);
+	WM_Lock(&handle_lock);
 	if (first_handle == NULL) {
+		WM_Unlock(&handle_lock);
+		WM_Unlock(&mdi->lock);
 		WM_ERROR(__FUNCTION__, __LINE__, WM_ERR_INVALID_ARG, "(no midi's open)", 0);
 		return -1;
 	}
-	WM_Lock(&mdi->lock);
 	if (first_handle->handle == handle) {
 		tmp_handle = first_handle->next;
 		free (first_handle);
@@ -3821,6 +3905,8 @@ WildMidi_Close (midi * handle) {
 		while (tmp_handle->handle != handle) {
 			tmp_handle = tmp_handle->next;
 			if (tmp_handle == NULL) {
+				WM_Unlock(&handle_lock);
+				WM_Unlock(&mdi->lock);
 				WM_ERROR(__FUNCTION__, __LINE__, WM_ERR_INVALID_ARG, "(handle does not exist)", 0);
 				return -1;
 			}
@@ -3831,23 +3917,15 @@ WildMidi_Close (midi * handle) {
 		}
 		free (tmp_handle);
 	}
+	WM_Unlock(&handle_lock);
 	
 	if (mdi->patch_count != 0) {
 		WM_Lock(&patch_lock);
 		for (i = 0; i < mdi->patch_count; i++) {
 			mdi->patches[i]->inuse_count--;
 			if (mdi->patches[i]->inuse_count == 0) {
-				//free samples here
-				if (mdi->patches[i]->first_sample != NULL) {
-					while (mdi->patches[i]->first_sample != NULL) {
-						tmp_sample = mdi->patches[i]->first_sample->next;
-						if (mdi->patches[i]->first_sample->data)
-							free(mdi->patches[i]->first_sample->data);
-						free(mdi->patches[i]->first_sample);
-						mdi->patches[i]->first_sample = tmp_sample;
-					}
-					mdi->patches[i]->loaded = 0;
-				}
+				//keep the samples in the patch cache, or free them
+				release_patch(mdi->patches[i]);
 			}
 		}
 		WM_Unlock(&patch_lock);
@@ -5073,22 +5151,75 @@ WildMidi_GetInfo (midi * handle) {
 	return mdi->tmp_info;
 }
 
+int
+WildMidi_SetPatchCache (unsigned long int size) {
+	if (!WM_Initialized) {
+		WM_ERROR(__FUNCTION__, __LINE__, WM_ERR_NOT_INIT, NULL, 0);
+		return -1;
+	}
+	WM_Lock(&patch_lock);
+	WM_PatchCacheSize = size;
+	trim_patch_cache();
+	WM_Unlock(&patch_lock);
+	return 0;
+}
+
+int
+WildMidi_PreloadPatches (volatile int *abort) {
+	int i;
+	struct _patch *tmp_patch;
+
+	if (!WM_Initialized) {
+		WM_ERROR(__FUNCTION__, __LINE__, WM_ERR_NOT_INIT, NULL, 0);
+		return -1;
+	}
+	for (i = 0; i < 128; i++) {
+		WM_Lock(&patch_lock);
+		tmp_patch = patch[i];
+		while (tmp_patch != NULL) {
+			if (abort != NULL && *abort) {
+				WM_Unlock(&patch_lock);
+				return 0;
+			}
+			if (WM_PatchCacheUsed >= WM_PatchCacheSize) {
+				WM_Unlock(&patch_lock);
+				return 0;
+			}
+			if (!tmp_patch->loaded && tmp_patch->filename != NULL) {
+				if (load_sample(tmp_patch) == 0) {
+					set_patch_size(tmp_patch);
+					if (tmp_patch->inuse_count == 0) {
+						release_patch(tmp_patch);
+					}
+				}
+			}
+			tmp_patch = tmp_patch->next;
+		}
+		WM_Unlock(&patch_lock);
+	}
+	return 0;
+}
+
 int
 WildMidi_Shutdown ( void ) {
-	struct _hndl * tmp_hdle;
+	struct _mdi * tmp_mdi;
 
 	if (!WM_Initialized) {
 		WM_ERROR(__FUNCTION__, __LINE__, WM_ERR_NOT_INIT, NULL, 0);
 		return -1;
 	}
-	if (first_handle != NULL) {
-		while (first_handle != NULL) {
-			tmp_hdle = first_handle->next;
-			WildMidi_Close((struct _mdi *)first_handle->handle);
-			free (first_handle);
-			first_handle = tmp_hdle;			
+	/* WildMidi_Close takes handle_lock and unlinks the handle itself */
+	WM_Lock(&handle_lock);
+	while (first_handle != NULL) {
+		tmp_mdi = (struct _mdi *)first_handle->handle;
+		WM_Unlock(&handle_lock);
+		if (WildMidi_Close(tmp_mdi) != 0) {
+			WM_Lock(&handle_lock);
+			break;
 		}
+		WM_Lock(&handle_lock);
 	}
+	WM_Unlock(&handle_lock);
 	WM_FreePatches();
 	free_gauss ();
 	WM_Initialized = 0;
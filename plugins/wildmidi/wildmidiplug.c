@@ -41,6 +41,9 @@ typedef struct {
     midi *m;
 } wmidi_info_t;
 
+static intptr_t preload_tid;
+static volatile int preload_abort;
+
 DB_fileinfo_t *
 wmidi_open (uint32_t hints) {
     DB_fileinfo_t *_info = (DB_fileinfo_t *)malloc (sizeof (wmidi_info_t));
@@ -131,6 +134,11 @@ wmidi_insert (ddb_playlist_t *plt, DB_playItem_t *after, const char *fname) {
 
 #define DEFAULT_TIMIDITY_CONFIG "/etc/timidity++/timidity-freepats.cfg:/etc/timidity/freepats.cfg:/etc/timidity/freepats/freepats.cfg"
 
+static void
+wmidi_preload_thread (void *ctx) {
+    WildMidi_PreloadPatches (&preload_abort);
+}
+
 int
 wmidi_start (void) {
     char config_files[1000];
@@ -158,7 +166,19 @@ wmidi_start (void) {
         p = e;
     }
     if (*config) {
-        WildMidi_Init (config, 44100, 0);
+        if (!WildMidi_Init (config, 44100, 0)) {
+            // patches stay loaded between tracks; samples are stored at
+            // their own rate and resampled while mixing, so they can be
+            // shared by all midis
+            int cache_mb = deadbeef->conf_get_int ("wildmidi.patch_cache", 64);
+            if (cache_mb > 0) {
+                WildMidi_SetPatchCache (cache_mb * 1024UL * 1024UL);
+                if (deadbeef->conf_get_int ("wildmidi.preload", 0)) {
+                    preload_abort = 0;
+                    preload_tid = deadbeef->thread_start_low_priority (wmidi_preload_thread, NULL);
+                }
+            }
+        }
     }
     else {
         fprintf (stderr, _("wildmidi: freepats config file not found. Please install timidity-freepats package, or specify path to freepats.cfg in the plugin settings."));
@@ -168,6 +188,11 @@ wmidi_start (void) {
 
 int
 wmidi_stop (void) {
+    if (preload_tid) {
+        preload_abort = 1;
+        deadbeef->thread_join (preload_tid);
+        preload_tid = 0;
+    }
     WildMidi_Shutdown ();
     return 0;
 }
@@ -182,6 +207,8 @@ static const char *exts[] = { "mid",NULL };
 
 static const char settings_dlg[] =
     "property \"Timidity++ bank configuration file\" file wildmidi.config \"" DEFAULT_TIMIDITY_CONFIG "\";\n"
+    "property \"Patch cache size (MB, 0 to disable)\" entry wildmidi.patch_cache 64;\n"
+    "property \"Load all patches on start\" checkbox wildmidi.preload 0;\n"
 ;
 // define plugin interface
 DB_decoder_t wmidi_plugin = {
@@ -41,7 +41,7 @@ for i in nullout cdda flac alsa mpgmad hotkeys vtx \
 	 lastfm sid adplug sndfile artwork alac \
 	 supereq gme dumb notify musepack wildmidi \
 	 tta dca aac mms shn ao shellexec vfs_zip \
-	 m3u converter pulse dsp_libsrc mono2stereo wma ; do
+	 m3u converter pulse dsp_libsrc mono2stereo wma rg_scanner ; do
     if [ -f ./plugins/$i/.libs/$i.so ]; then
 		 cp ./plugins/$i/.libs/$i.so $PLUGDIR/
 	elif [ -f ./plugins/$i/$i.so ]; then
@@ -48,6 +48,7 @@ cp ./plugins/soundtouch/ddb_soundtouch.so $PREFIX/lib/deadbeef/
 cp ./plugins/vfs_zip/.libs/vfs_zip.so $PREFIX/lib/deadbeef/
 cp ./plugins/medialib/.libs/medialib.so $PREFIX/lib/deadbeef/
 cp ./plugins/mono2stereo/.libs/ddb_mono2stereo.so $PREFIX/lib/deadbeef/
+cp ./plugins/rg_scanner/.libs/rg_scanner.so $PREFIX/lib/deadbeef/
 cp ./plugins/alac/.libs/alac.so $PREFIX/lib/deadbeef/
 cp ./plugins/wma/.libs/wma.so $PREFIX/lib/deadbeef/
 cp ./plugins/pltbrowser/.libs/pltbrowser_gtk2.so $PREFIX/lib/deadbeef/
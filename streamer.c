@@ -49,6 +49,9 @@
 #include "replaygain.h"
 #include "fft.h"
 #include "handler.h"
+#include "dsppipe.h"
+#include "perf.h"
+#include "noalloc.h"
 #include "plugins/libparser/parser.h"
 #include "strdupa.h"
 
@@ -70,6 +73,9 @@ streamer_read_async (char *bytes, int size);
 static int
 streamer_set_output_format (void);
 
+static int
+streamer_output_delay (DB_output_t *output);
+
 static intptr_t streamer_tid;
 static ddb_dsp_context_t *dsp_chain;
 static float dsp_ratio = 1;
@@ -79,6 +85,22 @@ static ddb_dsp_context_t *eq;
 
 static int dsp_on = 0;
 
+// optional pipelined execution of the dsp chain, see dsppipe.h
+static dsppipe_t *dsp_pipe;
+static int conf_dsp_pipeline = 0;
+static DB_fileinfo_t *dsp_pipe_fileinfo; // the stream which the queued blocks came from
+static int dsp_pipe_eof; // the decoder is done, but the pipe is not drained yet
+
+// perf counters; the decoder one is looked up when the decoder changes, the
+// dsp ones, indexed by position in the chain, when the chain changes
+#define MAX_PERF_DSP 32
+static DB_decoder_t *perf_decoder;
+static uintptr_t perf_decoder_read;
+static uintptr_t perf_dsp_process[MAX_PERF_DSP];
+static uintptr_t perf_pcm_convert;
+static uintptr_t perf_replaygain;
+static uintptr_t perf_streamer_read;
+
 static int autoconv_8_to_16 = 1;
 
 static int autoconv_16_to_24 = 0;
@@ -103,6 +125,17 @@ static int streaming_terminate;
 #define READBUFFER_SIZE (MAX_BLOCK_SIZE * MAX_DSP_RATIO)
 static char readbuffer[READBUFFER_SIZE];
 
+// scratch memory for decoding and converting one block in
+// streamer_read_async, sized for MAX_BLOCK_SIZE bytes of output in the
+// current input/output formats, so that nothing is allocated per block;
+// only touched by the streamer thread, with decodemutex locked
+static char *scratch_input; // pcm in the input format
+static int scratch_input_size; // in bytes
+static float *scratch_dsp; // float samples, with room for MAX_DSP_RATIO
+static int scratch_dsp_size; // in bytes
+static ddb_waveformat_t scratch_input_fmt;
+static ddb_waveformat_t scratch_output_fmt;
+
 static ringbuf_t streamer_ringbuf;
 static char streambuffer[STREAM_BUFFER_SIZE];
 
@@ -124,6 +157,15 @@ static playlist_t *streamer_playlist;
 static playItem_t *playing_track;
 static float playtime; // total playtime of playing track
 static time_t started_timestamp; // result of calling time(NULL)
+
+// events of a gapless track switch are held back until the output has
+// played what it buffered of the previous track, see streamer_push_event;
+// protected by pl_lock, since the events are sent with it held too
+#define MAX_DEFERRED_EVENTS 4
+static ddb_event_t *deferred_events[MAX_DEFERRED_EVENTS];
+static int num_deferred_events;
+static int deferred_events_bytes; // output data to play before sending them
+static int defer_events; // set while the events of a gapless switch are sent
 static playItem_t *streaming_track;
 static playItem_t *playlist_track;
 
@@ -147,6 +189,21 @@ static float audio_data[DDB_FREQ_BANDS * 2 * DDB_FREQ_MAX_CHANNELS];
 static int audio_data_fill = 0;
 static int audio_data_channels = 0;
 
+// recent output in float, to give vis plugins the data which is being heard
+// rather than the data which was just passed to the output
+#define VIS_HISTORY_SEC 2
+static float *vis_history;
+static int vis_history_size; // in frames
+static int vis_history_pos; // next frame to write
+static int vis_history_fill;
+static int vis_history_channels;
+static int vis_history_samplerate;
+
+// float copy of the output for vis plugins, converted in blocks of this size
+#define VIS_BLOCK_FRAMES 4096
+static float *vis_scratch;
+static int vis_scratch_channels;
+
 // message queue
 static struct handler_s *handler;
 
@@ -217,6 +274,68 @@ streamer_set_replaygain (playItem_t *it) {
     replaygain_set_values (albumgain, albumpeak, trackgain, trackpeak);
 }
 
+// sends the deferred events, with the start time of the new track moved to
+// the moment it's heard
+void
+streamer_send_deferred_events (void) {
+    pl_lock ();
+    if (!num_deferred_events) {
+        pl_unlock ();
+        return;
+    }
+    time_t now = time (NULL);
+    for (int i = 0; i < num_deferred_events; i++) {
+        ddb_event_t *ev = deferred_events[i];
+        if (ev->event == DB_EV_SONGSTARTED) {
+            ((ddb_event_track_t *)ev)->started_timestamp = now;
+            started_timestamp = now;
+        }
+        messagepump_push_event (ev, 0, 0);
+    }
+    num_deferred_events = 0;
+    deferred_events_bytes = 0;
+    pl_unlock ();
+}
+
+// drops the events which were never sent, at exit
+static void
+streamer_free_deferred_events (void) {
+    pl_lock ();
+    for (int i = 0; i < num_deferred_events; i++) {
+        messagepump_event_free (deferred_events[i]);
+        deferred_events[i] = NULL;
+    }
+    num_deferred_events = 0;
+    deferred_events_bytes = 0;
+    pl_unlock ();
+}
+
+static void
+streamer_push_event (ddb_event_t *ev) {
+    pl_lock ();
+    if (defer_events && num_deferred_events < MAX_DEFERRED_EVENTS) {
+        deferred_events[num_deferred_events++] = ev;
+        pl_unlock ();
+        return;
+    }
+    // keep the order
+    streamer_send_deferred_events ();
+    messagepump_push_event (ev, 0, 0);
+    pl_unlock ();
+}
+
+// playtime without the data which the output buffered, but didn't play yet;
+// on a gapless switch all of it gets played, so it counts
+static float
+streamer_heard_playtime (void) {
+    DB_output_t *output = plug_get_output ();
+    if (defer_events || !output || output->fmt.samplerate <= 0) {
+        return playtime;
+    }
+    float t = playtime - (float)streamer_output_delay (output) / output->fmt.samplerate;
+    return t > 0 ? t : 0;
+}
+
 static void
 send_songstarted (playItem_t *trk) {
     ddb_event_track_t *pev = (ddb_event_track_t *)messagepump_event_alloc (DB_EV_SONGSTARTED);
@@ -224,7 +343,7 @@ send_songstarted (playItem_t *trk) {
     pl_item_ref (trk);
     pev->playtime = 0;
     pev->started_timestamp = time(NULL);
-    messagepump_push_event ((ddb_event_t*)pev, 0, 0);
+    streamer_push_event ((ddb_event_t*)pev);
 }
 
 static void
@@ -232,15 +351,15 @@ send_songfinished (playItem_t *trk) {
     ddb_event_track_t *pev = (ddb_event_track_t *)messagepump_event_alloc (DB_EV_SONGFINISHED);
     pev->track = DB_PLAYITEM (trk);
     pl_item_ref (trk);
-    pev->playtime = playtime;
+    pev->playtime = streamer_heard_playtime ();
     pev->started_timestamp = started_timestamp;
-    messagepump_push_event ((ddb_event_t*)pev, 0, 0);
+    streamer_push_event ((ddb_event_t*)pev);
 }
 
 static void
 send_trackchanged (playItem_t *from, playItem_t *to) {
     ddb_event_trackchange_t *event = (ddb_event_trackchange_t *)messagepump_event_alloc (DB_EV_SONGCHANGED);
-    event->playtime = playtime;
+    event->playtime = streamer_heard_playtime ();
     event->started_timestamp = started_timestamp;
     if (from) {
         pl_item_ref (from);
@@ -250,7 +369,7 @@ send_trackchanged (playItem_t *from, playItem_t *to) {
     }
     event->from = (DB_playItem_t *)from;
     event->to = (DB_playItem_t *)to;
-    messagepump_push_event ((ddb_event_t *)event, 0, 0);
+    streamer_push_event ((ddb_event_t *)event);
 }
 
 void
@@ -353,7 +472,7 @@ send_trackinfochanged (playItem_t *track) {
     if (track) {
         pl_item_ref (track);
     }
-    messagepump_push_event ((ddb_event_t*)ev, 0, 0);
+    streamer_push_event ((ddb_event_t*)ev);
 }
 
 int
@@ -883,10 +1002,13 @@ streamer_set_current (playItem_t *it) {
     if (!decoder_id[0] && (!strcmp (filetype, "content") || !filetype[0])) {
         // try to get content-type
         mutex_lock (decodemutex);
-        trace ("\033[0;34mopening file %s\033[37;0m\n", pl_find_meta (it, ":URI"));
+        // copy the uri and open outside of pl_lock, since network streams
+        // may block in vfs_fopen for a long time
         pl_lock ();
-        DB_FILE *fp = streamer_file = vfs_fopen (pl_find_meta (it, ":URI"));
+        char *uri = strdupa (pl_find_meta (it, ":URI"));
         pl_unlock ();
+        trace ("\033[0;34mopening file %s\033[37;0m\n", uri);
+        DB_FILE *fp = streamer_file = vfs_fopen (uri);
         mutex_unlock (decodemutex);
         trace ("\033[0;34mgetting content-type\033[37;0m\n");
         if (!fp) {
@@ -1184,13 +1306,32 @@ error:
     return err;
 }
 
+// number of frames which were passed to the output, but not heard yet
+static int
+streamer_output_delay (DB_output_t *output) {
+    if (!output || output->plugin.api_vminor < 7 || !output->get_delay) {
+        return 0;
+    }
+    int delay = output->get_delay ();
+    return delay > 0 ? delay : 0;
+}
+
 float
 streamer_get_playpos (void) {
     float seek = seekpos;
     if (seek >= 0) {
         return seek;
     }
-    return playpos;
+    // the output is behind by the amount of data it buffers
+    float pos = playpos;
+    DB_output_t *output = plug_get_output ();
+    if (output && output->fmt.samplerate > 0) {
+        pos -= (float)streamer_output_delay (output) / output->fmt.samplerate * dsp_ratio;
+        if (pos < 0) {
+            pos = 0;
+        }
+    }
+    return pos;
 }
 
 void
@@ -1351,6 +1492,7 @@ streamer_start_new_song (void) {
             }
         }
         output->pause ();
+        streamer_send_deferred_events ();
     }
 }
 
@@ -1426,6 +1568,8 @@ streamer_thread (void *ctx) {
             continue;
         }
         else if (output->state () == OUTPUT_STATE_STOPPED) {
+            // nothing plays the data the deferred events wait for
+            streamer_send_deferred_events ();
             usleep (50000);
             continue;
         }
@@ -1445,6 +1589,16 @@ streamer_thread (void *ctx) {
             //playItem_t *to = streaming_track;
             trace ("sending songchanged\n");
             bytes_until_next_song = -1;
+            // the output is still playing the end of the previous track,
+            // the events are sent from streamer_read once it's heard
+            streamer_send_deferred_events ();
+            int delay = streamer_output_delay (output);
+            if (delay > 0) {
+                pl_lock ();
+                defer_events = 1;
+                deferred_events_bytes = delay * (output->fmt.bps >> 3) * output->fmt.channels;
+                pl_unlock ();
+            }
             // plugin will get pointer to str_playing_song
             if (playing_track) {
                 trace ("sending songfinished to plugins [2]\n");
@@ -1456,6 +1610,9 @@ streamer_thread (void *ctx) {
             trace ("songstarted %s\n", playing_track ? pl_find_meta (playing_track, ":URI") : "null");
             playtime = 0;
             send_songstarted (playing_track);
+            pl_lock ();
+            defer_events = 0;
+            pl_unlock ();
             last_bitrate = -1;
             avg_bitrate = -1;
             playlist_track = playing_track;
@@ -1571,7 +1728,7 @@ streamer_thread (void *ctx) {
                 pl_item_ref (playing_track);
             }
             ev->playpos = playpos;
-            messagepump_push_event ((ddb_event_t*)ev, 0, 0);
+            streamer_push_event ((ddb_event_t*)ev);
         }
 
         // read ahead at 2x speed of output samplerate, in 4k blocks
@@ -1827,6 +1984,12 @@ streamer_dsp_chain_save (void) {
 
 void
 streamer_dsp_postinit (void) {
+    if (dsp_pipe) {
+        // the chain may have been replaced, drop the workers
+        dsppipe_print_stats (dsp_pipe);
+        dsppipe_set_chain (dsp_pipe, NULL);
+    }
+
     // note about EQ hack:
     // we 1st check if there's an EQ in dsp chain, and just use it
     // if not -- we add our own
@@ -1875,6 +2038,20 @@ streamer_dsp_postinit (void) {
     else if (!ctx) {
         dsp_on = 0;
     }
+    if (dsp_pipe) {
+        dsppipe_set_chain (dsp_pipe, dsp_chain);
+    }
+
+    ctx = dsp_chain;
+    for (int i = 0; i < MAX_PERF_DSP; i++) {
+        perf_dsp_process[i] = 0;
+        if (ctx) {
+            char name[100];
+            snprintf (name, sizeof (name), "dsp.%s.process", ctx->plugin->plugin.id);
+            perf_dsp_process[i] = perf_counter (name);
+            ctx = ctx->next;
+        }
+    }
 }
 
 void
@@ -1943,6 +2120,12 @@ streamer_init (void) {
 
     pl_set_order (conf_get_int ("playback.order", 0));
 
+    perf_pcm_convert = perf_counter ("streamer.pcm_convert");
+    perf_replaygain = perf_counter ("streamer.replaygain");
+    perf_streamer_read = perf_counter ("streamer.read");
+
+    conf_dsp_pipeline = conf_get_int ("streamer.dsp_pipeline", 0);
+    dsp_pipe = dsppipe_new ();
     streamer_dsp_init ();
     
     replaygain_set (conf_get_int ("replaygain_mode", 0), conf_get_int ("replaygain_scale", 1), conf_get_float ("replaygain_preamp", 0), conf_get_float ("global_preamp", 0));
@@ -1967,6 +2150,7 @@ streamer_free (void) {
     streamer_abort_files ();
     streaming_terminate = 1;
     thread_join (streamer_tid);
+    streamer_free_deferred_events ();
 
     if (streaming_track) {
         pl_item_unref (streaming_track);
@@ -1996,12 +2180,43 @@ streamer_free (void) {
 
     streamer_dsp_chain_save();
 
+    if (dsp_pipe) {
+        dsppipe_print_stats (dsp_pipe);
+        dsppipe_free (dsp_pipe);
+        dsp_pipe = NULL;
+    }
+
     streamer_dsp_chain_free (dsp_chain);
     dsp_chain = NULL;
 
     eqplug = NULL;
     eq = NULL;
 
+    if (vis_history) {
+        free (vis_history);
+        vis_history = NULL;
+    }
+    vis_history_size = 0;
+    vis_history_fill = 0;
+    vis_history_channels = 0;
+    vis_history_samplerate = 0;
+    if (vis_scratch) {
+        free (vis_scratch);
+        vis_scratch = NULL;
+    }
+    vis_scratch_channels = 0;
+
+    if (scratch_input) {
+        free (scratch_input);
+        scratch_input = NULL;
+    }
+    scratch_input_size = 0;
+    if (scratch_dsp) {
+        free (scratch_dsp);
+        scratch_dsp = NULL;
+    }
+    scratch_dsp_size = 0;
+
     if (handler) {
         handler_free (handler);
         handler = NULL;
@@ -2018,6 +2233,14 @@ streamer_reset (int full) { // must be called when current song changes by exter
         streamer_lock ();
         streamer_ringbuf.remaining = 0;
         streamer_unlock ();
+        // the data they waited for is dropped, e.g. on seek or stop
+        streamer_send_deferred_events ();
+    }
+
+    // drop blocks queued for pipelined dsp before resetting the contexts
+    if (dsp_pipe) {
+        dsppipe_flush (dsp_pipe);
+        dsp_pipe_eof = 0;
     }
 
     // reset dsp
@@ -2061,6 +2284,138 @@ streamer_set_output_format (void) {
     return 0;
 }
 
+// calls read or read_float of the current decoder, timing it
+static int
+streamer_decoder_read (char *bytes, int size, int use_float) {
+    if (fileinfo->plugin != perf_decoder) {
+        char name[100];
+        snprintf (name, sizeof (name), "decoder.%s.read", fileinfo->plugin->plugin.id);
+        perf_decoder_read = perf_counter (name);
+        perf_decoder = fileinfo->plugin;
+    }
+    int64_t t = perf_begin ();
+    int nb;
+    if (use_float) {
+        nb = fileinfo->plugin->read_float (fileinfo, (float *)bytes, size);
+    }
+    else {
+        nb = fileinfo->plugin->read (fileinfo, bytes, size);
+    }
+    perf_end (perf_decoder_read, t);
+    return nb;
+}
+
+static int
+streamer_pcm_convert (const ddb_waveformat_t *inputfmt, const char *input, const ddb_waveformat_t *outputfmt, char *output, int inputsize) {
+    int64_t t = perf_begin ();
+    noalloc_begin ();
+    int res = pcm_convert (inputfmt, input, outputfmt, output, inputsize);
+    noalloc_end ();
+    perf_end (perf_pcm_convert, t);
+    return res;
+}
+
+// decodes up to nframes into buffer as float samples in dspfmt;
+// sets *is_eof if the decoder returned less than that
+static int
+streamer_decode_float (float *buffer, int nframes, const ddb_waveformat_t *dspfmt, int *is_eof) {
+    int dspsamplesize = fileinfo->fmt.channels * sizeof (float);
+    if (fileinfo->plugin->plugin.api_vminor >= 7 && fileinfo->plugin->read_float) {
+        // decoder can produce float directly
+        int floatsize = nframes * dspsamplesize;
+        int nb = streamer_decoder_read ((char *)buffer, floatsize, 1);
+        if (nb != floatsize) {
+            *is_eof = 1;
+        }
+        return nb / dspsamplesize;
+    }
+
+    int inputsamplesize = fileinfo->fmt.channels * fileinfo->fmt.bps / 8;
+    nframes = min (nframes, scratch_input_size / inputsamplesize);
+    int inputsize = nframes * inputsamplesize;
+
+    // decode pcm
+    int nb = streamer_decoder_read (scratch_input, inputsize, 0);
+    if (nb != inputsize) {
+        *is_eof = 1;
+    }
+
+    // convert to float
+    if (nb > 0) {
+        streamer_pcm_convert (&fileinfo->fmt, scratch_input, dspfmt, (char *)buffer, nb);
+    }
+    return nb / inputsamplesize;
+}
+
+// converts output of the dsp chain to the output format, switching the
+// output to the channels/samplerate which the chain produced
+// returns number of bytes written
+static int
+streamer_dsp_output (const float *samples, int nframes, const ddb_waveformat_t *dspfmt, char *bytes) {
+    DB_output_t *output = plug_get_output ();
+    ddb_waveformat_t outfmt;
+    // preserve sampleformat, but take channels, samplerate
+    outfmt.bps = fileinfo->fmt.bps;
+    outfmt.is_float = fileinfo->fmt.is_float;
+    // channelmask from dsp chain
+    outfmt.channels = dspfmt->channels;
+    outfmt.samplerate = dspfmt->samplerate;
+    outfmt.channelmask = dspfmt->channelmask;
+    outfmt.is_bigendian = fileinfo->fmt.is_bigendian;
+    if (memcmp (&output_format, &outfmt, sizeof (ddb_waveformat_t)) && bytes_until_next_song <= 0) {
+        memcpy (&output_format, &outfmt, sizeof (ddb_waveformat_t));
+        streamer_set_output_format ();
+    }
+
+    //printf ("convert from %dbit %s %dch %dHz channelmask=%X to %dbit %s %dch %dHz channelmask=%X\n", dspfmt->bps, dspfmt->is_float ? "float" : "int", dspfmt->channels, dspfmt->samplerate, dspfmt->channelmask, output->fmt.bps, output->fmt.is_float ? "float" : "int", output->fmt.channels, output->fmt.samplerate, output->fmt.channelmask);
+
+    return streamer_pcm_convert (dspfmt, (const char *)samples, &output->fmt, bytes, nframes * dspfmt->channels * sizeof (float));
+}
+
+// (re)allocates the scratch buffers when the input or output format changed
+// since the last call
+// must be called with decodemutex locked
+static int
+streamer_reserve_scratch (const ddb_waveformat_t *inputfmt, const ddb_waveformat_t *outputfmt) {
+    if (scratch_input && scratch_dsp
+            && !memcmp (inputfmt, &scratch_input_fmt, sizeof (ddb_waveformat_t))
+            && !memcmp (outputfmt, &scratch_output_fmt, sizeof (ddb_waveformat_t))) {
+        return 0;
+    }
+    int outputsamplesize = outputfmt->channels * outputfmt->bps / 8;
+    if (outputsamplesize <= 0) {
+        outputsamplesize = 1;
+    }
+    int frames = MAX_BLOCK_SIZE / outputsamplesize;
+#ifdef ANDROID
+    // reads are scaled up for 2x/4x downsampling
+    frames *= 4;
+#endif
+    int inputsize = frames * inputfmt->channels * inputfmt->bps / 8;
+    int dspsize = frames * inputfmt->channels * sizeof (float) * MAX_DSP_RATIO;
+    trace ("streamer: scratch buffers %d/%d bytes\n", inputsize, dspsize);
+
+    if (inputsize > scratch_input_size) {
+        char *p = realloc (scratch_input, inputsize);
+        if (!p) {
+            return -1;
+        }
+        scratch_input = p;
+        scratch_input_size = inputsize;
+    }
+    if (dspsize > scratch_dsp_size) {
+        float *p = realloc (scratch_dsp, dspsize);
+        if (!p) {
+            return -1;
+        }
+        scratch_dsp = p;
+        scratch_dsp_size = dspsize;
+    }
+    memcpy (&scratch_input_fmt, inputfmt, sizeof (ddb_waveformat_t));
+    memcpy (&scratch_output_fmt, outputfmt, sizeof (ddb_waveformat_t));
+    return 0;
+}
+
 // decodes data and converts to current output format
 // returns number of bytes been read
 static int
@@ -2076,6 +2431,12 @@ streamer_read_async (char *bytes, int size) {
     }
     int is_eof = 0;
 
+    if (fileinfo->fmt.samplerate != -1 && streamer_reserve_scratch (&fileinfo->fmt, &output->fmt) < 0) {
+        fprintf (stderr, "streamer: failed to allocate scratch buffers\n");
+        mutex_unlock (decodemutex);
+        return -1;
+    }
+
     if (fileinfo->fmt.samplerate != -1) {
         int outputsamplesize = output->fmt.channels * output->fmt.bps / 8;
         int inputsamplesize = fileinfo->fmt.channels * fileinfo->fmt.bps / 8;
@@ -2108,68 +2469,71 @@ streamer_read_async (char *bytes, int size) {
 
         if (!memcmp (&fileinfo->fmt, &output->fmt, sizeof (ddb_waveformat_t)) && (!dsp_on || can_bypass)) {
             // pass through from input to output
-            bytesread = fileinfo->plugin->read (fileinfo, bytes, size);
+            bytesread = streamer_decoder_read (bytes, size, 0);
 
             if (bytesread != size) {
                 is_eof = 1;
             }
         }
-        else if (dsp_on) {
-            // convert to float, pass through streamer DSP chain
-            int dspsamplesize = fileinfo->fmt.channels * sizeof (float);
-            int dsp_num_frames = size / (output->fmt.channels * output->fmt.bps / 8);
-
-            char outbuf[dsp_num_frames * dspsamplesize];
-
-            int inputsize = dsp_num_frames * inputsamplesize;
-            char input[inputsize];
+        else if (dsp_on && conf_dsp_pipeline && dsp_pipe) {
+            // same as below, but the chain runs on dsppipe workers, so the
+            // data returned here was decoded by earlier calls
+            int dsp_num_frames = size / outputsamplesize;
+            if (dsp_pipe_fileinfo != fileinfo) {
+                dsppipe_flush (dsp_pipe);
+                dsp_pipe_fileinfo = fileinfo;
+                dsp_pipe_eof = 0;
+            }
+            if (!dsp_pipe_eof && dsppipe_can_submit (dsp_pipe)) {
+                int nframes = streamer_decode_float (scratch_dsp, dsp_num_frames, &dspfmt, &dsp_pipe_eof);
+                if (nframes > 0) {
+                    dsppipe_submit (dsp_pipe, scratch_dsp, nframes, dsp_num_frames * MAX_DSP_RATIO, &dspfmt);
+                }
+            }
 
-            // decode pcm
-            int nb = fileinfo->plugin->read (fileinfo, input, inputsize);
-            if (nb != inputsize) {
+            // only block when the pipe is full, or has to be drained
+            int wait = dsp_pipe_eof || !dsppipe_can_submit (dsp_pipe);
+            ddb_waveformat_t fmt;
+            float ratio;
+            int nframes;
+            float *samples = dsppipe_peek (dsp_pipe, &nframes, &fmt, &ratio, wait);
+            if (samples) {
+                // the rest of the block stays in the pipe for the next call
+                nframes = min (nframes, dsp_num_frames);
+                dsp_ratio = ratio;
+                bytesread = streamer_dsp_output (samples, nframes, &fmt, bytes);
+                dsppipe_consume (dsp_pipe, nframes);
+            }
+            if (dsp_pipe_eof && !dsppipe_pending (dsp_pipe)) {
                 is_eof = 1;
+                dsp_pipe_eof = 0;
             }
-            inputsize = nb;
+        }
+        else if (dsp_on) {
+            // convert to float, pass through streamer DSP chain
+            int dspsamplesize = fileinfo->fmt.channels * sizeof (float);
+            int dsp_num_frames = size / outputsamplesize;
 
-            if (inputsize > 0) {
-                // make *MAX_DSP_RATIO sized buffer for float data
-                char tempbuf[inputsize/inputsamplesize * dspsamplesize * MAX_DSP_RATIO];
+            // scratch_dsp has room for *MAX_DSP_RATIO of float data
+            int nframes = streamer_decode_float (scratch_dsp, dsp_num_frames, &dspfmt, &is_eof);
 
-                // convert to float
-                int tempsize = pcm_convert (&fileinfo->fmt, input, &dspfmt, tempbuf, inputsize);
-                int nframes = inputsize / inputsamplesize;
+            if (nframes > 0) {
                 ddb_dsp_context_t *dsp = dsp_chain;
                 float ratio = 1.f;
-                int maxframes = sizeof (tempbuf) / dspsamplesize;
-                while (dsp) {
+                int maxframes = scratch_dsp_size / dspsamplesize;
+                for (int i = 0; dsp; i++) {
                     if (dsp->enabled) {
                         float r = 1;
-                        nframes = dsp->plugin->process (dsp, (float *)tempbuf, nframes, maxframes, &dspfmt, &r);
+                        int64_t t = perf_begin ();
+                        nframes = dsp->plugin->process (dsp, scratch_dsp, nframes, maxframes, &dspfmt, &r);
+                        perf_end (i < MAX_PERF_DSP ? perf_dsp_process[i] : 0, t);
                         ratio *= r;
                     }
                     dsp = dsp->next;
                 }
                 dsp_ratio = ratio;
 
-                ddb_waveformat_t outfmt;
-                // preserve sampleformat, but take channels, samplerate
-                outfmt.bps = fileinfo->fmt.bps;
-                outfmt.is_float = fileinfo->fmt.is_float;
-                // channelmask from dsp chain
-                outfmt.channels = dspfmt.channels;
-                outfmt.samplerate = dspfmt.samplerate;
-                outfmt.channelmask = dspfmt.channelmask;
-                outfmt.is_bigendian = fileinfo->fmt.is_bigendian;
-                if (memcmp (&output_format, &outfmt, sizeof (ddb_waveformat_t)) && bytes_until_next_song <= 0) {
-                    memcpy (&output_format, &outfmt, sizeof (ddb_waveformat_t));
-                    streamer_set_output_format ();
-                }
-
-                //printf ("convert from %dbit %s %dch %dHz channelmask=%X to %dbit %s %dch %dHz channelmask=%X\n", dspfmt.bps, dspfmt.is_float ? "float" : "int", dspfmt.channels, dspfmt.samplerate, dspfmt.channelmask, output->fmt.bps, output->fmt.is_float ? "float" : "int", output->fmt.channels, output->fmt.samplerate, output->fmt.channelmask);
-
-                int n = pcm_convert (&dspfmt, tempbuf, &output->fmt, bytes, nframes * dspfmt.channels * sizeof (float));
-
-                bytesread = n;
+                bytesread = streamer_dsp_output (scratch_dsp, nframes, &dspfmt, bytes);
             }
         }
         else {
@@ -2185,9 +2549,8 @@ streamer_read_async (char *bytes, int size) {
             }
 #endif
             // convert from input fmt to output fmt
-            int inputsize = size/outputsamplesize*inputsamplesize;
-            char input[inputsize];
-            int nb = fileinfo->plugin->read (fileinfo, input, inputsize);
+            int inputsize = min (size/outputsamplesize*inputsamplesize, scratch_input_size);
+            int nb = streamer_decoder_read (scratch_input, inputsize, 0);
             if (nb != inputsize) {
                 bytesread = nb;
                 is_eof = 1;
@@ -2196,7 +2559,7 @@ streamer_read_async (char *bytes, int size) {
 //            trace ("convert %d|%d|%d|%d|%d|%d to %d|%d|%d|%d|%d|%d\n"
 //                , fileinfo->fmt.bps, fileinfo->fmt.channels, fileinfo->fmt.samplerate, fileinfo->fmt.channelmask, fileinfo->fmt.is_float, fileinfo->fmt.is_bigendian
 //                , output->fmt.bps, output->fmt.channels, output->fmt.samplerate, output->fmt.channelmask, output->fmt.is_float, output->fmt.is_bigendian);
-            bytesread = pcm_convert (&fileinfo->fmt, input, &output->fmt, bytes, inputsize);
+            bytesread = streamer_pcm_convert (&fileinfo->fmt, scratch_input, &output->fmt, bytes, inputsize);
 
 #ifdef ANDROID
             // downsample
@@ -2253,7 +2616,11 @@ streamer_read_async (char *bytes, int size) {
         }
 #endif
 
+        int64_t t = perf_begin ();
+        noalloc_begin ();
         replaygain_apply (&output->fmt, streaming_track, bytes, bytesread);
+        noalloc_end ();
+        perf_end (perf_replaygain, t);
     }
     mutex_unlock (decodemutex);
     if (!is_eof) {
@@ -2271,12 +2638,71 @@ streamer_read_async (char *bytes, int size) {
     return bytesread;
 }
 
+// (re)allocates vis history and scratch when the output format changed
+static void
+streamer_vis_reserve (const ddb_waveformat_t *fmt) {
+    if (fmt->channels != vis_history_channels || fmt->samplerate != vis_history_samplerate) {
+        vis_history_fill = 0;
+        vis_history_pos = 0;
+        vis_history_channels = fmt->channels;
+        vis_history_samplerate = fmt->samplerate;
+        int size = fmt->samplerate * VIS_HISTORY_SEC;
+        if (vis_history) {
+            free (vis_history);
+        }
+        vis_history = malloc (size * fmt->channels * sizeof (float));
+        vis_history_size = vis_history ? size : 0;
+    }
+    if (fmt->channels != vis_scratch_channels) {
+        if (vis_scratch) {
+            free (vis_scratch);
+        }
+        vis_scratch = malloc (VIS_BLOCK_FRAMES * fmt->channels * sizeof (float));
+        vis_scratch_channels = vis_scratch ? fmt->channels : 0;
+    }
+}
+
+// stores the new frames, and replaces them with the same amount of frames
+// which end delay frames earlier, when history allows
+static void
+streamer_vis_delay (float *data, int frames, const ddb_waveformat_t *fmt, int delay) {
+    if (!vis_history || frames > vis_history_size) {
+        return;
+    }
+
+    int ch = fmt->channels;
+    int n = frames;
+    const float *src = data;
+    while (n > 0) {
+        int chunk = min (n, vis_history_size - vis_history_pos);
+        memcpy (vis_history + vis_history_pos * ch, src, chunk * ch * sizeof (float));
+        vis_history_pos = (vis_history_pos + chunk) % vis_history_size;
+        src += chunk * ch;
+        n -= chunk;
+    }
+    vis_history_fill = min (vis_history_fill + frames, vis_history_size);
+
+    if (delay > vis_history_fill - frames) {
+        delay = vis_history_fill - frames;
+    }
+    if (delay <= 0) {
+        return;
+    }
+    int pos = (vis_history_pos - delay - frames + 2 * vis_history_size) % vis_history_size;
+    float *dst = data;
+    n = frames;
+    while (n > 0) {
+        int chunk = min (n, vis_history_size - pos);
+        memcpy (dst, vis_history + pos * ch, chunk * ch * sizeof (float));
+        pos = (pos + chunk) % vis_history_size;
+        dst += chunk * ch;
+        n -= chunk;
+    }
+}
+
 int
 streamer_read (char *bytes, int size) {
-#if 0
-    struct timeval tm1;
-    gettimeofday (&tm1, NULL);
-#endif
+    int64_t perf_start = perf_begin ();
     if (!playing_track) {
         return -1;
     }
@@ -2297,6 +2723,14 @@ streamer_read (char *bytes, int size) {
                 bytes_until_next_song = 0;
             }
         }
+        if (num_deferred_events) {
+            pl_lock ();
+            deferred_events_bytes -= sz;
+            if (deferred_events_bytes <= 0) {
+                streamer_send_deferred_events ();
+            }
+            pl_unlock ();
+        }
     }
     streamer_unlock ();
 
@@ -2325,14 +2759,6 @@ streamer_read (char *bytes, int size) {
         avg_bitrate = -1;
     }
 
-#if 0
-    struct timeval tm2;
-    gettimeofday (&tm2, NULL);
-
-    int ms = (tm2.tv_sec*1000+tm2.tv_usec/1000) - (tm1.tv_sec*1000+tm1.tv_usec/1000);
-    printf ("streamer_read took %d ms\n", ms);
-#endif
-
     if (waveform_listeners || spectrum_listeners) {
         int in_frame_size = (output->fmt.bps >> 3) * output->fmt.channels;
         int in_frames = sz / in_frame_size;
@@ -2345,52 +2771,66 @@ streamer_read (char *bytes, int size) {
             .is_bigendian = 0
         };
 
-        float temp_audio_data[in_frames * out_fmt.channels];
-        pcm_convert (&output->fmt, bytes, &out_fmt, (char *)temp_audio_data, sz);
-        ddb_audio_data_t data;
-        data.fmt = &out_fmt;
-        data.data = temp_audio_data;
-        data.nframes = in_frames;
-        mutex_lock (wdl_mutex);
-        for (wavedata_listener_t *l = waveform_listeners; l; l = l->next) {
-            l->callback (l->ctx, &data);
-        }
-        mutex_unlock (wdl_mutex);
-
-        if (out_fmt.channels != audio_data_channels || !spectrum_listeners) {
-            audio_data_fill = 0;
-            audio_data_channels = out_fmt.channels;
-        }
-
-        if (spectrum_listeners) {
-            int remaining = in_frames;
-            do {
-                int sz = DDB_FREQ_BANDS * 2 -audio_data_fill;
-                sz = min (sz, remaining);
-                for (int c = 0; c < audio_data_channels; c++) {
-                    for (int s = 0; s < sz; s++) {
-                        audio_data[DDB_FREQ_BANDS * 2 * c + audio_data_fill + s] = temp_audio_data[(in_frames-remaining + s) * audio_data_channels + c];
-                    }
-                }
-                //            memcpy (&audio_data[audio_data_fill], &temp_audio_data[in_frames-remaining], sz * sizeof (float));
-                audio_data_fill += sz;
-                remaining -= sz;
-                if (audio_data_fill == DDB_FREQ_BANDS * 2) {
+        streamer_vis_reserve (&out_fmt);
+        if (!vis_scratch) {
+            in_frames = 0;
+        }
+        int delay = streamer_output_delay (output);
+
+        // the output picks the block size, so convert it in pieces which fit
+        // vis_scratch
+        for (int pos = 0; pos < in_frames; pos += VIS_BLOCK_FRAMES) {
+            int nframes = min (in_frames - pos, VIS_BLOCK_FRAMES);
+            float *temp_audio_data = vis_scratch;
+            noalloc_begin ();
+            pcm_convert (&output->fmt, bytes + pos * in_frame_size, &out_fmt, (char *)temp_audio_data, nframes * in_frame_size);
+            streamer_vis_delay (temp_audio_data, nframes, &out_fmt, delay);
+            noalloc_end ();
+            ddb_audio_data_t data;
+            data.fmt = &out_fmt;
+            data.data = temp_audio_data;
+            data.nframes = nframes;
+            mutex_lock (wdl_mutex);
+            for (wavedata_listener_t *l = waveform_listeners; l; l = l->next) {
+                l->callback (l->ctx, &data);
+            }
+            mutex_unlock (wdl_mutex);
+
+            if (out_fmt.channels != audio_data_channels || !spectrum_listeners) {
+                audio_data_fill = 0;
+                audio_data_channels = out_fmt.channels;
+            }
+
+            if (spectrum_listeners) {
+                int remaining = nframes;
+                do {
+                    int sz = DDB_FREQ_BANDS * 2 -audio_data_fill;
+                    sz = min (sz, remaining);
                     for (int c = 0; c < audio_data_channels; c++) {
-                        calc_freq (&audio_data[DDB_FREQ_BANDS * 2 * c], &freq_data[DDB_FREQ_BANDS * c]);
+                        for (int s = 0; s < sz; s++) {
+                            audio_data[DDB_FREQ_BANDS * 2 * c + audio_data_fill + s] = temp_audio_data[(nframes-remaining + s) * audio_data_channels + c];
+                        }
                     }
-                    ddb_audio_data_t data;
-                    data.fmt = &out_fmt;
-                    data.data = freq_data;
-                    data.nframes = DDB_FREQ_BANDS;
-                    mutex_lock (wdl_mutex);
-                    for (wavedata_listener_t *l = spectrum_listeners; l; l = l->next) {
-                        l->callback (l->ctx, &data);
+                    //            memcpy (&audio_data[audio_data_fill], &temp_audio_data[in_frames-remaining], sz * sizeof (float));
+                    audio_data_fill += sz;
+                    remaining -= sz;
+                    if (audio_data_fill == DDB_FREQ_BANDS * 2) {
+                        for (int c = 0; c < audio_data_channels; c++) {
+                            calc_freq (&audio_data[DDB_FREQ_BANDS * 2 * c], &freq_data[DDB_FREQ_BANDS * c]);
+                        }
+                        ddb_audio_data_t data;
+                        data.fmt = &out_fmt;
+                        data.data = freq_data;
+                        data.nframes = DDB_FREQ_BANDS;
+                        mutex_lock (wdl_mutex);
+                        for (wavedata_listener_t *l = spectrum_listeners; l; l = l->next) {
+                            l->callback (l->ctx, &data);
+                        }
+                        mutex_unlock (wdl_mutex);
+                        audio_data_fill = 0;
                     }
-                    mutex_unlock (wdl_mutex);
-                    audio_data_fill = 0;
-                }
-            } while (remaining > 0);
+                } while (remaining > 0);
+            }
         }
     }
 
@@ -2446,6 +2886,7 @@ streamer_read (char *bytes, int size) {
         }
     }
 
+    perf_end (perf_streamer_read, perf_start);
     return sz;
 }
 
@@ -2492,6 +2933,19 @@ streamer_configchanged (void) {
 
     trace_bufferfill = conf_get_int ("streamer.trace_buffer_fill",0);
 
+    // takes effect on the next block, the blocks queued in the pipe are
+    // dropped; locked against streamer_read_async, which uses both
+    int conf_pipeline = conf_get_int ("streamer.dsp_pipeline", 0);
+    if (conf_pipeline != conf_dsp_pipeline) {
+        mutex_lock (decodemutex);
+        conf_dsp_pipeline = conf_pipeline;
+        if (dsp_pipe) {
+            dsppipe_flush (dsp_pipe);
+            dsp_pipe_eof = 0;
+        }
+        mutex_unlock (decodemutex);
+    }
+
     stop_after_current = conf_get_int ("playlist.stop_after_current", 0);
 
     char mapstr[2048];
@@ -2518,6 +2972,7 @@ streamer_play_current_track (void) {
         }
         // unpause currently paused track
         output->unpause ();
+        streamer_send_deferred_events ();
         messagepump_push (DB_EV_PAUSED, 0, 0, 0);
     }
     else if (plt->current_row[PL_MAIN] != -1) {
@@ -2611,6 +3066,12 @@ dsp_clone (ddb_dsp_context_t *from) {
 void
 streamer_set_dsp_chain (ddb_dsp_context_t *chain) {
     mutex_lock (decodemutex);
+    if (dsp_pipe) {
+        // the workers run the old contexts, they have to be stopped (and
+        // their stats printed) before the contexts are closed
+        dsppipe_print_stats (dsp_pipe);
+        dsppipe_set_chain (dsp_pipe, NULL);
+    }
     streamer_dsp_chain_free (dsp_chain);
 
     dsp_chain = NULL;
@@ -48,6 +48,11 @@ streamer_lock (void);
 void
 streamer_unlock (void);
 
+// sends the track change events held back until the output plays the new
+// track; call before reporting a pause, which stops the countdown
+void
+streamer_send_deferred_events (void);
+
 // pstate indicates what to do with playback
 // -1 means "don't do anything"
 // -2 means "end of playlist"
@@ -65,9 +65,15 @@ cond_create (void);
 void
 cond_free (uintptr_t cond);
 
+// locks the mutex, and waits; returns with the mutex locked
 int
 cond_wait (uintptr_t cond, uintptr_t mutex);
 
+// for callers which already hold the mutex (locked once), like
+// pthread_cond_wait
+int
+cond_wait_locked (uintptr_t cond, uintptr_t mutex);
+
 int
 cond_signal (uintptr_t cond);
 
@@ -221,6 +221,17 @@ cond_wait (uintptr_t c, uintptr_t m) {
     return err;
 }
 
+int
+cond_wait_locked (uintptr_t c, uintptr_t m) {
+    pthread_cond_t *cond = (pthread_cond_t *)c;
+    pthread_mutex_t *mutex = (pthread_mutex_t *)m;
+    int err = pthread_cond_wait (cond, mutex);
+    if (err != 0) {
+        fprintf (stderr, "pthread_cond_wait failed: %s\n", strerror (err));
+    }
+    return err;
+}
+
 int
 cond_signal (uintptr_t c) {
     pthread_cond_t *cond = (pthread_cond_t *)c;
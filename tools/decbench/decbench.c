@@ -0,0 +1,360 @@
+/*
+    DeaDBeeF - ultimate music player for GNU/Linux systems with X11
+    Copyright (C) 2009-2013 Alexey Yakovenko <waker@users.sourceforge.net>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// decoder throughput benchmark
+// loads a single decoder plugin outside of the player, decodes a file from
+// start to end with the given read size, and reports MB/s of PCM output.
+// only the small subset of the plugin API which decoders use during
+// init/read/free is provided; everything else is NULL.
+// with -c, the file is also decoded with read, with read_float, and with
+// both alternating, and the number of frames must match, which catches
+// decoders dropping samples when a block doesn't fit their buffers.
+// `make check` runs that on an 8ch 24bit flac file with 4608 sample blocks,
+// the largest block size which the reference encoder produces at 48kHz.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/time.h>
+#include "../../deadbeef.h"
+
+typedef struct {
+    DB_FILE file;
+    FILE *stream;
+} bench_file_t;
+
+static DB_functions_t api;
+static DB_vfs_t vfs;
+static const char *uri;
+
+static int
+bench_is_streaming (void) {
+    return 0;
+}
+
+static DB_FILE *
+bench_fopen (const char *fname) {
+    FILE *stream = fopen (fname, "rb");
+    if (!stream) {
+        return NULL;
+    }
+    bench_file_t *f = calloc (1, sizeof (bench_file_t));
+    f->file.vfs = &vfs;
+    f->stream = stream;
+    return &f->file;
+}
+
+static void
+bench_fclose (DB_FILE *f) {
+    fclose (((bench_file_t *)f)->stream);
+    free (f);
+}
+
+static size_t
+bench_fread (void *ptr, size_t size, size_t nmemb, DB_FILE *f) {
+    return fread (ptr, size, nmemb, ((bench_file_t *)f)->stream);
+}
+
+static int
+bench_fseek (DB_FILE *f, int64_t offset, int whence) {
+    return fseeko (((bench_file_t *)f)->stream, offset, whence);
+}
+
+static int64_t
+bench_ftell (DB_FILE *f) {
+    return ftello (((bench_file_t *)f)->stream);
+}
+
+static void
+bench_rewind (DB_FILE *f) {
+    rewind (((bench_file_t *)f)->stream);
+}
+
+static int64_t
+bench_fgetlength (DB_FILE *f) {
+    FILE *stream = ((bench_file_t *)f)->stream;
+    off_t pos = ftello (stream);
+    fseeko (stream, 0, SEEK_END);
+    off_t len = ftello (stream);
+    fseeko (stream, pos, SEEK_SET);
+    return len;
+}
+
+static int
+bench_junk_get_leading_size (DB_FILE *f) {
+    return 0;
+}
+
+static const char *
+bench_pl_find_meta (DB_playItem_t *it, const char *key) {
+    if (!strcmp (key, ":URI")) {
+        return uri;
+    }
+    return NULL;
+}
+
+static int
+bench_pl_find_meta_int (DB_playItem_t *it, const char *key, int def) {
+    return def;
+}
+
+static float
+bench_pl_get_item_duration (DB_playItem_t *it) {
+    return -1;
+}
+
+static void
+bench_noop (void) {
+}
+
+static void
+bench_item_noop (DB_playItem_t *it) {
+}
+
+static void
+bench_set_bitrate (int bitrate) {
+}
+
+static int
+bench_conf_get_int (const char *key, int def) {
+    return def;
+}
+
+static float
+bench_conf_get_float (const char *key, float def) {
+    return def;
+}
+
+static void
+bench_conf_get_str (const char *key, const char *def, char *buffer, int buffer_size) {
+    snprintf (buffer, buffer_size, "%s", def);
+}
+
+enum {
+    DECODE_READ,
+    DECODE_FLOAT,
+    DECODE_ALTERNATE,
+};
+
+// decodes the whole file, returns the number of frames or -1 on error
+static int64_t
+decode_frames (DB_decoder_t *dec, DB_playItem_t *it, int mode, char *buffer, int readsize) {
+    DB_fileinfo_t *fileinfo = dec->open (0);
+    if (!fileinfo || dec->init (fileinfo, it) != 0) {
+        fprintf (stderr, "decbench: failed to open %s\n", uri);
+        exit (-1);
+    }
+    int64_t frames = 0;
+    for (int i = 0; ; i++) {
+        int use_float = mode == DECODE_FLOAT || (mode == DECODE_ALTERNATE && (i & 1));
+        int samplesize = fileinfo->fmt.channels * (use_float ? 4 : fileinfo->fmt.bps / 8);
+        // whole frames only, so that both methods stay in sync
+        int size = readsize / samplesize * samplesize;
+        if (size <= 0) {
+            fprintf (stderr, "decbench: read size %d is smaller than a frame\n", readsize);
+            exit (-1);
+        }
+        int sz = use_float ? dec->read_float (fileinfo, (float *)buffer, size) : dec->read (fileinfo, buffer, size);
+        if (sz <= 0) {
+            break;
+        }
+        if (sz % samplesize) {
+            fprintf (stderr, "decbench: partial frame returned (%d bytes)\n", sz);
+            frames = -1;
+            break;
+        }
+        frames += sz / samplesize;
+    }
+    dec->free (fileinfo);
+    return frames;
+}
+
+static double
+now (void) {
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static DB_plugin_t *
+load_plugin (const char *fname) {
+    char d_name[256];
+    const char *slash = strrchr (fname, '/');
+    slash = slash ? slash + 1 : fname;
+    size_t l = strlen (slash);
+    if (l < 3 || l >= sizeof (d_name) - 5 || strcasecmp (&slash[l-3], ".so")) {
+        fprintf (stderr, "decbench: invalid fname %s\n", fname);
+        return NULL;
+    }
+    strcpy (d_name, slash);
+    d_name[l-3] = 0;
+    strcat (d_name, "_load");
+
+    void *handle = dlopen (fname, RTLD_NOW);
+    if (!handle) {
+        fprintf (stderr, "dlopen error: %s\n", dlerror ());
+        return NULL;
+    }
+    DB_plugin_t *(*plug_load)(DB_functions_t *api) = dlsym (handle, d_name);
+    if (!plug_load) {
+        fprintf (stderr, "decbench: dlsym error: %s\n", dlerror ());
+        return NULL;
+    }
+    return plug_load (&api);
+}
+
+int
+main (int argc, char *argv[]) {
+    int readsize = 4096;
+    int iterations = 3;
+    int use_float = 0;
+    int check = 0;
+    int opt;
+    while ((opt = getopt (argc, argv, "b:n:fc")) != -1) {
+        switch (opt) {
+        case 'b':
+            readsize = atoi (optarg);
+            break;
+        case 'n':
+            iterations = atoi (optarg);
+            break;
+        case 'f':
+            use_float = 1;
+            break;
+        case 'c':
+            check = 1;
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (argc - optind != 2 || readsize <= 0 || iterations <= 0) {
+        fprintf (stderr, "usage: decbench [-b readsize] [-n iterations] [-f] [-c] plugin.so file\n"
+                "  -f  use the read_float method, if the decoder has one\n"
+                "  -c  check that read, read_float and both alternating return the same number of frames\n");
+        exit (-1);
+    }
+
+    vfs.is_streaming = bench_is_streaming;
+    vfs.open = bench_fopen;
+    vfs.close = bench_fclose;
+    vfs.read = bench_fread;
+    vfs.seek = bench_fseek;
+    vfs.tell = bench_ftell;
+    vfs.rewind = bench_rewind;
+    vfs.getlength = bench_fgetlength;
+
+    api.vmajor = DB_API_VERSION_MAJOR;
+    api.vminor = DB_API_VERSION_MINOR;
+    api.fopen = bench_fopen;
+    api.fclose = bench_fclose;
+    api.fread = bench_fread;
+    api.fseek = bench_fseek;
+    api.ftell = bench_ftell;
+    api.rewind = bench_rewind;
+    api.fgetlength = bench_fgetlength;
+    api.junk_get_leading_size = bench_junk_get_leading_size;
+    api.pl_find_meta = bench_pl_find_meta;
+    api.pl_find_meta_int = bench_pl_find_meta_int;
+    api.pl_get_item_duration = bench_pl_get_item_duration;
+    api.pl_lock = bench_noop;
+    api.pl_unlock = bench_noop;
+    api.conf_lock = bench_noop;
+    api.conf_unlock = bench_noop;
+    api.pl_item_ref = bench_item_noop;
+    api.pl_item_unref = bench_item_noop;
+    api.streamer_set_bitrate = bench_set_bitrate;
+    api.conf_get_int = bench_conf_get_int;
+    api.conf_get_float = bench_conf_get_float;
+    api.conf_get_str = bench_conf_get_str;
+
+    DB_plugin_t *plug = load_plugin (argv[optind]);
+    if (!plug) {
+        exit (-1);
+    }
+    if (plug->type != DB_PLUGIN_DECODER) {
+        fprintf (stderr, "decbench: %s is not a decoder plugin\n", plug->id);
+        exit (-1);
+    }
+    if (plug->start && plug->start ()) {
+        fprintf (stderr, "decbench: failed to start %s\n", plug->id);
+        exit (-1);
+    }
+    DB_decoder_t *dec = (DB_decoder_t *)plug;
+    int has_float = plug->api_vminor >= 7 && dec->read_float;
+    if (use_float && !has_float) {
+        fprintf (stderr, "decbench: %s has no read_float method, using read\n", plug->id);
+        use_float = 0;
+    }
+    if (check && !has_float) {
+        fprintf (stderr, "decbench: %s has no read_float method, nothing to check\n", plug->id);
+        exit (-1);
+    }
+
+    uri = argv[optind+1];
+    DB_playItem_t it = { .startsample = 0, .endsample = -1 };
+    char *buffer = malloc (readsize);
+
+    printf ("%s %d.%d, %s, read size %d\n", plug->id, plug->version_major, plug->version_minor, use_float ? "read_float" : "read", readsize);
+    double best = 0;
+    for (int i = 0; i < iterations; i++) {
+        DB_fileinfo_t *fileinfo = dec->open (0);
+        if (!fileinfo || dec->init (fileinfo, &it) != 0) {
+            fprintf (stderr, "decbench: failed to open %s\n", uri);
+            exit (-1);
+        }
+        int64_t total = 0;
+        double t = now ();
+        for (;;) {
+            int sz = use_float ? dec->read_float (fileinfo, (float *)buffer, readsize) : dec->read (fileinfo, buffer, readsize);
+            if (sz <= 0) {
+                break;
+            }
+            total += sz;
+        }
+        t = now () - t;
+        int samplesize = fileinfo->fmt.channels * (use_float ? 4 : fileinfo->fmt.bps / 8);
+        double mbps = t > 0 ? total / t / (1024 * 1024) : 0;
+        printf ("run %d: %lld bytes (%dch %dbit %dHz) in %.3f sec, %.1f MB/s, %.1fx realtime\n", i+1, (long long)total, fileinfo->fmt.channels, fileinfo->fmt.bps, fileinfo->fmt.samplerate, t, mbps, t > 0 ? total / samplesize / (double)fileinfo->fmt.samplerate / t : 0);
+        if (mbps > best) {
+            best = mbps;
+        }
+        dec->free (fileinfo);
+    }
+    printf ("best: %.1f MB/s\n", best);
+
+    int res = 0;
+    if (check) {
+        int64_t frames_read = decode_frames (dec, &it, DECODE_READ, buffer, readsize);
+        int64_t frames_float = decode_frames (dec, &it, DECODE_FLOAT, buffer, readsize);
+        int64_t frames_alternate = decode_frames (dec, &it, DECODE_ALTERNATE, buffer, readsize);
+        res = frames_read < 0 || frames_read != frames_float || frames_read != frames_alternate;
+        printf ("check: read %lld, read_float %lld, alternating %lld frames: %s\n", (long long)frames_read, (long long)frames_float, (long long)frames_alternate, res ? "FAILED" : "ok");
+    }
+
+    free (buffer);
+    if (plug->stop) {
+        plug->stop ();
+    }
+    return res;
+}
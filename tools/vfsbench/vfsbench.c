@@ -0,0 +1,181 @@
+/*
+    DeaDBeeF - ultimate music player for GNU/Linux systems with X11
+    Copyright (C) 2009-2013 Alexey Yakovenko <waker@users.sourceforge.net>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// vfs_stdio benchmark
+// reads a file through vfs_stdio, which is compiled into the tool, in
+// buffered and in mmap mode, and reports throughput and the number of
+// read/lseek/fstat/mmap calls it took. the calls are counted by wrapping
+// them at link time, see the Makefile.
+// two access patterns are measured: reading the file start to end, and
+// seeking to random offsets for small reads, like tag and header parsers do.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "../../deadbeef.h"
+
+DB_plugin_t *
+stdio_load (DB_functions_t *api);
+
+static DB_functions_t api;
+static int use_mmap;
+
+static int64_t nread;
+static int64_t nlseek;
+static int64_t nfstat;
+static int64_t nmmap;
+
+ssize_t __real_read (int fd, void *buf, size_t count);
+off64_t __real_lseek64 (int fd, off64_t offset, int whence);
+int __real_fstat (int fd, struct stat *st);
+void *__real_mmap (void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+
+ssize_t
+__wrap_read (int fd, void *buf, size_t count) {
+    nread++;
+    return __real_read (fd, buf, count);
+}
+
+off64_t
+__wrap_lseek64 (int fd, off64_t offset, int whence) {
+    nlseek++;
+    return __real_lseek64 (fd, offset, whence);
+}
+
+int
+__wrap_fstat (int fd, struct stat *st) {
+    nfstat++;
+    return __real_fstat (fd, st);
+}
+
+void *
+__wrap_mmap (void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    nmmap++;
+    return __real_mmap (addr, length, prot, flags, fd, offset);
+}
+
+static int
+bench_conf_get_int (const char *key, int def) {
+    if (!strcmp (key, "vfs_stdio.mmap")) {
+        return use_mmap;
+    }
+    return def;
+}
+
+static double
+now (void) {
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// returns the number of bytes read
+static int64_t
+run (DB_vfs_t *vfs, const char *fname, int probe, int readsize, int nprobes, char *buffer) {
+    DB_FILE *f = vfs->open (fname);
+    if (!f) {
+        fprintf (stderr, "vfsbench: failed to open %s\n", fname);
+        exit (-1);
+    }
+    int64_t total = 0;
+    if (!probe) {
+        size_t rb;
+        while ((rb = vfs->read (buffer, 1, readsize, f)) > 0) {
+            total += rb;
+        }
+    }
+    else {
+        int64_t len = vfs->getlength (f);
+        srand (1);
+        for (int i = 0; i < nprobes; i++) {
+            int64_t pos = len > readsize ? (int64_t)((double)rand () / RAND_MAX * (len - readsize)) : 0;
+            vfs->seek (f, pos, SEEK_SET);
+            // a few small reads around each position, like a header parser
+            for (int j = 0; j < 4; j++) {
+                total += vfs->read (buffer, 1, readsize, f);
+            }
+        }
+    }
+    vfs->close (f);
+    return total;
+}
+
+int
+main (int argc, char *argv[]) {
+    int readsize = 4096;
+    int iterations = 3;
+    int nprobes = 10000;
+    int opt;
+    while ((opt = getopt (argc, argv, "b:n:p:")) != -1) {
+        switch (opt) {
+        case 'b':
+            readsize = atoi (optarg);
+            break;
+        case 'n':
+            iterations = atoi (optarg);
+            break;
+        case 'p':
+            nprobes = atoi (optarg);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (argc - optind != 1 || readsize <= 0 || iterations <= 0 || nprobes <= 0) {
+        fprintf (stderr, "usage: vfsbench [-b readsize] [-n iterations] [-p probes] file\n"
+                "  -p  number of random seeks in the probe pattern\n");
+        exit (-1);
+    }
+    const char *fname = argv[optind];
+
+    api.vmajor = DB_API_VERSION_MAJOR;
+    api.vminor = DB_API_VERSION_MINOR;
+    api.conf_get_int = bench_conf_get_int;
+    DB_vfs_t *vfs = (DB_vfs_t *)stdio_load (&api);
+    char *buffer = malloc (readsize);
+
+    printf ("%s, read size %d\n", fname, readsize);
+    for (int probe = 0; probe < 2; probe++) {
+        for (use_mmap = 0; use_mmap < 2; use_mmap++) {
+            double best = 0;
+            int64_t total = 0;
+            for (int i = 0; i < iterations; i++) {
+                nread = nlseek = nfstat = nmmap = 0;
+                double t = now ();
+                total = run (vfs, fname, probe, readsize, nprobes, buffer);
+                t = now () - t;
+                double mbps = t > 0 ? total / t / (1024 * 1024) : 0;
+                if (mbps > best) {
+                    best = mbps;
+                }
+            }
+            // the call counts are the same for every run
+            printf ("%-10s %-8s %lld bytes, best %.1f MB/s, read %lld, lseek %lld, fstat %lld, mmap %lld\n", probe ? "probe" : "sequential", use_mmap ? "mmap" : "buffered", (long long)total, best, (long long)nread, (long long)nlseek, (long long)nfstat, (long long)nmmap);
+        }
+    }
+    free (buffer);
+    return 0;
+}
@@ -33,6 +33,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #ifndef __linux__
 #define off64_t off_t
@@ -42,6 +43,13 @@
 
 //#define USE_STDIO
 
+// small reads (tag parsing, header probing) are served from this buffer,
+// reads larger than the buffer go straight to the file
+#define STDIO_BUFFER_SIZE 0x4000
+
+// files larger than that are never mmapped
+#define STDIO_MAX_MMAP_SIZE 0x40000000
+
 static DB_functions_t *deadbeef;
 typedef struct {
     DB_vfs_t *vfs;
@@ -50,6 +58,20 @@ typedef struct {
 #else
     int stream;
     int64_t offs;
+
+    // read-ahead buffer, contains file data from bufoffs to bufoffs+buflen;
+    // the file descriptor position is always at bufoffs+buflen
+    int64_t bufoffs;
+    int buflen;
+    uint8_t *buffer;
+
+    // whole file mapping, used instead of the buffer in mmap mode
+    uint8_t *map;
+    int64_t mapsize;
+    // the file size was last verified for reads from mapcheckoffs to
+    // mapcheckend
+    int64_t mapcheckoffs;
+    int64_t mapcheckend;
 #endif
 } STDIO_FILE;
 
@@ -72,10 +94,27 @@ stdio_open (const char *fname) {
     }
 #endif
     STDIO_FILE *fp = malloc (sizeof (STDIO_FILE));
+    memset (fp, 0, sizeof (STDIO_FILE));
     fp->vfs = &plugin;
     fp->stream = file;
 #ifndef USE_STDIO
-    fp->offs = 0;
+    struct stat st;
+    if (deadbeef->conf_get_int ("vfs_stdio.mmap", 0) && !fstat (file, &st) && S_ISREG (st.st_mode)
+            && st.st_size > 0 && st.st_size <= STDIO_MAX_MMAP_SIZE) {
+        void *map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, file, 0);
+        if (map != MAP_FAILED) {
+            fp->map = map;
+            fp->mapsize = st.st_size;
+#ifdef __linux__
+            madvise (map, st.st_size, MADV_SEQUENTIAL);
+#endif
+            return (DB_FILE*)fp;
+        }
+    }
+#ifdef __linux__
+    posix_fadvise (file, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    fp->buffer = malloc (STDIO_BUFFER_SIZE);
 #endif
     return (DB_FILE*)fp;
 }
@@ -86,11 +125,33 @@ stdio_close (DB_FILE *stream) {
 #ifdef USE_STDIO
     fclose (((STDIO_FILE *)stream)->stream);
 #else
-    close (((STDIO_FILE *)stream)->stream);
+    STDIO_FILE *fp = (STDIO_FILE *)stream;
+    if (fp->map) {
+        munmap (fp->map, fp->mapsize);
+    }
+    if (fp->buffer) {
+        free (fp->buffer);
+    }
+    close (fp->stream);
 #endif
     free (stream);
 }
 
+#ifndef USE_STDIO
+// switches the handle from mmap mode to the read-ahead buffer, keeping the
+// current position
+static void
+stdio_unmap (STDIO_FILE *fp) {
+    munmap (fp->map, fp->mapsize);
+    fp->map = NULL;
+    fp->mapsize = 0;
+    fp->buffer = malloc (STDIO_BUFFER_SIZE);
+    lseek64 (fp->stream, fp->offs, SEEK_SET);
+    fp->bufoffs = fp->offs;
+    fp->buflen = 0;
+}
+#endif
+
 static size_t
 stdio_read (void *ptr, size_t size, size_t nmemb, DB_FILE *stream) {
     assert (stream);
@@ -98,12 +159,79 @@ stdio_read (void *ptr, size_t size, size_t nmemb, DB_FILE *stream) {
 #ifdef USE_STDIO
     return fread (ptr, size, nmemb, ((STDIO_FILE*)stream)->stream);
 #else
-    int res = read (((STDIO_FILE*)stream)->stream, ptr, size*nmemb);
-    if (res == -1) {
-        return 0;
+    STDIO_FILE *fp = (STDIO_FILE *)stream;
+    size_t sz = size * nmemb;
+    if (fp->map) {
+        // touching pages past the end of a file which was truncated while
+        // mapped raises SIGBUS, so the size is checked whenever a read leaves
+        // the last verified STDIO_BUFFER_SIZE window (about as many syscalls
+        // as the buffered path makes), and the handle falls back to read()
+        // for good if the file shrank.
+        // a truncate between the check and the copy can still crash,
+        // which is why mmap mode is off by default
+        struct stat st;
+        if (fp->offs < fp->mapcheckoffs || fp->offs + (int64_t)sz > fp->mapcheckend) {
+            if (fstat (fp->stream, &st) || st.st_size < fp->mapsize) {
+                stdio_unmap (fp);
+            }
+            else {
+                fp->mapcheckoffs = fp->offs;
+                fp->mapcheckend = fp->offs + (sz > STDIO_BUFFER_SIZE ? sz : STDIO_BUFFER_SIZE);
+            }
+        }
+        if (fp->map) {
+            if (fp->offs >= fp->mapsize) {
+                return 0;
+            }
+            if (sz > fp->mapsize - fp->offs) {
+                sz = fp->mapsize - fp->offs;
+            }
+            memcpy (ptr, fp->map + fp->offs, sz);
+            fp->offs += sz;
+            return sz / size;
+        }
     }
-    ((STDIO_FILE*)stream)->offs += res;
-    return res / size;
+
+    size_t total = 0;
+    while (sz > 0) {
+        int64_t bufpos = fp->offs - fp->bufoffs;
+        if (bufpos < fp->buflen) {
+            // serve from buffer
+            size_t n = fp->buflen - bufpos;
+            if (n > sz) {
+                n = sz;
+            }
+            memcpy (ptr, fp->buffer + bufpos, n);
+            ptr = (uint8_t *)ptr + n;
+            sz -= n;
+            total += n;
+            fp->offs += n;
+            continue;
+        }
+        if (sz >= STDIO_BUFFER_SIZE || !fp->buffer) {
+            // large read, bypass the buffer
+            ssize_t res = read (fp->stream, ptr, sz);
+            if (res <= 0) {
+                break;
+            }
+            total += res;
+            fp->offs += res;
+            fp->bufoffs = fp->offs;
+            fp->buflen = 0;
+            if ((size_t)res < sz) {
+                break;
+            }
+            sz -= res;
+            continue;
+        }
+        ssize_t res = read (fp->stream, fp->buffer, STDIO_BUFFER_SIZE);
+        fp->bufoffs = fp->offs;
+        fp->buflen = res > 0 ? res : 0;
+        if (res <= 0) {
+            break;
+        }
+    }
+    return total / size;
 #endif
 }
 
@@ -113,12 +241,37 @@ stdio_seek (DB_FILE *stream, int64_t offset, int whence) {
 #ifdef USE_STDIO
     return fseek (((STDIO_FILE *)stream)->stream, offset, whence);
 #else
-    off64_t res = lseek64 (((STDIO_FILE *)stream)->stream, offset, whence);
+    STDIO_FILE *fp = (STDIO_FILE *)stream;
+    if (whence == SEEK_CUR) {
+        offset += fp->offs;
+        whence = SEEK_SET;
+    }
+    else if (whence == SEEK_END && fp->map) {
+        offset += fp->mapsize;
+        whence = SEEK_SET;
+    }
+    if (fp->map) {
+        if (offset < 0) {
+            return -1;
+        }
+        fp->offs = offset;
+        return 0;
+    }
+    if (whence == SEEK_SET && offset >= fp->bufoffs && offset <= fp->bufoffs + fp->buflen) {
+        // inside of the read-ahead buffer, no need to touch the file
+        fp->offs = offset;
+        return 0;
+    }
+    off64_t res = lseek64 (fp->stream, offset, whence);
     if (res == -1) {
+        // keep the file position in sync with the buffer
+        lseek64 (fp->stream, fp->bufoffs + fp->buflen, SEEK_SET);
         return -1;
     }
 //    printf ("lseek res: %lld (%lld, %d, prev=%lld)\n", res, offset, whence,  ((STDIO_FILE*)stream)->offs);
-    ((STDIO_FILE*)stream)->offs = res; 
+    fp->offs = res;
+    fp->bufoffs = res;
+    fp->buflen = 0;
 #endif
     return 0;
 }
@@ -154,9 +307,14 @@ stdio_getlength (DB_FILE *stream) {
     fseek (f->stream, offs, SEEK_SET);
     return l;
 #else
-    int64_t size = lseek64 (f->stream, 0, SEEK_END);
-    lseek64 (f->stream, f->offs, SEEK_SET);
-    return size;
+    // no shortcut for mapped files, the size can change while mapped
+    struct stat st;
+    if (fstat (f->stream, &st) || !S_ISREG (st.st_mode)) {
+        int64_t size = lseek64 (f->stream, 0, SEEK_END);
+        lseek64 (f->stream, f->bufoffs + f->buflen, SEEK_SET);
+        return size;
+    }
+    return st.st_size;
 #endif
 }
 
@@ -170,6 +328,10 @@ stdio_is_streaming (void) {
     return 0;
 }
 
+static const char settings_dlg[] =
+    "property \"Map files into memory instead of reading (mmap)\" checkbox vfs_stdio.mmap 0;\n"
+;
+
 // standard stdio vfs
 static DB_vfs_t plugin = {
     DB_PLUGIN_SET_API_VERSION
@@ -197,6 +359,7 @@ static DB_vfs_t plugin = {
         "Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.\n"
     ,
     .plugin.website = "http://deadbeef.sf.net",
+    .plugin.configdialog = settings_dlg,
     .open = stdio_open,
     .close = stdio_close,
     .read = stdio_read,